@@ -1,4 +1,4 @@
 #!/bin/bash
-(cd _build ; cmake -DCMAKE_BUILD_TYPE=Debug .. && make && ./sn_test)
-# valgrind --trace-children=yes --leak-check=full ./sn_test
+(cd _build ; cmake -DCMAKE_BUILD_TYPE=Debug .. && make && ./sn_test32 && ./sn_test64 && ./sn_test64_noasm)
+# valgrind --trace-children=yes --leak-check=full ./sn_test64
 
@@ -1,17 +1,245 @@
 #include <assert.h>
 #include <endian.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "number.h"
 
+#if SN_FD_STREAMS
+#  include <errno.h>
+#  include <unistd.h>
+#endif // SN_FD_STREAMS
+
+/** Double-width word holding the full result of a word-by-word product. */
+#if SN_WORD_BITS == 64
+__extension__ typedef unsigned __int128 sn_dword;
+#else
+typedef uint64_t sn_dword;
+#endif // SN_WORD_BITS
+
+/**
+ * Whether hand-written x86-64 kernels are built in next to the portable ones.
+ * They are only used on processors that support them; define SN_NO_ASM to
+ * leave them out altogether.
+ */
+#if !defined(SN_NO_ASM) && SN_WORD_BITS == 64 && defined(__x86_64__) && defined(__GNUC__)
+#  define SN_X86_64_KERNELS 1
+#  include <cpuid.h>
+#  include <immintrin.h>
+#else
+#  define SN_X86_64_KERNELS 0
+#endif // SN_X86_64_KERNELS
+
+struct sn_ntt_prime;
+struct sn_arena_chunk;
+struct sn_prime_test;
+
 static bool sn_valid__(const SN *);
+static inline size_t sn_capacity__(const SN *);
 static SN *sn_resize__(SN * const, size_t);
-static SN *sn_add_internal__(SN * const restrict, const SN *, const SN *, bool);
-static SN *sn_sub_internal__(SN * const restrict, const SN *, const SN *);
+static inline unsigned sn_clz__(sn_word);
+static inline unsigned sn_popcount__(sn_word);
+static inline bool sn_is_inline__(const SN *);
+static SN *sn_realloc__(SN * const, size_t);
+static void sn_normalize__(SN * const);
+static SN *sn_set_blocks__(SN * const, const sn_word *, size_t, bool);
+static void *sn_std_alloc__(void *, size_t);
+static void *sn_std_realloc__(void *, void *, size_t, size_t);
+static void sn_std_free__(void *, void *, size_t);
+static inline void *sn_mem_alloc__(size_t);
+static inline void *sn_mem_realloc__(void *, size_t, size_t);
+static inline void sn_mem_free__(void *, size_t);
+static struct sn_arena_chunk *sn_arena_grow__(sn_ctx *, size_t);
+static sn_word *sn_tmp_alloc__(size_t);
+static void sn_tmp_free__(sn_word *, size_t);
+static sn_word sn_mul_1_c__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_addmul_1_c__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_add_n_c__(sn_word *, const sn_word *, const sn_word *, size_t);
+static sn_word sn_sub_n_c__(sn_word *, const sn_word *, const sn_word *, size_t);
+static sn_word sn_submul_1_c__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_lshift_c__(sn_word *, const sn_word *, size_t, unsigned);
+static sn_word sn_rshift_c__(sn_word *, const sn_word *, size_t, unsigned);
+#if SN_X86_64_KERNELS
+static sn_word sn_mul_1_x86__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_addmul_1_x86__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_add_n_x86__(sn_word *, const sn_word *, const sn_word *, size_t);
+static sn_word sn_sub_n_x86__(sn_word *, const sn_word *, const sn_word *, size_t);
+static sn_word sn_submul_1_x86__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_lshift_avx2__(sn_word *, const sn_word *, size_t, unsigned);
+static sn_word sn_rshift_avx2__(sn_word *, const sn_word *, size_t, unsigned);
+static void sn_kernels_init__(void);
+#endif // SN_X86_64_KERNELS
+static inline sn_word sn_mul_1__(sn_word *, const sn_word *, size_t, sn_word);
+static inline sn_word sn_addmul_1__(sn_word *, const sn_word *, size_t, sn_word);
+static inline sn_word sn_add_n__(sn_word *, const sn_word *, const sn_word *, size_t);
+static inline sn_word sn_sub_n__(sn_word *, const sn_word *, const sn_word *, size_t);
+static inline sn_word sn_submul_1__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_add_1__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_sub_1__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_add__(sn_word *, const sn_word *, size_t, const sn_word *, size_t);
+static sn_word sn_sub__(sn_word *, const sn_word *, size_t, const sn_word *, size_t);
+static int sn_cmp__(const sn_word *, size_t, const sn_word *, size_t);
+static bool sn_abs_sub__(sn_word *, const sn_word *, size_t, const sn_word *, size_t);
+static inline sn_word sn_lshift__(sn_word *, const sn_word *, size_t, unsigned);
+static inline sn_word sn_rshift__(sn_word *, const sn_word *, size_t, unsigned);
+static void sn_divexact_by3__(sn_word *, const sn_word *, size_t);
+static void sn_mul_basecase__(sn_word *, const sn_word *, size_t, const sn_word *, size_t);
+static void sn_ntt_roots__(uint32_t *, size_t, uint32_t, const struct sn_ntt_prime *);
+static void sn_ntt_dif_level_c__(uint32_t *, size_t, size_t, const uint32_t *,
+        const struct sn_ntt_prime *);
+static void sn_ntt_dit_level_c__(uint32_t *, size_t, size_t, const uint32_t *,
+        const struct sn_ntt_prime *);
+static void sn_ntt_pointwise_c__(uint32_t *, const uint32_t *, size_t, uint32_t,
+        const struct sn_ntt_prime *);
+#if SN_X86_64_KERNELS
+static void sn_ntt_dif_level_avx2__(uint32_t *, size_t, size_t, const uint32_t *,
+        const struct sn_ntt_prime *);
+static void sn_ntt_dit_level_avx2__(uint32_t *, size_t, size_t, const uint32_t *,
+        const struct sn_ntt_prime *);
+static void sn_ntt_pointwise_avx2__(uint32_t *, const uint32_t *, size_t, uint32_t,
+        const struct sn_ntt_prime *);
+#endif // SN_X86_64_KERNELS
+static void sn_ntt_dif__(uint32_t *, size_t, const uint32_t *, const struct sn_ntt_prime *);
+static void sn_ntt_dit__(uint32_t *, size_t, const uint32_t *, const struct sn_ntt_prime *);
+static size_t sn_ntt_size__(size_t, size_t);
+static bool sn_ntt_fits__(size_t, size_t);
+static size_t sn_ntt_scratch__(size_t, size_t);
+static void sn_ntt_forward__(uint32_t *, size_t, const sn_word *, size_t, const uint32_t *,
+        const struct sn_ntt_prime *);
+static void sn_mul_ntt__(sn_word *, const sn_word *, size_t, const sn_word *, size_t, sn_word *);
+static size_t sn_mul_n_scratch__(size_t);
+static size_t sn_mul_scratch__(size_t, size_t);
+static void sn_add_into__(sn_word *, size_t, const sn_word *, size_t);
+static void sn_mul_karatsuba__(sn_word *, const sn_word *, const sn_word *, size_t, sn_word *);
+static bool sn_toom3_eval__(sn_word *, sn_word *, sn_word *, const sn_word *, size_t, size_t);
+static void sn_toom3_interpolate__(sn_word *, size_t, sn_word *, sn_word *, sn_word *, bool,
+        sn_word *);
+static void sn_mul_toom3__(sn_word *, const sn_word *, const sn_word *, size_t, sn_word *);
+static void sn_mul_n__(sn_word *, const sn_word *, const sn_word *, size_t, sn_word *);
+static void sn_mul_internal__(sn_word *, const sn_word *, size_t, const sn_word *, size_t,
+        sn_word *);
+static size_t sn_sqr_scratch__(size_t);
+static void sn_sqr_basecase__(sn_word *, const sn_word *, size_t);
+static void sn_sqr_karatsuba__(sn_word *, const sn_word *, size_t, sn_word *);
+static void sn_sqr_toom3__(sn_word *, const sn_word *, size_t, sn_word *);
+static void sn_sqr_n__(sn_word *, const sn_word *, size_t, sn_word *);
+static sn_word sn_divrem_1__(sn_word *, const sn_word *, size_t, sn_word);
+static sn_word sn_mod_1__(const sn_word *, size_t, sn_word);
+static void sn_div_knuth__(sn_word *, sn_word *, size_t, const sn_word *, size_t);
+static size_t sn_div_2n1n_scratch__(size_t);
+static void sn_div_2n1n__(sn_word *, sn_word *, const sn_word *, const sn_word *, size_t,
+        sn_word *);
+static void sn_div_3n2n__(sn_word *, sn_word *, const sn_word *, const sn_word *, size_t,
+        sn_word *);
+static bool sn_divrem__(sn_word *, sn_word *, const sn_word *, size_t, const sn_word *,
+        size_t);
+static inline size_t sn_mont_ctx_size__(size_t);
+static sn_word sn_mont_minv__(sn_word);
+static size_t sn_mont_scratch__(size_t);
+static void sn_mont_redc__(sn_word *, sn_word *, const sn_mont_ctx *);
+static void sn_mont_mul__(sn_word *, const sn_word *, const sn_word *, const sn_mont_ctx *,
+        sn_word *);
+static void sn_mont_sqr__(sn_word *, const sn_word *, const sn_mont_ctx *, sn_word *);
+static size_t sn_powm_scratch__(size_t, size_t);
+static void sn_powm__(sn_word *, const sn_word *, const sn_word *, size_t,
+        const sn_mont_ctx *, sn_word *);
+#if SN_X86_64_KERNELS
+static void sn_ifma_mont_mul__(uint64_t *, const uint64_t *, const uint64_t *,
+        const uint64_t *, const uint64_t *, size_t, uint64_t *);
+static void sn_ifma_select__(uint64_t *, const uint64_t *, size_t, const uint64_t *, size_t);
+static void sn_ifma_load__(uint64_t *, size_t, const sn_word *, size_t, size_t);
+static void sn_ifma_store__(sn_word *, size_t, const uint64_t *, size_t, size_t);
+static size_t sn_ifma_limbs__(const sn_mont_ctx * const [], size_t);
+static bool sn_powm_ifma__(SN * const [], const SN * const [], const SN * const [],
+        const sn_mont_ctx * const [], size_t, size_t);
+#endif // SN_X86_64_KERNELS
+static inline size_t sn_barrett_ctx_size__(size_t);
+static size_t sn_barrett_scratch__(const sn_barrett_ctx *);
+static void sn_barrett_reduce__(sn_word *, const sn_word *, size_t, const sn_barrett_ctx *,
+        sn_word *);
+static SN *sn_add_internal__(SN * const, const SN *, const SN *, bool);
+static SN *sn_sub_internal__(SN * const, const SN *, const SN *);
+static SN *sn_divmod_internal__(SN * const, SN * const, const SN *, const SN *, bool);
+static SN *sn_bitwise__(SN * const, const SN *, const SN *, sn_word, sn_word);
+static SN *sn_add_pow2__(SN * const, size_t, bool);
+static double sn_to_double__(const SN *, size_t *);
+static bool sn_sqrt__(SN * const, SN * const, const SN *, SN * const);
+static bool sn_root_pow__(SN * const, const SN *, unsigned);
+static bool sn_root__(SN * const, const SN *, unsigned, SN [2]);
+static bool sn_mont_load__(sn_word *, const SN *, const sn_mont_ctx *);
+static SN *sn_barrett_store__(SN * const, const sn_word *, size_t, bool,
+        const sn_barrett_ctx *);
+static sn_word sn_gcd_1__(sn_word, sn_word);
+static sn_dword sn_gcd_2__(sn_dword, sn_dword);
+static size_t sn_strip_twos__(sn_word *, size_t, size_t *);
+static SN *sn_gcd_binary__(SN * const, const SN *, const SN *);
+static sn_word sn_gcd_word__(const SN *, size_t);
+static inline sn_dword sn_lehmer_quotient__(sn_dword, sn_dword);
+static bool sn_lehmer_matrix__(sn_word [4], const SN *, const SN *, size_t);
+static void sn_gcd_matvec_1__(sn_word *, sn_word *, const sn_word *, const sn_word *, size_t,
+        const sn_word [4]);
+static bool sn_gcd_extend__(SN * const, size_t);
+static bool sn_gcd_apply_1__(SN * const, SN * const, const sn_word [4], SN [2]);
+static bool sn_gcd_rows_1__(SN * const, size_t, const sn_word [4], SN [2]);
+static SN *sn_gcd_low__(SN * const, const SN *, size_t);
+static bool sn_hgcd_lift__(SN * const, SN * const, const SN *, const SN *, size_t, const SN [4],
+        SN [4]);
+static bool sn_gcd_rows__(SN * const, size_t, const SN [4], SN [2]);
+static bool sn_gcd_div_step__(SN * const, SN * const, size_t, SN * const, size_t, SN [2]);
+static bool sn_hgcd_reducible__(const SN *, const SN *, size_t, SN * const);
+static void sn_gcd_identity__(SN [4]);
+static bool sn_hgcd__(SN * const, SN * const, SN [4]);
+static bool sn_gcd_reduce__(SN * const, SN * const, SN * const);
+static bool sn_small_prime__(sn_word);
+static bool sn_presieve__(unsigned *, const sn_word *, size_t);
+static int sn_jacobi_1__(sn_word, sn_word);
+static int sn_jacobi_small__(long, const SN *);
+static SN *sn_addmod__(SN * const, const SN *, const SN *, const SN *);
+static SN *sn_submod__(SN * const, const SN *, const SN *, const SN *);
+static SN *sn_halfmod__(SN * const, const SN *);
+static int sn_selfridge__(long *, const SN *);
+static int sn_strong_fermat__(const struct sn_prime_test *, sn_word, SN * const);
+static int sn_strong_lucas__(const struct sn_prime_test *);
+static int sn_prime_test__(const SN *, unsigned);
+static bool sn_fixed_from_sn__(sn_word *, size_t, const SN *);
+static inline int sn_fixed_cmp__(const sn_word *, const sn_word *, size_t);
+static inline sn_word sn_fixed_add__(sn_word *, const sn_word *, const sn_word *, size_t);
+static inline sn_word sn_fixed_sub__(sn_word *, const sn_word *, const sn_word *, size_t);
+static inline void sn_fixed_mul__(sn_word *, const sn_word *, const sn_word *, size_t);
+static inline void sn_fixed_sqr__(sn_word *, const sn_word *, size_t);
+static inline void sn_fixed_mont_final__(sn_word *, sn_word *, const sn_word *, size_t);
+static inline void sn_fixed_mont_mul__(sn_word *, const sn_word *, const sn_word *,
+        const sn_word *, sn_word, size_t, sn_word *);
+static bool sn_fixed_mont_init__(sn_word *, sn_word *, const sn_word *, size_t);
+static inline int sn_host_endian__(void);
+static inline sn_word sn_bswap__(sn_word);
+static unsigned sn_get_bits__(const SN *, size_t, unsigned);
+static void sn_export_bytes__(uint8_t *, size_t, const SN *, bool);
+static void sn_import_bytes__(SN * const, const uint8_t *, size_t, bool);
+static unsigned sn_radix_bits__(unsigned);
+static sn_word sn_radix_chunk__(unsigned, unsigned *);
+static unsigned sn_digit_value__(char);
+static bool sn_radix_powers__(SN *[], size_t [], size_t *, unsigned, size_t);
+static void sn_to_str_pow2__(char *, size_t, const SN *, unsigned);
+static bool sn_to_str_basecase__(char *, size_t, const SN *, unsigned);
+static bool sn_to_str_dc__(char *, size_t, const SN *, unsigned, SN * const [],
+        const size_t [], size_t);
+static void sn_from_str_pow2__(SN * const, const char *, size_t, unsigned);
+static SN *sn_from_str_basecase__(SN * const, const char *, size_t, unsigned);
+static SN *sn_from_str_dc__(SN * const, const char *, size_t, unsigned, SN * const [],
+        const size_t [], size_t);
+static size_t sn_varint_encode__(uint8_t *, uint64_t);
+static size_t sn_stream_padding__(uint64_t);
+static bool sn_writer_put__(sn_writer *, const void *, size_t);
+static sn_writer *sn_writer_start__(FILE *, int, unsigned);
+static bool sn_reader_fill__(sn_reader *);
+static bool sn_reader_get__(sn_reader *, void *, size_t);
+static sn_reader *sn_reader_start__(FILE *, int);
 
 /* =============================================================================
  * Initialization and cleanup functions
@@ -19,24 +247,59 @@ static SN *sn_sub_internal__(SN * const restrict, const SN *, const SN *);
  */
 
 /**
- * Initialize a number and set it to zero.
+ * Initialize a number and set it to zero. Values of up to SN_INLINE_BLOCKS
+ * blocks are kept inside the number itself, so this never allocates.
  */
 SN *sn_init(SN * const num) {
     assert(num);
 
-    num->blocks = calloc(1, sizeof(*num->blocks));
-    if (!num->blocks) {
-        return NULL;
+    num->blocks    = num->small;
+    num->blocks[0] = 0;
+    num->size      = 1;
+    num->neg       = false;
+    num->view      = false;
+    num->capacity  = SN_INLINE_BLOCKS;
+
+    return num;
+}
+
+/**
+ * Make `num` a nonnegative read-only view of the `size` blocks at `blocks`,
+ * e.g. in a memory-mapped file, without copying them. Leading zero blocks
+ * are left out of the view. Like sn_init(), this never allocates and does not
+ * release what `num` held before. The blocks must stay valid as long as the
+ * view is used; sn_release() and sn_free() leave them alone, and a view that
+ * is assigned a result moves to memory of its own first.
+ */
+SN *sn_view(SN * const num, const sn_word *blocks, size_t size) {
+    assert(num && (blocks || size == 0));
+
+    while (size > 0 && blocks[size - 1] == 0) {
+        --size;
     }
 
-    num->size = 1;
-    num->neg  = false;
+    if (size == 0) {
+        return sn_init(num);
+    }
+
+    /* Never written through: results move the view to blocks of its own */
+    num->blocks   = (sn_word *)(uintptr_t)blocks;
+    num->size     = size;
+    num->neg      = false;
+    num->view     = true;
+    num->capacity = size;
 
     return num;
 }
 
+bool sn_is_view(const SN *num) {
+    assert(num);
+
+    return num->view;
+}
+
 SN *sn_new(void) {
-    SN *ret = malloc(sizeof(*ret));
+    SN *ret = sn_mem_alloc__(sizeof(*ret));
     if (!ret) {
         return NULL;
     }
@@ -48,13 +311,21 @@ SN *sn_copy(SN * const restrict dst, const SN * restrict src) {
     assert(dst && src && sn_valid__(src));
     assert(dst != src);
 
-    *dst = *src;
-    dst->blocks = malloc(src->size * sizeof(*src->blocks));
-    if (!dst->blocks) {
-        return NULL;
+    if (src->size <= SN_INLINE_BLOCKS) {
+        dst->blocks   = dst->small;
+        dst->capacity = SN_INLINE_BLOCKS;
+    } else {
+        dst->blocks = sn_mem_alloc__(src->size * sizeof(*src->blocks));
+        if (!dst->blocks) {
+            return NULL;
+        }
+        dst->capacity = src->size;
     }
 
     memcpy(dst->blocks, src->blocks, src->size * sizeof(*src->blocks));
+    dst->size = src->size;
+    dst->neg  = src->neg;
+    dst->view = false;
 
     return dst;
 }
@@ -62,12 +333,17 @@ SN *sn_copy(SN * const restrict dst, const SN * restrict src) {
 SN *sn_duplicate(const SN *src) {
     assert(src);
 
-    SN *dup = malloc(sizeof(*dup));
+    SN *dup = sn_mem_alloc__(sizeof(*dup));
     if (!dup) {
         return NULL;
     }
 
-    return sn_copy(dup, src);
+    if (!sn_copy(dup, src)) {
+        sn_mem_free__(dup, sizeof(*dup));
+        return NULL;
+    }
+
+    return dup;
 }
 
 void sn_swap(SN * const restrict a, SN * const restrict b) {
@@ -75,20 +351,50 @@ void sn_swap(SN * const restrict a, SN * const restrict b) {
     tmp = *a;
     *a  = *b;
     *b  = tmp;
+
+    /* Inline blocks moved along with the structures */
+    if (a->blocks == b->small) {
+        a->blocks = a->small;
+    }
+    if (b->blocks == a->small) {
+        b->blocks = b->small;
+    }
+}
+
+/**
+ * Free the heap blocks of a number, e.g. one initialized on the stack with
+ * sn_init(), but not the number itself. The number is left as zero and can
+ * be used again.
+ */
+void sn_release(SN * const num) {
+    assert(num && num->blocks);
+
+    if (!sn_is_inline__(num) && !num->view) {
+        sn_mem_free__(num->blocks, sn_capacity__(num) * sizeof(*num->blocks));
+    }
+
+    sn_init(num);
 }
 
 void sn_free(SN *num) {
     assert(num && num->blocks);
 
-    free(num->blocks);
-    free(num);
+    sn_release(num);
+    sn_mem_free__(num, sizeof(*num));
     num = NULL;
 }
 
 void sn_clear(SN * const num) {
     assert(num);
 
-    memset(num->blocks, 0, sn_num_bytes(num));
+    /* A view has no blocks of its own to wipe */
+    if (num->view) {
+        sn_init(num);
+        return;
+    }
+
+    /* Also wipe whatever earlier values left beyond the used blocks */
+    memset(num->blocks, 0, sn_capacity__(num) * sizeof(*num->blocks));
     sn_zero(num);
 
     num->size = 1;
@@ -102,50 +408,92 @@ void sn_clear_free(SN * const num) {
     sn_free(num);
 }
 
+/**
+ * Set a number to zero. The allocated blocks are kept for later use.
+ */
 void sn_zero(SN * const num) {
     assert(num && sn_valid__(num));
 
-    if (num->size > 1) {
-        sn_resize__(num, 1);
+    if (num->view) {
+        sn_init(num);
     }
 
+    num->size      = 1;
     num->neg       = false;
     num->blocks[0] = 0;
 }
 
+/**
+ * Set a number to one. The allocated blocks are kept for later use.
+ */
 void sn_one(SN * const num) {
     assert(num && sn_valid__(num));
 
-    if (num->size > 1) {
-        sn_resize__(num, 1);
+    if (num->view) {
+        sn_init(num);
     }
 
+    num->size      = 1;
     num->neg       = false;
     num->blocks[0] = 1;
 }
 
+/**
+ * Make room for at least `capacity` blocks, so that results up to that size
+ * can be stored in `num` without reallocating. The value is unchanged.
+ */
+SN *sn_reserve(SN * const num, size_t capacity) {
+    assert(num && sn_valid__(num));
+
+    if (capacity <= sn_capacity__(num)) {
+        return num;
+    }
+
+    return sn_realloc__(num, capacity);
+}
+
+/**
+ * Release the allocated blocks beyond those in use. A value that fits is moved
+ * back into the inline blocks.
+ */
+SN *sn_shrink_to_fit(SN * const num) {
+    assert(num && sn_valid__(num));
+
+    if (sn_is_inline__(num) || num->view) {
+        return num;
+    } else if (num->size <= SN_INLINE_BLOCKS) {
+        memcpy(num->small, num->blocks, num->size * sizeof(*num->blocks));
+        sn_mem_free__(num->blocks, sn_capacity__(num) * sizeof(*num->blocks));
+        num->blocks   = num->small;
+        num->capacity = SN_INLINE_BLOCKS;
+        return num;
+    } else if (num->capacity && num->capacity <= num->size) {
+        return num;
+    }
+
+    return sn_realloc__(num, num->size);
+}
+
+size_t sn_capacity(const SN *num) {
+    assert(num);
+
+    return sn_capacity__(num);
+}
+
 /* =============================================================================
  * Comparisons and tests
  * =============================================================================
  */
 
+/**
+ * Compare the magnitudes of `a` and `b`, starting from the most significant
+ * blocks. Normalized numbers of different sizes are told apart by their top
+ * blocks alone.
+ */
 int sn_ucmp(const SN *a, const SN *b) {
     assert(a && b);
 
-    if (a->size > b->size) {
-        return 1;
-    } else if (a->size < b->size) {
-        return -1;
-    } else {
-        for (size_t i = 0; i < a->size; ++i) {
-            if (a->blocks[i] > b->blocks[i])
-                return 1;
-            else if (a->blocks[i] < b->blocks[i])
-                return -1;
-        }
-    }
-
-    return 0;
+    return sn_cmp__(a->blocks, a->size, b->blocks, b->size);
 }
 
 int sn_cmp(const SN *a, const SN *b) {
@@ -200,21 +548,36 @@ bool sn_is_even(const SN *num) {
 }
 
 /* **********************************************************************************
- * ????
+ * Size queries
  */
 
+/**
+ * Number of bytes needed to store the magnitude of `num` in binary, e.g. with
+ * sn_sn2bin(); zero needs none.
+ */
 size_t sn_num_bytes(const SN *num) {
     assert(num);
 
-    /* FIXME: Not precise */
-    return num->size * sizeof(*num->blocks);
+    return (sn_num_bits(num) + 7) / 8;
 }
 
+/**
+ * Number of significant bits in the magnitude of `num`; zero has none. For a
+ * normalized number this only looks at the top block.
+ */
 size_t sn_num_bits(const SN *num) {
     assert(num);
 
-    /* FIXME */
-    return 0;
+    size_t n = num->size;
+    while (n > 0 && num->blocks[n - 1] == 0) {
+        --n;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+
+    return n * SN_WORD_BITS - sn_clz__(num->blocks[n - 1]);
 }
 
 /* **********************************************************************************
@@ -222,18 +585,34 @@ size_t sn_num_bits(const SN *num) {
  */
 
 static bool sn_valid__(const SN *num) {
-    return num && num->blocks && num->size;
+    return num && num->blocks && num->size
+        && (!num->capacity || num->size <= num->capacity);
+}
+
+/**
+ * Number of blocks known to be allocated. Numbers set up by hand with a zero
+ * capacity are assumed to have exactly `size` blocks.
+ */
+static inline size_t sn_capacity__(const SN *num) {
+    return num->capacity ? num->capacity : num->size;
 }
 
+/**
+ * Set the number of blocks in use. The new blocks are uninitialized. Growing
+ * past the capacity at least doubles it, so that a sequence of ever larger
+ * results reallocates only a logarithmic number of times; shrinking never
+ * releases memory (see sn_shrink_to_fit()).
+ */
 static SN *sn_resize__(SN * const num, size_t new_size) {
     assert(num && sn_valid__(num) && new_size > 0);
 
-    if (num->size == new_size) {
-        return num;
+    /* The old value may still be read as an operand, so keep all of it */
+    if (num->view && !sn_realloc__(num, max(new_size, num->size))) {
+        return NULL;
     }
 
-    num->blocks = realloc(num->blocks, new_size * sizeof(*num->blocks));
-    if (!num->blocks) {
+    if (new_size > sn_capacity__(num)
+            && !sn_realloc__(num, max(new_size, 2 * sn_capacity__(num)))) {
         return NULL;
     }
 
@@ -242,218 +621,6740 @@ static SN *sn_resize__(SN * const num, size_t new_size) {
     return num;
 }
 
-/* **********************************************************************************
- * Basic arithmetic operations
- */
-/* addition
- * --------
- *  a +  b =   a + b
- * -a +  b =   b - a  ↓
- *  a + -b =   a - b  ↓
- * -a + -b = -(a + b)
- *
- * subtraction
- * -----------
- *  a -  b =   a - b
- * -a -  b = -(a + b) ↑
- *  a - -b =   a + b  ↑
- * -a - -b =   b - a
- */
+/** Number of leading zero bits in the nonzero block `w` */
+static inline unsigned sn_clz__(sn_word w) {
+    assert(w != 0);
 
-SN *sn_add(SN * const res, const SN *a, const SN *b) {
-    assert(res && a && b && sn_valid__(res) && sn_valid__(a) && sn_valid__(b));
-    assert(res->blocks != a->blocks && res->blocks != b->blocks);
+#if SN_WORD_BITS == 64
+    return (unsigned)__builtin_clzll(w);
+#else
+    return (unsigned)__builtin_clz(w);
+#endif // SN_WORD_BITS
+}
 
-    if (a->neg && !b->neg) {
-        return sn_sub_internal__(res, b, a);
-    } else if (!a->neg && b->neg) {
-        return sn_sub_internal__(res, a, b);
-    }
+/** Number of trailing zero bits in the nonzero block `w` */
+static inline unsigned sn_ctz__(sn_word w) {
+    assert(w != 0);
 
-    assert(a->neg == b->neg);
+#if SN_WORD_BITS == 64
+    return (unsigned)__builtin_ctzll(w);
+#else
+    return (unsigned)__builtin_ctz(w);
+#endif // SN_WORD_BITS
+}
 
-    return sn_add_internal__(res, a, b, a->neg);
+/** Number of set bits in the block `w` */
+static inline unsigned sn_popcount__(sn_word w) {
+#if SN_WORD_BITS == 64
+    return (unsigned)__builtin_popcountll(w);
+#else
+    return (unsigned)__builtin_popcount(w);
+#endif // SN_WORD_BITS
 }
 
-SN *sn_sub(SN * const res, const SN *a, const SN *b) {
-    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
-    assert(res->blocks != a->blocks && res->blocks != b->blocks);
+/** Whether the blocks of `num` are stored inside the number itself */
+static inline bool sn_is_inline__(const SN *num) {
+    return num->blocks == num->small;
+}
 
-    if (a->neg && !b->neg) {
-        return sn_add_internal__(res, a, b, true);
-    } else if (!a->neg && b->neg) {
-        return sn_add_internal__(res, a, b, false);
-    }
+/**
+ * Move the used blocks of `num` onto the heap, into exactly `capacity` >= size
+ * blocks. Blocks other than the inline ones are owned by the number, unless it
+ * is a view, which stops being one.
+ */
+static SN *sn_realloc__(SN * const num, size_t capacity) {
+    assert(capacity >= num->size && capacity > 0);
 
-    assert(a->neg == b->neg);
+    sn_word *blocks;
 
-    if (a->neg) {
-        return sn_sub_internal__(res, b, a);
+    if (sn_is_inline__(num) || num->view) {
+        blocks = sn_mem_alloc__(capacity * sizeof(*blocks));
+        if (!blocks) {
+            return NULL;
+        }
+        memcpy(blocks, num->blocks, num->size * sizeof(*blocks));
     } else {
-        return sn_sub_internal__(res, a, b);
+        blocks = sn_mem_realloc__(num->blocks, sn_capacity__(num) * sizeof(*blocks),
+                capacity * sizeof(*blocks));
+        if (!blocks) {
+            return NULL;
+        }
     }
-}
 
-SN *sn_mul(SN * const res, const SN *a, const SN *b) {
-    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
-    assert(res->blocks != a->blocks && res->blocks != b->blocks);
+    num->blocks   = blocks;
+    num->capacity = capacity;
+    num->view     = false;
 
-    if (a->neg || b->neg) {
-        return res;
-    }
+    return num;
+}
 
-    size_t product_size = max(a->size, b->size);
-    if (!sn_resize__(res, product_size)) {
-        return NULL;
+/**
+ * Strip leading zero blocks so that the most significant block is nonzero,
+ * unless the number is zero, which is kept as a single block. Zero is never
+ * negative.
+ */
+static void sn_normalize__(SN * const num) {
+    while (num->size > 1 && num->blocks[num->size - 1] == 0) {
+        --num->size;
     }
 
-    bool overflow = false;
-    sn_word tmp;
+    if (num->size == 1 && num->blocks[0] == 0) {
+        num->neg = false;
+    }
+}
 
-    for (size_t i = 0; i < a->size; ++i) {
-        tmp = 0;
-        for (size_t j = 0; j < b->size; ++j) {
-            tmp     += a->blocks[i] * b->blocks[j] + overflow;
-            overflow = (tmp < a->blocks[i] && tmp < b->blocks[j]);
-        }
-        res->blocks[i] = tmp;
+/**
+ * Set `num` to the `n` blocks at `src` with the sign `neg` and normalize it.
+ * `src` may point into the blocks of `num` itself; an empty array is zero.
+ */
+static SN *sn_set_blocks__(SN * const num, const sn_word *src, size_t n, bool neg) {
+    if (n == 0) {
+        sn_zero(num);
+        return num;
     }
 
-    if (overflow) {
-        if (!sn_resize__(res, product_size + 1)) {
+    if (src != num->blocks) {
+        if (!sn_resize__(num, n)) {
             return NULL;
         }
-        res->blocks[product_size] = overflow;
+        memcpy(num->blocks, src, n * sizeof(*src));
+    } else {
+        assert(n <= num->size);
+        num->size = n;
     }
 
-    res->neg = false;
+    num->neg = neg;
+    sn_normalize__(num);
 
-    return res;
+    return num;
 }
 
-static SN *sn_add_internal__(SN * const res, const SN *a, const SN *b, bool negative) {
-    size_t sum_size = max(a->size, b->size);
-    if (!sn_resize__(res, sum_size)) {
-        return NULL;
+/* **********************************************************************************
+ * Memory management
+ */
+
+static void *sn_std_alloc__(void *state, size_t size) {
+    return malloc(size);
+}
+
+static void *sn_std_realloc__(void *state, void *ptr, size_t old_size, size_t new_size) {
+    return realloc(ptr, new_size);
+}
+
+static void sn_std_free__(void *state, void *ptr, size_t size) {
+    free(ptr);
+}
+
+static sn_allocator sn_allocator__ = {
+    sn_std_alloc__, sn_std_realloc__, sn_std_free__, NULL
+};
+
+/** Context providing the temporaries of the calling thread, if any */
+static _Thread_local sn_ctx *sn_ctx_current__;
+
+/** Part of an arena. Every chunk is at least as large as the previous one. */
+struct sn_arena_chunk {
+    struct sn_arena_chunk *prev;
+    size_t  size; /* Number of blocks */
+    size_t  used; /* Number of blocks handed out, from the start */
+    sn_word blocks[];
+};
+
+struct sn_ctx {
+    struct sn_arena_chunk *top; /* Chunk that temporaries are taken from */
+};
+
+/**
+ * Install the allocation functions used from now on; NULL restores the
+ * standard library ones. This is not thread-safe, and memory obtained from
+ * the previous allocator must not be freed afterwards.
+ */
+void sn_set_allocator(const sn_allocator *allocator) {
+    if (allocator) {
+        assert(allocator->alloc && allocator->realloc && allocator->free);
+        sn_allocator__ = *allocator;
+    } else {
+        sn_allocator__ = (sn_allocator){
+            sn_std_alloc__, sn_std_realloc__, sn_std_free__, NULL
+        };
     }
+}
 
-    bool overflow = false;
-    sn_word tmp   = 0;
+void sn_get_allocator(sn_allocator *allocator) {
+    assert(allocator);
 
-    for (size_t i = 0; i < sum_size; ++i) {
-        if (i >= a->size) {
-            tmp            = b->blocks[i] + overflow;
-            res->blocks[i] = tmp;
-            overflow       = (tmp < b->blocks[i]);
-        } else if (i >= b->size) {
-            tmp            = a->blocks[i] + overflow;
-            res->blocks[i] = tmp;
-            overflow       = (tmp < a->blocks[i]);
-        } else {
-            tmp            = a->blocks[i] + b->blocks[i] + overflow;
-            res->blocks[i] = tmp;
-            overflow       = (tmp < a->blocks[i] || tmp < b->blocks[i]);
-        }
+    *allocator = sn_allocator__;
+}
+
+static inline void *sn_mem_alloc__(size_t size) {
+    return sn_allocator__.alloc(sn_allocator__.state, size);
+}
+
+static inline void *sn_mem_realloc__(void *ptr, size_t old_size, size_t new_size) {
+    return sn_allocator__.realloc(sn_allocator__.state, ptr, old_size, new_size);
+}
+
+static inline void sn_mem_free__(void *ptr, size_t size) {
+    if (ptr) {
+        sn_allocator__.free(sn_allocator__.state, ptr, size);
     }
+}
 
-    if (overflow) {
-        if (!sn_resize__(res, sum_size + 1)) {
-            return NULL;
-        }
-        res->blocks[sum_size] = overflow;
+/**
+ * Start a new chunk of at least `n` blocks on top of the arena of `ctx`, at
+ * least doubling the size of the previous chunk.
+ */
+static struct sn_arena_chunk *sn_arena_grow__(sn_ctx *ctx, size_t n) {
+    const size_t size = ctx->top ? max(n, 2 * ctx->top->size) : n;
+    struct sn_arena_chunk *chunk = sn_mem_alloc__(sizeof(*chunk) + size * sizeof(sn_word));
+    if (!chunk) {
+        return NULL;
     }
 
-    res->neg = negative;
+    chunk->prev = ctx->top;
+    chunk->size = size;
+    chunk->used = 0;
+    ctx->top    = chunk;
 
-    return res;
+    return chunk;
 }
 
-static SN *sn_sub_internal__(SN * const res, const SN *a, const SN *b) {
-    size_t diff_size = max(a->size, b->size);
-    if (!sn_resize__(res, diff_size))
-        return NULL;
-
-    bool underflow = false;
-    sn_word tmp   = 0;
-
-    for (size_t i = 0; i < diff_size; ++i) {
-        if (i >= a->size) {
-            tmp            = - b->blocks[i] + underflow;
-            res->blocks[i] = tmp;
-            underflow       = true;
-        } else if (i >= b->size) {
-            tmp            = a->blocks[i] - underflow;
-            res->blocks[i] = tmp;
-            underflow       = (tmp > a->blocks[i]);
-        } else {
-            tmp            = a->blocks[i] - b->blocks[i] + underflow;
-            res->blocks[i] = tmp;
-            underflow       = (tmp > a->blocks[i]);
-        }
+/**
+ * Create a context whose arena initially has room for `capacity` blocks of
+ * temporaries. The arena grows on demand. Returns NULL on allocation failure.
+ */
+sn_ctx *sn_ctx_new(size_t capacity) {
+    sn_ctx *ctx = sn_mem_alloc__(sizeof(*ctx));
+    if (!ctx) {
+        return NULL;
     }
 
-    if (underflow) {
-        if (!sn_resize__(res, diff_size + 1))
-            return NULL;
-        res->blocks[diff_size] = underflow;
+    ctx->top = NULL;
+    if (capacity && !sn_arena_grow__(ctx, capacity)) {
+        sn_mem_free__(ctx, sizeof(*ctx));
+        return NULL;
     }
 
-    return res;
+    return ctx;
 }
 
-/* **********************************************************************************
- * Printing and loading
+void sn_ctx_free(sn_ctx *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    if (sn_ctx_current__ == ctx) {
+        sn_ctx_current__ = NULL;
+    }
+
+    struct sn_arena_chunk *chunk = ctx->top, *prev;
+    for (; chunk; chunk = prev) {
+        prev = chunk->prev;
+        sn_mem_free__(chunk, sizeof(*chunk) + chunk->size * sizeof(sn_word));
+    }
+    sn_mem_free__(ctx, sizeof(*ctx));
+}
+
+/**
+ * Release all temporaries in the arena of `ctx` at once. If the arena had to
+ * grow, its chunks are merged into one, so that repeating the same
+ * computation afterwards does not allocate at all.
  */
+void sn_ctx_reset(sn_ctx *ctx) {
+    assert(ctx);
 
-size_t sn_sn2bin(const SN *num, uint8_t * const dst) {
-    assert(num && dst);
+    if (!ctx->top) {
+        return;
+    } else if (!ctx->top->prev) {
+        ctx->top->used = 0;
+        return;
+    }
 
-    sn_word b;
-    for (size_t i = 0; i < num->size; ++i) {
-        b = num->blocks[num->size - i - 1];
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        dst[4*i]   = (b & 0xff000000) >> 24;
-        dst[4*i+1] = (b & 0x00ff0000) >> 16;
-        dst[4*i+2] = (b & 0x0000ff00) >> 8;
-        dst[4*i+3] =  b & 0x000000ff;
-#else
-        dst[4*i]   =  b & 0x000000ff;
-        dst[4*i+1] = (b & 0x0000ff00) >> 8;
-        dst[4*i+2] = (b & 0x00ff0000) >> 16;
-        dst[4*i+3] = (b & 0xff000000) >> 24;
-#endif // __BYTE_ORDER__
+    size_t total = 0;
+    struct sn_arena_chunk *chunk = ctx->top, *prev;
+    for (; chunk; chunk = prev) {
+        prev   = chunk->prev;
+        total += chunk->size;
+        sn_mem_free__(chunk, sizeof(*chunk) + chunk->size * sizeof(sn_word));
     }
 
-    return sn_num_bytes(num);
+    /* On failure the arena simply starts over empty */
+    ctx->top = NULL;
+    sn_arena_grow__(ctx, total);
 }
 
-SN *sn_bin2sn(const uint8_t *src, size_t length, SN *res) {
-    assert(src && length > 0);
+/**
+ * Take the temporaries of the calling thread from the arena of `ctx`, or from
+ * the allocator again for NULL. Returns the context used before, so that
+ * calls can be nested. Each context may only be in use by one thread at a
+ * time.
+ */
+sn_ctx *sn_ctx_use(sn_ctx *ctx) {
+    sn_ctx *prev = sn_ctx_current__;
+    sn_ctx_current__ = ctx;
 
-    if (!res) {
-        res = sn_new();
-        if (!sn_resize__(res, 1 + (length - 1) / sizeof(*res->blocks))) {
-            sn_free(res);
-            return NULL;
-        }
-    } else if (!sn_resize__(res, 1 + (length - 1) / sizeof(*res->blocks))) {
-        return NULL;
+    return prev;
+}
+
+/**
+ * Allocate `n` > 0 blocks of scratch space for the duration of an operation,
+ * from the arena of the current context if there is one.
+ */
+static sn_word *sn_tmp_alloc__(size_t n) {
+    sn_ctx *ctx = sn_ctx_current__;
+
+    if (!ctx) {
+        return sn_mem_alloc__(n * sizeof(sn_word));
     }
 
-    sn_word *b;
-    for (size_t i = 0; i < length; ++i) {
-        if (i % 4 == 0) {
-            b  = &res->blocks[res->size - i / 4 - 1];
-            *b = 0;
-        }
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        *b = (*b & ~(0xff << (24 - 8 * (i % 4)))) | src[i] << (24 - 8 * (i % 4));
-#else
-        *b = (*b & ~(0xff << (8 * (i % 4)))) | src[i] << (8 * (i % 4));
-#endif // __BYTE_ORDER__
+    if ((!ctx->top || ctx->top->size - ctx->top->used < n) && !sn_arena_grow__(ctx, n)) {
+        return NULL;
     }
 
-    return res;
+    sn_word *p = ctx->top->blocks + ctx->top->used;
+    ctx->top->used += n;
+
+    return p;
+}
+
+/**
+ * Free the `n` blocks of scratch space at `p` from sn_tmp_alloc__(). Scratch
+ * space is freed in reverse order of allocation, so an arena can take back the
+ * most recent blocks right away; others wait for sn_ctx_reset().
+ */
+static void sn_tmp_free__(sn_word *p, size_t n) {
+    sn_ctx *ctx = sn_ctx_current__;
+
+    if (!p) {
+        return;
+    } else if (!ctx) {
+        sn_mem_free__(p, n * sizeof(*p));
+    } else if (p + n == ctx->top->blocks + ctx->top->used) {
+        ctx->top->used -= n;
+    }
 }
 
+/* **********************************************************************************
+ * Algorithm selection thresholds
+ */
+
+/* Defaults measured with tune/tune.c on x86-64 */
+#ifndef SN_MUL_KARATSUBA_THRESHOLD
+#define SN_MUL_KARATSUBA_THRESHOLD 28
+#endif // !defined SN_MUL_KARATSUBA_THRESHOLD
+#ifndef SN_MUL_TOOM3_THRESHOLD
+#  if SN_WORD_BITS == 64
+#    define SN_MUL_TOOM3_THRESHOLD 96
+#  else
+#    define SN_MUL_TOOM3_THRESHOLD 192
+#  endif
+#endif // !defined SN_MUL_TOOM3_THRESHOLD
+#ifndef SN_SQR_KARATSUBA_THRESHOLD
+#define SN_SQR_KARATSUBA_THRESHOLD 64
+#endif // !defined SN_SQR_KARATSUBA_THRESHOLD
+#ifndef SN_SQR_TOOM3_THRESHOLD
+#  if SN_WORD_BITS == 64
+#    define SN_SQR_TOOM3_THRESHOLD 192
+#  else
+#    define SN_SQR_TOOM3_THRESHOLD 384
+#  endif
+#endif // !defined SN_SQR_TOOM3_THRESHOLD
+#ifndef SN_MUL_NTT_THRESHOLD
+#define SN_MUL_NTT_THRESHOLD 6144
+#endif // !defined SN_MUL_NTT_THRESHOLD
+#ifndef SN_SQR_NTT_THRESHOLD
+#  if SN_WORD_BITS == 64
+#    define SN_SQR_NTT_THRESHOLD 8192
+#  else
+#    define SN_SQR_NTT_THRESHOLD 6144
+#  endif
+#endif // !defined SN_SQR_NTT_THRESHOLD
+#ifndef SN_DIV_BZ_THRESHOLD
+#  if SN_WORD_BITS == 64
+#    define SN_DIV_BZ_THRESHOLD 60
+#  else
+#    define SN_DIV_BZ_THRESHOLD 120
+#  endif
+#endif // !defined SN_DIV_BZ_THRESHOLD
+#ifndef SN_STR_DC_THRESHOLD
+#  if SN_WORD_BITS == 64
+#    define SN_STR_DC_THRESHOLD 32
+#  else
+#    define SN_STR_DC_THRESHOLD 64
+#  endif
+#endif // !defined SN_STR_DC_THRESHOLD
+#ifndef SN_GCD_LEHMER_THRESHOLD
+#define SN_GCD_LEHMER_THRESHOLD 3
+#endif // !defined SN_GCD_LEHMER_THRESHOLD
+#ifndef SN_GCD_HGCD_THRESHOLD
+#  if SN_WORD_BITS == 64
+#    define SN_GCD_HGCD_THRESHOLD 200
+#  else
+#    define SN_GCD_HGCD_THRESHOLD 400
+#  endif
+#endif // !defined SN_GCD_HGCD_THRESHOLD
+
+static size_t sn_thresholds__[SN_THRESHOLD_COUNT] = {
+    [SN_THRESHOLD_MUL_KARATSUBA] = SN_MUL_KARATSUBA_THRESHOLD,
+    [SN_THRESHOLD_MUL_TOOM3]     = SN_MUL_TOOM3_THRESHOLD,
+    [SN_THRESHOLD_MUL_NTT]       = SN_MUL_NTT_THRESHOLD,
+    [SN_THRESHOLD_SQR_KARATSUBA] = SN_SQR_KARATSUBA_THRESHOLD,
+    [SN_THRESHOLD_SQR_TOOM3]     = SN_SQR_TOOM3_THRESHOLD,
+    [SN_THRESHOLD_SQR_NTT]       = SN_SQR_NTT_THRESHOLD,
+    [SN_THRESHOLD_DIV_BZ]        = SN_DIV_BZ_THRESHOLD,
+    [SN_THRESHOLD_STR_DC]        = SN_STR_DC_THRESHOLD,
+    [SN_THRESHOLD_GCD_LEHMER]    = SN_GCD_LEHMER_THRESHOLD,
+    [SN_THRESHOLD_GCD_HGCD]      = SN_GCD_HGCD_THRESHOLD,
+};
+
+size_t sn_get_threshold(sn_threshold which) {
+    assert(which < SN_THRESHOLD_COUNT);
+
+    return sn_thresholds__[which];
+}
+
+void sn_set_threshold(sn_threshold which, size_t value) {
+    assert(which < SN_THRESHOLD_COUNT);
+
+    sn_thresholds__[which] = value;
+}
+
+/* **********************************************************************************
+ * Block array primitives
+ *
+ * These operate on raw little-endian arrays of blocks and never allocate. The
+ * destination must have room for the whole result.
+ */
+
+/**
+ * Multiply the `n` blocks at `ap` by the single block `b`, store the low `n`
+ * blocks of the product at `rp` and return the most significant block.
+ */
+static sn_word sn_mul_1_c__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    sn_word carry = 0;
+    sn_dword tmp;
+
+    for (size_t i = 0; i < n; ++i) {
+        tmp   = (sn_dword)ap[i] * b + carry;
+        rp[i] = (sn_word)tmp;
+        carry = (sn_word)(tmp >> SN_WORD_BITS);
+    }
+
+    return carry;
+}
+
+/**
+ * Add the product of the `n` blocks at `ap` and the single block `b` to the `n`
+ * blocks at `rp` and return the block carried out of the top.
+ */
+static sn_word sn_addmul_1_c__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    sn_word carry = 0;
+    sn_dword tmp;
+
+    for (size_t i = 0; i < n; ++i) {
+        /* (2^W - 1)^2 + 2 (2^W - 1) < 2^2W, so this never overflows */
+        tmp   = (sn_dword)ap[i] * b + rp[i] + carry;
+        rp[i] = (sn_word)tmp;
+        carry = (sn_word)(tmp >> SN_WORD_BITS);
+    }
+
+    return carry;
+}
+
+/**
+ * Schoolbook multiplication of `an` blocks at `ap` by `bn` blocks at `bp`. The
+ * full `an + bn` block product is written to `rp`, which must not overlap
+ * either operand.
+ */
+static void sn_mul_basecase__(sn_word *rp, const sn_word *ap, size_t an,
+        const sn_word *bp, size_t bn) {
+    assert(an > 0 && bn > 0);
+
+    rp[an] = sn_mul_1__(rp, ap, an, bp[0]);
+    for (size_t j = 1; j < bn; ++j) {
+        rp[an + j] = sn_addmul_1__(rp + j, ap, an, bp[j]);
+    }
+}
+
+/**
+ * Add the `n` blocks at `ap` and `bp`, store the sum at `rp` and return the
+ * carry. `rp` may coincide with either operand.
+ */
+static sn_word sn_add_n_c__(sn_word *rp, const sn_word *ap, const sn_word *bp, size_t n) {
+    sn_word carry = 0;
+    sn_dword tmp;
+
+    for (size_t i = 0; i < n; ++i) {
+        tmp   = (sn_dword)ap[i] + bp[i] + carry;
+        rp[i] = (sn_word)tmp;
+        carry = (sn_word)(tmp >> SN_WORD_BITS);
+    }
+
+    return carry;
+}
+
+/**
+ * Subtract the `n` blocks at `bp` from those at `ap`, store the difference at
+ * `rp` and return the borrow. `rp` may coincide with either operand.
+ */
+static sn_word sn_sub_n_c__(sn_word *rp, const sn_word *ap, const sn_word *bp, size_t n) {
+    sn_word borrow = 0;
+    sn_dword tmp;
+
+    for (size_t i = 0; i < n; ++i) {
+        tmp    = (sn_dword)ap[i] - bp[i] - borrow;
+        rp[i]  = (sn_word)tmp;
+        borrow = (sn_word)(tmp >> SN_WORD_BITS) & 1;
+    }
+
+    return borrow;
+}
+
+/**
+ * Add the single block `b` to the `n` blocks at `ap`, store the sum at `rp` and
+ * return the carry. `rp` may coincide with `ap`.
+ */
+static sn_word sn_add_1__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    size_t i = 0;
+
+    for (; i < n && b; ++i) {
+        rp[i] = ap[i] + b;
+        b     = rp[i] < b;
+    }
+    if (rp != ap) {
+        for (; i < n; ++i) {
+            rp[i] = ap[i];
+        }
+    }
+
+    return b;
+}
+
+/**
+ * Subtract the single block `b` from the `n` blocks at `ap`, store the
+ * difference at `rp` and return the borrow. `rp` may coincide with `ap`.
+ */
+static sn_word sn_sub_1__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    size_t i = 0;
+
+    sn_word a;
+
+    for (; i < n && b; ++i) {
+        a     = ap[i];
+        rp[i] = a - b;
+        b     = a < b;
+    }
+    if (rp != ap) {
+        for (; i < n; ++i) {
+            rp[i] = ap[i];
+        }
+    }
+
+    return b;
+}
+
+/**
+ * Add `bn` blocks at `bp` to `an` >= `bn` blocks at `ap`, store the `an` block
+ * sum at `rp` and return the carry.
+ */
+static sn_word sn_add__(sn_word *rp, const sn_word *ap, size_t an,
+        const sn_word *bp, size_t bn) {
+    assert(an >= bn);
+
+    sn_word carry = sn_add_n__(rp, ap, bp, bn);
+    return sn_add_1__(rp + bn, ap + bn, an - bn, carry);
+}
+
+/**
+ * Subtract `bn` blocks at `bp` from `an` >= `bn` blocks at `ap`, store the `an`
+ * block difference at `rp` and return the borrow.
+ */
+static sn_word sn_sub__(sn_word *rp, const sn_word *ap, size_t an,
+        const sn_word *bp, size_t bn) {
+    assert(an >= bn);
+
+    sn_word borrow = sn_sub_n__(rp, ap, bp, bn);
+    return sn_sub_1__(rp + bn, ap + bn, an - bn, borrow);
+}
+
+/**
+ * Subtract the product of the `n` blocks at `ap` and the single block `b` from
+ * the `n` blocks at `rp` and return the block borrowed out of the top.
+ */
+static sn_word sn_submul_1_c__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    sn_word borrow = 0;
+    sn_dword prod;
+    sn_word low;
+
+    for (size_t i = 0; i < n; ++i) {
+        prod   = (sn_dword)ap[i] * b + borrow;
+        low    = (sn_word)prod;
+        borrow = (sn_word)(prod >> SN_WORD_BITS) + (rp[i] < low);
+        rp[i] -= low;
+    }
+
+    return borrow;
+}
+
+/**
+ * Compare `an` blocks at `ap` with `bn` blocks at `bp`, either of which may
+ * have leading zero blocks. Returns -1, 0 or 1.
+ */
+static int sn_cmp__(const sn_word *ap, size_t an, const sn_word *bp, size_t bn) {
+    for (; an > bn; --an) {
+        if (ap[an - 1]) {
+            return 1;
+        }
+    }
+    for (; bn > an; --bn) {
+        if (bp[bn - 1]) {
+            return -1;
+        }
+    }
+    while (an--) {
+        if (ap[an] != bp[an]) {
+            return ap[an] > bp[an] ? 1 : -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Store |a - b| for `an` >= `bn` blocks at `ap` and `bn` blocks at `bp` into the
+ * `an` blocks at `rp`. Returns true if the difference is negative, i.e. a < b.
+ */
+static bool sn_abs_sub__(sn_word *rp, const sn_word *ap, size_t an,
+        const sn_word *bp, size_t bn) {
+    assert(an >= bn);
+
+    if (sn_cmp__(ap, an, bp, bn) >= 0) {
+        sn_sub__(rp, ap, an, bp, bn);
+        return false;
+    }
+
+    /* a < b implies that the blocks of a above bn are all zero */
+    sn_sub_n__(rp, bp, ap, bn);
+    memset(rp + bn, 0, (an - bn) * sizeof(*rp));
+
+    return true;
+}
+
+/**
+ * Shift the `n` blocks at `ap` left by 0 < `cnt` < W bits, store the low `n`
+ * blocks of the result at `rp` and return the bits shifted out, in the bottom
+ * of a block. The blocks are done from the top down, so `rp` may be `ap` or
+ * above it, which shifts by whole blocks at the same time.
+ */
+static sn_word sn_lshift_c__(sn_word *rp, const sn_word *ap, size_t n, unsigned cnt) {
+    assert(n > 0 && cnt > 0 && cnt < SN_WORD_BITS);
+
+    sn_word out = ap[n - 1] >> (SN_WORD_BITS - cnt);
+    for (size_t i = n - 1; i > 0; --i) {
+        rp[i] = (ap[i] << cnt) | (ap[i - 1] >> (SN_WORD_BITS - cnt));
+    }
+    rp[0] = ap[0] << cnt;
+
+    return out;
+}
+
+/**
+ * Shift the `n` blocks at `ap` right by 0 < `cnt` < W bits, store the result at
+ * `rp` and return the bits shifted out, in the top of a block. The blocks are
+ * done from the bottom up, so `rp` may be `ap` or below it.
+ */
+static sn_word sn_rshift_c__(sn_word *rp, const sn_word *ap, size_t n, unsigned cnt) {
+    assert(n > 0 && cnt > 0 && cnt < SN_WORD_BITS);
+
+    sn_word out = ap[0] << (SN_WORD_BITS - cnt);
+    for (size_t i = 0; i + 1 < n; ++i) {
+        rp[i] = (ap[i] >> cnt) | (ap[i + 1] << (SN_WORD_BITS - cnt));
+    }
+    rp[n - 1] = ap[n - 1] >> cnt;
+
+    return out;
+}
+
+/**
+ * Divide the `n` blocks at `ap` by three, which must divide them exactly, and
+ * store the quotient at `rp`. Uses multiplication by the inverse of 3 modulo
+ * 2^W instead of a division per block. `rp` may coincide with `ap`.
+ */
+static void sn_divexact_by3__(sn_word *rp, const sn_word *ap, size_t n) {
+    const sn_word inv3 = SN_WORD_MAX / 3 * 2 + 1; /* 3 * inv3 == 1 (mod 2^W) */
+    sn_word borrow = 0, s, q;
+
+    for (size_t i = 0; i < n; ++i) {
+        s      = ap[i];
+        q      = (s - borrow) * inv3;
+        borrow = (s < borrow) + (q > SN_WORD_MAX / 3) + (q > SN_WORD_MAX / 3 * 2);
+        rp[i]  = q;
+    }
+
+    assert(borrow == 0);
+}
+
+/* **********************************************************************************
+ * Kernel selection
+ *
+ * The hottest primitives have versions for processors with BMI2 and ADX. MULX
+ * multiplies without touching the flags, so a whole row of partial products
+ * can be summed along a single carry chain, and ADCX and ADOX add along two
+ * independent chains (CF and OF) for multiply-accumulate. The loops count down
+ * with LEA, DEC and JRCXZ, which leave the carry flags alone. The kernels are
+ * picked once at startup according to CPUID, so that one binary uses the best
+ * code on every processor; the portable ones serve as the fallback.
+ *
+ * Shifts have no carry chain: with AVX2 every output block is a funnel shift
+ * of two neighbouring input blocks, four at a time. The butterflies of the
+ * number theoretic transforms are independent as well and run eight at a time.
+ */
+
+#if SN_X86_64_KERNELS
+/** Whether the processor and operating system support AVX-512 IFMA */
+static bool sn_have_ifma__;
+
+/** Kernels for the block array primitives on the running processor */
+static struct sn_kernels {
+    sn_word (*mul_1)(sn_word *, const sn_word *, size_t, sn_word);
+    sn_word (*addmul_1)(sn_word *, const sn_word *, size_t, sn_word);
+    sn_word (*submul_1)(sn_word *, const sn_word *, size_t, sn_word);
+    sn_word (*add_n)(sn_word *, const sn_word *, const sn_word *, size_t);
+    sn_word (*sub_n)(sn_word *, const sn_word *, const sn_word *, size_t);
+    sn_word (*lshift)(sn_word *, const sn_word *, size_t, unsigned);
+    sn_word (*rshift)(sn_word *, const sn_word *, size_t, unsigned);
+    void (*ntt_dif_level)(uint32_t *, size_t, size_t, const uint32_t *,
+            const struct sn_ntt_prime *);
+    void (*ntt_dit_level)(uint32_t *, size_t, size_t, const uint32_t *,
+            const struct sn_ntt_prime *);
+    void (*ntt_pointwise)(uint32_t *, const uint32_t *, size_t, uint32_t,
+            const struct sn_ntt_prime *);
+} sn_kernels__ = {
+    sn_mul_1_c__, sn_addmul_1_c__, sn_submul_1_c__, sn_add_n_c__, sn_sub_n_c__,
+    sn_lshift_c__, sn_rshift_c__, sn_ntt_dif_level_c__, sn_ntt_dit_level_c__,
+    sn_ntt_pointwise_c__
+};
+
+#  define SN_KERNEL(name) (sn_kernels__.name)
+#else
+#  define SN_KERNEL(name) (sn_##name##_c__)
+#endif // SN_X86_64_KERNELS
+
+static inline sn_word sn_mul_1__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    return SN_KERNEL(mul_1)(rp, ap, n, b);
+}
+
+static inline sn_word sn_addmul_1__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    return SN_KERNEL(addmul_1)(rp, ap, n, b);
+}
+
+static inline sn_word sn_submul_1__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    return SN_KERNEL(submul_1)(rp, ap, n, b);
+}
+
+static inline sn_word sn_add_n__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        size_t n) {
+    return SN_KERNEL(add_n)(rp, ap, bp, n);
+}
+
+static inline sn_word sn_sub_n__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        size_t n) {
+    return SN_KERNEL(sub_n)(rp, ap, bp, n);
+}
+
+static inline sn_word sn_lshift__(sn_word *rp, const sn_word *ap, size_t n, unsigned cnt) {
+    return SN_KERNEL(lshift)(rp, ap, n, cnt);
+}
+
+static inline sn_word sn_rshift__(sn_word *rp, const sn_word *ap, size_t n, unsigned cnt) {
+    return SN_KERNEL(rshift)(rp, ap, n, cnt);
+}
+
+#if SN_X86_64_KERNELS
+__attribute__((constructor))
+static void sn_kernels_init__(void) {
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return;
+    }
+
+    if ((ebx & bit_BMI2) && (ebx & bit_ADX)) {
+        sn_kernels__.mul_1    = sn_mul_1_x86__;
+        sn_kernels__.addmul_1 = sn_addmul_1_x86__;
+        sn_kernels__.submul_1 = sn_submul_1_x86__;
+        sn_kernels__.add_n    = sn_add_n_x86__;
+        sn_kernels__.sub_n    = sn_sub_n_x86__;
+    }
+
+    /* AVX also needs the operating system to save the YMM registers, i.e.
+     * bits 1 and 2 of XCR0, and AVX-512 the opmask and all 512-bit registers
+     * as well, i.e. bits 5 to 7 */
+    const unsigned leaf7_ebx = ebx;
+    unsigned xcr0 = 0, xcr0_hi;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_OSXSAVE)) {
+        __asm__("xgetbv" : "=a" (xcr0), "=d" (xcr0_hi) : "c" (0));
+    }
+    if ((leaf7_ebx & bit_AVX2) && (xcr0 & 0x6) == 0x6) {
+        sn_kernels__.lshift        = sn_lshift_avx2__;
+        sn_kernels__.rshift        = sn_rshift_avx2__;
+        sn_kernels__.ntt_dif_level = sn_ntt_dif_level_avx2__;
+        sn_kernels__.ntt_dit_level = sn_ntt_dit_level_avx2__;
+        sn_kernels__.ntt_pointwise = sn_ntt_pointwise_avx2__;
+    }
+    sn_have_ifma__ = (leaf7_ebx & bit_AVX512F) && (leaf7_ebx & bit_AVX512IFMA)
+        && (xcr0 & 0xe6) == 0xe6;
+}
+
+static sn_word sn_mul_1_x86__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    sn_word hi, lo, t;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    /* rp[i] = lo(a[i] b) + hi(a[i-1] b) + CF */
+    __asm__ __volatile__(
+        "xorl   %k[hi], %k[hi]\n"
+        "1:\n\t"
+        "mulxq  (%[ap]), %[lo], %[t]\n\t"
+        "adcq   %[hi], %[lo]\n\t"
+        "movq   %[lo], (%[rp])\n\t"
+        "movq   %[t], %[hi]\n\t"
+        "leaq   8(%[ap]), %[ap]\n\t"
+        "leaq   8(%[rp]), %[rp]\n\t"
+        "decq   %[n]\n\t"
+        "jnz    1b\n\t"
+        "adcq   $0, %[hi]\n\t"
+        : [hi] "=&r" (hi), [lo] "=&r" (lo), [t] "=&r" (t),
+          [rp] "+r" (rp), [ap] "+r" (ap), [n] "+r" (n)
+        : "d" (b)
+        : "cc", "memory");
+
+    return hi;
+}
+
+static sn_word sn_addmul_1_x86__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    sn_word hi, lo, t;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    /* rp[i] += lo(a[i] b) + hi(a[i-1] b), the product half along CF and the
+     * addition to rp along OF. Two blocks per iteration after an odd one. */
+    __asm__ __volatile__(
+        "xorl   %k[hi], %k[hi]\n\t"
+        "testb  $1, %%cl\n\t"
+        "jz     2f\n\t"
+        "mulxq  (%[ap]), %[lo], %[t]\n\t"
+        "adcxq  %[hi], %[lo]\n\t"
+        "adoxq  (%[rp]), %[lo]\n\t"
+        "movq   %[lo], (%[rp])\n\t"
+        "movq   %[t], %[hi]\n\t"
+        "leaq   8(%[ap]), %[ap]\n\t"
+        "leaq   8(%[rp]), %[rp]\n\t"
+        "leaq   -1(%%rcx), %%rcx\n"
+        "2:\n\t"
+        "jrcxz  4f\n"
+        "3:\n\t"
+        "mulxq  (%[ap]), %[lo], %[t]\n\t"
+        "adcxq  %[hi], %[lo]\n\t"
+        "adoxq  (%[rp]), %[lo]\n\t"
+        "movq   %[lo], (%[rp])\n\t"
+        "mulxq  8(%[ap]), %[lo], %[hi]\n\t"
+        "adcxq  %[t], %[lo]\n\t"
+        "adoxq  8(%[rp]), %[lo]\n\t"
+        "movq   %[lo], 8(%[rp])\n\t"
+        "leaq   16(%[ap]), %[ap]\n\t"
+        "leaq   16(%[rp]), %[rp]\n\t"
+        "leaq   -2(%%rcx), %%rcx\n\t"
+        "jrcxz  4f\n\t"
+        "jmp    3b\n"
+        "4:\n\t"
+        "movl   $0, %k[t]\n\t"
+        "adcxq  %[t], %[hi]\n\t"
+        "adoxq  %[t], %[hi]\n\t"
+        : [hi] "=&r" (hi), [lo] "=&r" (lo), [t] "=&r" (t),
+          [rp] "+r" (rp), [ap] "+r" (ap), [n] "+c" (n)
+        : "d" (b)
+        : "cc", "memory");
+
+    return hi;
+}
+
+static sn_word sn_submul_1_x86__(sn_word *rp, const sn_word *ap, size_t n, sn_word b) {
+    sn_word hi, lo, t, r;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    /* The borrow out of rp[i] is added to what is left to subtract from
+     * rp[i+1], which cannot overflow as lo(a[i] b) + hi is then zero */
+    __asm__ __volatile__(
+        "xorl   %k[hi], %k[hi]\n"
+        "1:\n\t"
+        "mulxq  (%[ap]), %[lo], %[t]\n\t"
+        "addq   %[hi], %[lo]\n\t"
+        "adcq   $0, %[t]\n\t"
+        "movq   (%[rp]), %[r]\n\t"
+        "subq   %[lo], %[r]\n\t"
+        "adcq   $0, %[t]\n\t"
+        "movq   %[r], (%[rp])\n\t"
+        "movq   %[t], %[hi]\n\t"
+        "leaq   8(%[ap]), %[ap]\n\t"
+        "leaq   8(%[rp]), %[rp]\n\t"
+        "decq   %[n]\n\t"
+        "jnz    1b\n\t"
+        : [hi] "=&r" (hi), [lo] "=&r" (lo), [t] "=&r" (t), [r] "=&r" (r),
+          [rp] "+r" (rp), [ap] "+r" (ap), [n] "+r" (n)
+        : "d" (b)
+        : "cc", "memory");
+
+    return hi;
+}
+
+/*
+ * Four blocks per iteration of a plain ADC/SBB chain, after the n mod 4 odd
+ * ones. `rp` may coincide with either operand, as every block is read before
+ * the result is stored over it.
+ */
+#define SN_X86_ADD_SUB_N(insn)                                                  \
+    __asm__ __volatile__(                                                       \
+        "xorl   %k[c], %k[c]\n\t"                                               \
+        "testq  %[rest], %[rest]\n\t"                                           \
+        "jz     2f\n"                                                           \
+        "1:\n\t"                                                                \
+        "movq   (%[ap]), %[t0]\n\t"                                             \
+        insn "q (%[bp]), %[t0]\n\t"                                             \
+        "movq   %[t0], (%[rp])\n\t"                                             \
+        "leaq   8(%[ap]), %[ap]\n\t"                                            \
+        "leaq   8(%[bp]), %[bp]\n\t"                                            \
+        "leaq   8(%[rp]), %[rp]\n\t"                                            \
+        "decq   %[rest]\n\t"                                                    \
+        "jnz    1b\n"                                                           \
+        "2:\n\t"                                                                \
+        "jrcxz  4f\n"                                                           \
+        "3:\n\t"                                                                \
+        "movq   (%[ap]), %[t0]\n\t"                                             \
+        "movq   8(%[ap]), %[t1]\n\t"                                            \
+        insn "q (%[bp]), %[t0]\n\t"                                             \
+        insn "q 8(%[bp]), %[t1]\n\t"                                            \
+        "movq   %[t0], (%[rp])\n\t"                                             \
+        "movq   %[t1], 8(%[rp])\n\t"                                            \
+        "movq   16(%[ap]), %[t0]\n\t"                                           \
+        "movq   24(%[ap]), %[t1]\n\t"                                           \
+        insn "q 16(%[bp]), %[t0]\n\t"                                           \
+        insn "q 24(%[bp]), %[t1]\n\t"                                           \
+        "movq   %[t0], 16(%[rp])\n\t"                                           \
+        "movq   %[t1], 24(%[rp])\n\t"                                           \
+        "leaq   32(%[ap]), %[ap]\n\t"                                           \
+        "leaq   32(%[bp]), %[bp]\n\t"                                           \
+        "leaq   32(%[rp]), %[rp]\n\t"                                           \
+        "decq   %%rcx\n\t"                                                      \
+        "jnz    3b\n"                                                           \
+        "4:\n\t"                                                                \
+        "adcl   $0, %k[c]\n\t"                                                  \
+        : [c] "=&r" (c), [t0] "=&r" (t0), [t1] "=&r" (t1),                      \
+          [rp] "+r" (rp), [ap] "+r" (ap), [bp] "+r" (bp),                       \
+          [rest] "+r" (rest), [quads] "+c" (quads)                              \
+        :                                                                       \
+        : "cc", "memory")
+
+static sn_word sn_add_n_x86__(sn_word *rp, const sn_word *ap, const sn_word *bp, size_t n) {
+    sn_word c, t0, t1;
+    size_t rest = n % 4, quads = n / 4;
+
+    SN_X86_ADD_SUB_N("adc");
+
+    return c;
+}
+
+static sn_word sn_sub_n_x86__(sn_word *rp, const sn_word *ap, const sn_word *bp, size_t n) {
+    sn_word c, t0, t1;
+    size_t rest = n % 4, quads = n / 4;
+
+    SN_X86_ADD_SUB_N("sbb");
+
+    return c;
+}
+
+#undef SN_X86_ADD_SUB_N
+
+/*
+ * Block i of a left shift takes the top bits of block i - 1 and of a right
+ * shift those of block i + 1, so four of each are loaded with one unaligned
+ * load offset by a block. The left shift runs from the top down and the right
+ * shift from the bottom up, like the portable ones, and every vector is loaded
+ * before the one overlapping it is stored, so the same overlaps are allowed.
+ */
+__attribute__((target("avx2")))
+static sn_word sn_lshift_avx2__(sn_word *rp, const sn_word *ap, size_t n, unsigned cnt) {
+    assert(n > 0 && cnt > 0 && cnt < SN_WORD_BITS);
+
+    const __m128i l = _mm_cvtsi32_si128((int)cnt);
+    const __m128i r = _mm_cvtsi32_si128(SN_WORD_BITS - (int)cnt);
+    const sn_word out = ap[n - 1] >> (SN_WORD_BITS - cnt);
+    size_t i = n - 1;
+
+    for (; i >= 4; i -= 4) {
+        const __m256i hi = _mm256_loadu_si256((const __m256i *)(ap + i - 3));
+        const __m256i lo = _mm256_loadu_si256((const __m256i *)(ap + i - 4));
+        _mm256_storeu_si256((__m256i *)(rp + i - 3),
+            _mm256_or_si256(_mm256_sll_epi64(hi, l), _mm256_srl_epi64(lo, r)));
+    }
+    for (; i > 0; --i) {
+        rp[i] = (ap[i] << cnt) | (ap[i - 1] >> (SN_WORD_BITS - cnt));
+    }
+    rp[0] = ap[0] << cnt;
+
+    return out;
+}
+
+__attribute__((target("avx2")))
+static sn_word sn_rshift_avx2__(sn_word *rp, const sn_word *ap, size_t n, unsigned cnt) {
+    assert(n > 0 && cnt > 0 && cnt < SN_WORD_BITS);
+
+    const __m128i r = _mm_cvtsi32_si128((int)cnt);
+    const __m128i l = _mm_cvtsi32_si128(SN_WORD_BITS - (int)cnt);
+    const sn_word out = ap[0] << (SN_WORD_BITS - cnt);
+    size_t i = 0;
+
+    for (; i + 4 < n; i += 4) {
+        const __m256i lo = _mm256_loadu_si256((const __m256i *)(ap + i));
+        const __m256i hi = _mm256_loadu_si256((const __m256i *)(ap + i + 1));
+        _mm256_storeu_si256((__m256i *)(rp + i),
+            _mm256_or_si256(_mm256_srl_epi64(lo, r), _mm256_sll_epi64(hi, l)));
+    }
+    for (; i + 1 < n; ++i) {
+        rp[i] = (ap[i] >> cnt) | (ap[i + 1] << (SN_WORD_BITS - cnt));
+    }
+    rp[n - 1] = ap[n - 1] >> cnt;
+
+    return out;
+}
+#endif // SN_X86_64_KERNELS
+
+/* **********************************************************************************
+ * Number theoretic transform multiplication
+ *
+ * The operands are cut into 32-bit digits whose cyclic convolution is computed
+ * modulo three primes p < 2^31 with 2^24 | p - 1, using transforms of length up
+ * to 2^24. Every coefficient of the convolution is below 2^23 (2^32)^2 = 2^87,
+ * which is less than the product of the primes, so it is recovered exactly by
+ * the Chinese remainder theorem. Arithmetic modulo each prime is done in
+ * 32-bit Montgomery form, which needs nothing but 64-bit integer products.
+ */
+
+#define SN_NTT_MAX_LOG  24  /**< Log2 of the longest transform */
+#define SN_NTT_BLOCK    (1 << 12)  /**< Transforms of this length fit into L1 */
+#define SN_NTT_DIGITS   (SN_WORD_BITS / 32)  /**< 32-bit digits per block */
+
+typedef struct sn_ntt_prime {
+    uint32_t p;    /**< The prime */
+    uint32_t pinv; /**< -p^-1 mod 2^32 */
+    uint32_t r2;   /**< 2^64 mod p */
+    uint32_t g;    /**< Generator of the multiplicative group */
+} sn_ntt_prime;
+
+static const sn_ntt_prime sn_ntt_primes__[3] = {
+    { 2013265921u, 2013265919u, 1172168163u, 31 }, /* 15 * 2^27 + 1 */
+    {  469762049u,  469762047u,  460175152u,  3 }, /*  7 * 2^26 + 1 */
+    {  754974721u,  754974719u,  749009521u, 11 }, /* 45 * 2^24 + 1 */
+};
+
+/** Montgomery reduction of `t` < p 2^32, i.e. t 2^-32 mod p */
+static inline uint32_t sn_ntt_redc__(uint64_t t, const sn_ntt_prime *q) {
+    uint32_t m = (uint32_t)t * q->pinv;
+    uint32_t r = (uint32_t)((t + (uint64_t)m * q->p) >> 32);
+    return r >= q->p ? r - q->p : r;
+}
+
+static inline uint32_t sn_ntt_mul__(uint32_t a, uint32_t b, const sn_ntt_prime *q) {
+    return sn_ntt_redc__((uint64_t)a * b, q);
+}
+
+static inline uint32_t sn_ntt_add__(uint32_t a, uint32_t b, const sn_ntt_prime *q) {
+    uint32_t s = a + b;
+    return s >= q->p ? s - q->p : s;
+}
+
+static inline uint32_t sn_ntt_sub__(uint32_t a, uint32_t b, const sn_ntt_prime *q) {
+    return a >= b ? a - b : a + q->p - b;
+}
+
+/** Convert `a` < 2^32 into Montgomery form */
+static inline uint32_t sn_ntt_to_mont__(uint32_t a, const sn_ntt_prime *q) {
+    return sn_ntt_redc__((uint64_t)a * q->r2, q);
+}
+
+/** Raise `a` in Montgomery form to the `e`-th power */
+static uint32_t sn_ntt_pow__(uint32_t a, uint32_t e, const sn_ntt_prime *q) {
+    uint32_t r = sn_ntt_to_mont__(1, q);
+
+    for (; e; e >>= 1) {
+        if (e & 1) {
+            r = sn_ntt_mul__(r, a, q);
+        }
+        a = sn_ntt_mul__(a, a, q);
+    }
+
+    return r;
+}
+
+/**
+ * Fill in the twiddle factors for every level of a length `n` transform whose
+ * primitive root of unity is `w`: the powers w_len^j, j < len/2, of the root
+ * for length `len` are stored contiguously at `roots + len/2`.
+ */
+static void sn_ntt_roots__(uint32_t *roots, size_t n, uint32_t w, const sn_ntt_prime *q) {
+    uint32_t *top = roots + n / 2;
+
+    top[0] = sn_ntt_to_mont__(1, q);
+    for (size_t j = 1; j < n / 2; ++j) {
+        top[j] = sn_ntt_mul__(top[j - 1], w, q);
+    }
+    for (size_t len = n / 2; len >= 2; len /= 2) {
+        for (size_t j = 0; j < len / 2; ++j) {
+            roots[len / 2 + j] = roots[len + 2 * j];
+        }
+    }
+}
+
+/**
+ * One level of the forward transform: the butterflies `half` apart in every
+ * group of 2 `half` of the `n` elements at `a`, with the twiddles at `w`. The
+ * prime is copied so that the stores cannot make the compiler reload it.
+ */
+static void sn_ntt_dif_level_c__(uint32_t *a, size_t n, size_t half, const uint32_t *w,
+        const sn_ntt_prime *prime) {
+    const sn_ntt_prime local = *prime, * const q = &local;
+
+    for (size_t s = 0; s < n; s += 2 * half) {
+        for (size_t j = 0; j < half; ++j) {
+            uint32_t u = a[s + j], v = a[s + j + half];
+            a[s + j]        = sn_ntt_add__(u, v, q);
+            a[s + j + half] = sn_ntt_mul__(sn_ntt_sub__(u, v, q), w[j], q);
+        }
+    }
+}
+
+/** One level of the inverse transform, see sn_ntt_dif_level_c__() */
+static void sn_ntt_dit_level_c__(uint32_t *a, size_t n, size_t half, const uint32_t *w,
+        const sn_ntt_prime *prime) {
+    const sn_ntt_prime local = *prime, * const q = &local;
+
+    for (size_t s = 0; s < n; s += 2 * half) {
+        for (size_t j = 0; j < half; ++j) {
+            uint32_t u = a[s + j], v = sn_ntt_mul__(a[s + j + half], w[j], q);
+            a[s + j]        = sn_ntt_add__(u, v, q);
+            a[s + j + half] = sn_ntt_sub__(u, v, q);
+        }
+    }
+}
+
+/** Multiply the `n` elements at `a` by those at `b` and by `scale` */
+static void sn_ntt_pointwise_c__(uint32_t *a, const uint32_t *b, size_t n, uint32_t scale,
+        const sn_ntt_prime *prime) {
+    const sn_ntt_prime local = *prime, * const q = &local;
+
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = sn_ntt_mul__(sn_ntt_mul__(a[i], b[i], q), scale, q);
+    }
+}
+
+#if SN_X86_64_KERNELS
+/*
+ * Eight residues per vector. The products of the even and of the odd lanes
+ * are reduced separately in 64-bit lanes and blended back together. Sums and
+ * differences below 2p < 2^32 are brought into [0, p) by taking the unsigned
+ * minimum with the value shifted by p, which wraps around unless it is the
+ * reduced one.
+ */
+__attribute__((target("avx2")))
+static inline __m256i sn_ntt_mul_avx2__(__m256i a, __m256i b, __m256i p, __m256i pinv) {
+    __m256i even = _mm256_mul_epu32(a, b);
+    __m256i odd  = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+
+    even = _mm256_add_epi64(even, _mm256_mul_epu32(_mm256_mul_epu32(even, pinv), p));
+    odd  = _mm256_add_epi64(odd, _mm256_mul_epu32(_mm256_mul_epu32(odd, pinv), p));
+
+    const __m256i r = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+    return _mm256_min_epu32(r, _mm256_sub_epi32(r, p));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i sn_ntt_add_avx2__(__m256i a, __m256i b, __m256i p) {
+    const __m256i s = _mm256_add_epi32(a, b);
+    return _mm256_min_epu32(s, _mm256_sub_epi32(s, p));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i sn_ntt_sub_avx2__(__m256i a, __m256i b, __m256i p) {
+    const __m256i d = _mm256_sub_epi32(a, b);
+    return _mm256_min_epu32(d, _mm256_add_epi32(d, p));
+}
+
+/*
+ * Levels with fewer than eight butterflies per group take two vectors of
+ * eight elements and regroup them, so that one vector holds all the upper
+ * and the other all the lower inputs: by 128-bit halves for half = 4, by
+ * 64-bit pairs for half = 2 and by single elements for half = 1. Applying the
+ * same regrouping to the results puts them back in place.
+ */
+__attribute__((target("avx2")))
+static inline void sn_ntt_split_avx2__(__m256i *u, __m256i *v, __m256i x0, __m256i x1,
+        size_t half) {
+    if (half == 4) {
+        *u = _mm256_permute2x128_si256(x0, x1, 0x20);
+        *v = _mm256_permute2x128_si256(x0, x1, 0x31);
+    } else if (half == 2) {
+        *u = _mm256_unpacklo_epi64(x0, x1);
+        *v = _mm256_unpackhi_epi64(x0, x1);
+    } else {
+        *u = _mm256_blend_epi32(x0, _mm256_slli_epi64(x1, 32), 0xaa);
+        *v = _mm256_blend_epi32(_mm256_srli_epi64(x0, 32), x1, 0xaa);
+    }
+}
+
+/** The twiddles of a level with `half` < 8, repeated to match the regrouping */
+__attribute__((target("avx2")))
+static inline __m256i sn_ntt_twiddles_avx2__(const uint32_t *w, size_t half) {
+    if (half == 4) {
+        return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)w));
+    } else if (half == 2) {
+        return _mm256_set1_epi64x((long long)((uint64_t)w[1] << 32 | w[0]));
+    }
+    return _mm256_set1_epi32((int)w[0]);
+}
+
+__attribute__((target("avx2")))
+static void sn_ntt_dif_level_avx2__(uint32_t *a, size_t n, size_t half, const uint32_t *w,
+        const sn_ntt_prime *q) {
+    const __m256i p = _mm256_set1_epi32((int)q->p), pinv = _mm256_set1_epi32((int)q->pinv);
+
+    if (half >= 8) {
+        for (size_t s = 0; s < n; s += 2 * half) {
+            for (size_t j = 0; j < half; j += 8) {
+                __m256i *pu = (__m256i *)(a + s + j), *pv = (__m256i *)(a + s + j + half);
+                const __m256i u = _mm256_loadu_si256(pu), v = _mm256_loadu_si256(pv);
+                const __m256i wj = _mm256_loadu_si256((const __m256i *)(w + j));
+                _mm256_storeu_si256(pu, sn_ntt_add_avx2__(u, v, p));
+                _mm256_storeu_si256(pv, sn_ntt_mul_avx2__(sn_ntt_sub_avx2__(u, v, p), wj, p,
+                            pinv));
+            }
+        }
+    } else if (n >= 16) {
+        const __m256i wv = sn_ntt_twiddles_avx2__(w, half);
+        for (size_t s = 0; s < n; s += 16) {
+            __m256i *p0 = (__m256i *)(a + s), *p1 = (__m256i *)(a + s + 8), u, v, x, y;
+            sn_ntt_split_avx2__(&u, &v, _mm256_loadu_si256(p0), _mm256_loadu_si256(p1), half);
+            x = sn_ntt_add_avx2__(u, v, p);
+            y = sn_ntt_mul_avx2__(sn_ntt_sub_avx2__(u, v, p), wv, p, pinv);
+            sn_ntt_split_avx2__(&u, &v, x, y, half);
+            _mm256_storeu_si256(p0, u);
+            _mm256_storeu_si256(p1, v);
+        }
+    } else {
+        sn_ntt_dif_level_c__(a, n, half, w, q);
+    }
+}
+
+__attribute__((target("avx2")))
+static void sn_ntt_dit_level_avx2__(uint32_t *a, size_t n, size_t half, const uint32_t *w,
+        const sn_ntt_prime *q) {
+    const __m256i p = _mm256_set1_epi32((int)q->p), pinv = _mm256_set1_epi32((int)q->pinv);
+
+    if (half >= 8) {
+        for (size_t s = 0; s < n; s += 2 * half) {
+            for (size_t j = 0; j < half; j += 8) {
+                __m256i *pu = (__m256i *)(a + s + j), *pv = (__m256i *)(a + s + j + half);
+                const __m256i wj = _mm256_loadu_si256((const __m256i *)(w + j));
+                const __m256i u = _mm256_loadu_si256(pu);
+                const __m256i v = sn_ntt_mul_avx2__(_mm256_loadu_si256(pv), wj, p, pinv);
+                _mm256_storeu_si256(pu, sn_ntt_add_avx2__(u, v, p));
+                _mm256_storeu_si256(pv, sn_ntt_sub_avx2__(u, v, p));
+            }
+        }
+    } else if (n >= 16) {
+        const __m256i wv = sn_ntt_twiddles_avx2__(w, half);
+        for (size_t s = 0; s < n; s += 16) {
+            __m256i *p0 = (__m256i *)(a + s), *p1 = (__m256i *)(a + s + 8), u, v, x, y;
+            sn_ntt_split_avx2__(&u, &v, _mm256_loadu_si256(p0), _mm256_loadu_si256(p1), half);
+            v = sn_ntt_mul_avx2__(v, wv, p, pinv);
+            x = sn_ntt_add_avx2__(u, v, p);
+            y = sn_ntt_sub_avx2__(u, v, p);
+            sn_ntt_split_avx2__(&u, &v, x, y, half);
+            _mm256_storeu_si256(p0, u);
+            _mm256_storeu_si256(p1, v);
+        }
+    } else {
+        sn_ntt_dit_level_c__(a, n, half, w, q);
+    }
+}
+
+__attribute__((target("avx2")))
+static void sn_ntt_pointwise_avx2__(uint32_t *a, const uint32_t *b, size_t n, uint32_t scale,
+        const sn_ntt_prime *q) {
+    const __m256i p = _mm256_set1_epi32((int)q->p), pinv = _mm256_set1_epi32((int)q->pinv);
+    const __m256i sv = _mm256_set1_epi32((int)scale);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        const __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        const __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        _mm256_storeu_si256((__m256i *)(a + i),
+            sn_ntt_mul_avx2__(sn_ntt_mul_avx2__(x, y, p, pinv), sv, p, pinv));
+    }
+    sn_ntt_pointwise_c__(a + i, b + i, n - i, scale, q);
+}
+#endif // SN_X86_64_KERNELS
+
+/**
+ * Forward decimation-in-frequency transform, leaving the result in bit
+ * reversed order. Levels above SN_NTT_BLOCK are done depth-first so that every
+ * transform of at most SN_NTT_BLOCK elements runs entirely in cache.
+ */
+static void sn_ntt_dif__(uint32_t *a, size_t n, const uint32_t *roots,
+        const sn_ntt_prime *q) {
+    for (size_t len = n; len >= 2; len /= 2) {
+        SN_KERNEL(ntt_dif_level)(a, n, len / 2, roots + len / 2, q);
+
+        if (len > SN_NTT_BLOCK) {
+            sn_ntt_dif__(a, len / 2, roots, q);
+            sn_ntt_dif__(a + len / 2, len / 2, roots, q);
+            return;
+        }
+    }
+}
+
+/**
+ * Inverse decimation-in-time transform of bit reversed input, built from the
+ * inverse roots of unity and leaving the result, times `n`, in natural order.
+ */
+static void sn_ntt_dit__(uint32_t *a, size_t n, const uint32_t *iroots,
+        const sn_ntt_prime *q) {
+    size_t len = 2;
+
+    if (n > SN_NTT_BLOCK) {
+        sn_ntt_dit__(a, n / 2, iroots, q);
+        sn_ntt_dit__(a + n / 2, n / 2, iroots, q);
+        len = n;
+    }
+
+    for (; len <= n; len *= 2) {
+        SN_KERNEL(ntt_dit_level)(a, n, len / 2, iroots + len / 2, q);
+    }
+}
+
+/** The `i`-th 32-bit digit of a block array */
+static inline uint32_t sn_ntt_digit__(const sn_word *ap, size_t i) {
+    return (uint32_t)(ap[i / SN_NTT_DIGITS] >> (32 * (i % SN_NTT_DIGITS)));
+}
+
+/** Transform length for a product of `an` and `bn` blocks */
+static size_t sn_ntt_size__(size_t an, size_t bn) {
+    size_t coeffs = (an + bn) * SN_NTT_DIGITS - 1, n = 2;
+
+    while (n < coeffs) {
+        n *= 2;
+    }
+
+    return n;
+}
+
+static bool sn_ntt_fits__(size_t an, size_t bn) {
+    return an + bn <= ((size_t)1 << SN_NTT_MAX_LOG) / SN_NTT_DIGITS;
+}
+
+static size_t sn_ntt_scratch__(size_t an, size_t bn) {
+    /* Three residue arrays, one operand transform and two twiddle tables */
+    size_t digits = 6 * sn_ntt_size__(an, bn);
+
+    return (digits + SN_NTT_DIGITS - 1) / SN_NTT_DIGITS;
+}
+
+/**
+ * Load the `n` digits of `ap` into `a` in Montgomery form, pad it with zeros
+ * to `len` and transform it.
+ */
+static void sn_ntt_forward__(uint32_t *a, size_t len, const sn_word *ap, size_t n,
+        const uint32_t *roots, const sn_ntt_prime *q) {
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = sn_ntt_to_mont__(sn_ntt_digit__(ap, i), q);
+    }
+    memset(a + n, 0, (len - n) * sizeof(*a));
+
+    sn_ntt_dif__(a, len, roots, q);
+}
+
+/**
+ * Multiply `an` and `bn` block operands through number theoretic transforms,
+ * transforming the operand only once if both are the same.
+ */
+static void sn_mul_ntt__(sn_word *rp, const sn_word *ap, size_t an,
+        const sn_word *bp, size_t bn, sn_word *scratch) {
+    assert(sn_ntt_fits__(an, bn));
+
+    const size_t len = sn_ntt_size__(an, bn);
+    const size_t ad = an * SN_NTT_DIGITS, bd = bn * SN_NTT_DIGITS;
+    const bool square = ap == bp && an == bn;
+    uint32_t *res[3], *tmp, *roots, *iroots;
+
+    res[0] = (uint32_t *)scratch;
+    res[1] = res[0] + len;
+    res[2] = res[1] + len;
+    tmp    = res[2] + len;
+    roots  = tmp + len;
+    iroots = roots + len;
+
+    for (size_t k = 0; k < 3; ++k) {
+        const sn_ntt_prime *q = &sn_ntt_primes__[k];
+
+        uint32_t w  = sn_ntt_pow__(sn_ntt_to_mont__(q->g, q), (q->p - 1) / len, q);
+        uint32_t iw = sn_ntt_pow__(w, q->p - 2, q);
+        sn_ntt_roots__(roots, len, w, q);
+        sn_ntt_roots__(iroots, len, iw, q);
+
+        sn_ntt_forward__(res[k], len, ap, ad, roots, q);
+        if (!square) {
+            sn_ntt_forward__(tmp, len, bp, bd, roots, q);
+        }
+
+        /* Multiplying the Montgomery forms by the plain 1/len scales the
+         * inverse transform and converts it out of Montgomery form at once;
+         * the transform is linear, so that can happen before it */
+        uint32_t scale = sn_ntt_pow__(sn_ntt_to_mont__(len % q->p, q), q->p - 2, q);
+        scale = sn_ntt_redc__(scale, q);
+        SN_KERNEL(ntt_pointwise)(res[k], square ? res[k] : tmp, len, scale, q);
+        sn_ntt_dit__(res[k], len, iroots, q);
+    }
+
+    /* Garner's CRT constants, in Montgomery form: 1/p0 mod p1, 1/(p0 p1) mod p2.
+     * The residues are plain, so multiplying by them yields plain values. */
+    const sn_ntt_prime *q0 = &sn_ntt_primes__[0], *q1 = &sn_ntt_primes__[1],
+                       *q2 = &sn_ntt_primes__[2];
+    const uint64_t p01 = (uint64_t)q0->p * q1->p;
+    uint32_t inv01  = sn_ntt_pow__(sn_ntt_to_mont__(q0->p, q1), q1->p - 2, q1);
+    uint32_t inv012 = sn_ntt_pow__(sn_ntt_to_mont__((uint32_t)(p01 % q2->p), q2),
+                                   q2->p - 2, q2);
+
+    /* Carry held in three 32-bit digits */
+    uint64_t c0 = 0, c1 = 0, c2 = 0, s;
+    const size_t coeffs = ad + bd - 1, rd = ad + bd;
+
+    for (size_t i = 0; i < rd; ++i) {
+        uint32_t d0 = 0, d1 = 0, d2 = 0;
+
+        if (i < coeffs) {
+            uint32_t r0 = res[0][i], r1 = res[1][i], r2 = res[2][i];
+
+            /* x01 = r0 + p0 ((r1 - r0) / p0 mod p1) < p0 p1 */
+            uint32_t t1  = sn_ntt_mul__(sn_ntt_sub__(r1, r0 % q1->p, q1), inv01, q1);
+            uint64_t x01 = r0 + (uint64_t)q0->p * t1;
+
+            /* x = x01 + p0 p1 ((r2 - x01) / (p0 p1) mod p2) */
+            uint32_t x01_mod = sn_ntt_mul__(sn_ntt_redc__(x01, q2), q2->r2, q2);
+            uint32_t t2  = sn_ntt_mul__(sn_ntt_sub__(r2, x01_mod, q2), inv012, q2);
+            uint64_t lo  = (uint64_t)(uint32_t)p01 * t2;
+            uint64_t hi  = (p01 >> 32) * t2;
+
+            s  = (x01 & 0xffffffff) + (lo & 0xffffffff);
+            d0 = (uint32_t)s;
+            s  = (s >> 32) + (x01 >> 32) + (lo >> 32) + (hi & 0xffffffff);
+            d1 = (uint32_t)s;
+            d2 = (uint32_t)((s >> 32) + (hi >> 32));
+        }
+
+        s  = c0 + d0;
+        uint32_t digit = (uint32_t)s;
+        s  = (s >> 32) + c1 + d1;
+        c0 = (uint32_t)s;
+        s  = (s >> 32) + c2 + d2;
+        c1 = (uint32_t)s;
+        c2 = s >> 32;
+
+        if (i % SN_NTT_DIGITS == 0) {
+            rp[i / SN_NTT_DIGITS] = digit;
+        } else {
+            rp[i / SN_NTT_DIGITS] |= (sn_word)digit << (32 * (i % SN_NTT_DIGITS));
+        }
+    }
+
+    assert(c0 == 0 && c1 == 0 && c2 == 0);
+}
+
+/* **********************************************************************************
+ * Multiplication algorithms
+ *
+ * All of these take an `an + bn` block product destination that does not
+ * overlap the operands and a caller-provided scratch area, sized by
+ * sn_mul_scratch__(), from which every temporary is carved. Nothing is
+ * allocated during the recursion.
+ */
+
+/**
+ * Number of scratch blocks needed to multiply two `n` block operands.
+ */
+static size_t sn_mul_n_scratch__(size_t n) {
+    const size_t karatsuba = max(sn_thresholds__[SN_THRESHOLD_MUL_KARATSUBA], 2);
+    const size_t toom3     = max(sn_thresholds__[SN_THRESHOLD_MUL_TOOM3], 5);
+
+    if (n >= sn_thresholds__[SN_THRESHOLD_MUL_NTT] && sn_ntt_fits__(n, n)) {
+        return sn_ntt_scratch__(n, n);
+    } else if (n < karatsuba) {
+        return 0;
+    } else if (n < toom3) {
+        size_t h = n - n / 2;
+        size_t next = max(sn_mul_n_scratch__(h), sn_mul_n_scratch__(n / 2));
+        return 4 * h + max(2 * h + 1, next);
+    } else {
+        size_t k = (n + 2) / 3, r = n - 2 * k;
+        size_t next = max(sn_mul_n_scratch__(k + 1),
+                max(sn_mul_n_scratch__(k), sn_mul_n_scratch__(r)));
+        return 12 * (k + 1) + next;
+    }
+}
+
+/**
+ * Number of scratch blocks needed to multiply `an` >= `bn` block operands.
+ */
+static size_t sn_mul_scratch__(size_t an, size_t bn) {
+    assert(an >= bn);
+
+    if (bn >= sn_thresholds__[SN_THRESHOLD_MUL_NTT] && sn_ntt_fits__(an, bn)) {
+        return sn_ntt_scratch__(an, bn);
+    } else if (bn < sn_thresholds__[SN_THRESHOLD_MUL_KARATSUBA] || bn < 2) {
+        return 0;
+    } else if (an == bn) {
+        return sn_mul_n_scratch__(bn);
+    }
+
+    size_t need = sn_mul_n_scratch__(bn);
+    if (an % bn) {
+        need = max(need, sn_mul_scratch__(bn, an % bn));
+    }
+
+    return 2 * bn + need;
+}
+
+/**
+ * Add `xn` blocks at `xp` into the `rn` blocks at `rp`. Blocks of `x` beyond
+ * `rn` must be zero and the sum must fit into `rn` blocks.
+ */
+static void sn_add_into__(sn_word *rp, size_t rn, const sn_word *xp, size_t xn) {
+    for (; xn > rn; --xn) {
+        assert(xp[xn - 1] == 0);
+    }
+
+    sn_word carry = sn_add__(rp, rp, rn, xp, xn);
+    assert(carry == 0);
+    (void)carry;
+}
+
+/**
+ * Karatsuba multiplication of two `n` block operands. With a = a1 B^l + a0 and
+ * b = b1 B^l + b0, the middle coefficient a0 b1 + a1 b0 is computed as
+ * a0 b0 + a1 b1 - (a1 - a0)(b1 - b0), i.e. with three half-size products.
+ */
+static void sn_mul_karatsuba__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        size_t n, sn_word *scratch) {
+    const size_t l = n / 2, h = n - l;
+    const sn_word *a0 = ap, *a1 = ap + l, *b0 = bp, *b1 = bp + l;
+    sn_word *da = scratch, *db = da + h, *zm = db + h, *next = zm + 2 * h;
+
+    bool neg = sn_abs_sub__(da, a1, h, a0, l) ^ sn_abs_sub__(db, b1, h, b0, l);
+
+    sn_mul_n__(rp, a0, b0, l, next);
+    sn_mul_n__(rp + 2 * l, a1, b1, h, next);
+    sn_mul_n__(zm, da, db, h, next);
+
+    /* The recursion is done, so its scratch can hold the middle coefficient */
+    sn_word *mid = next;
+    mid[2 * h] = sn_add__(mid, rp + 2 * l, 2 * h, rp, 2 * l);
+    if (neg) {
+        mid[2 * h] += sn_add_n__(mid, mid, zm, 2 * h);
+    } else {
+        mid[2 * h] -= sn_sub_n__(mid, mid, zm, 2 * h);
+    }
+
+    sn_add_into__(rp + l, 2 * n - l, mid, 2 * h + 1);
+}
+
+/**
+ * Evaluate x = x2 B^2k + x1 B^k + x0, with `r` blocks in x2, at the points 1,
+ * -1 and 2. Each result has `k + 1` blocks; the magnitude is stored for -1
+ * and its sign returned.
+ */
+static bool sn_toom3_eval__(sn_word *e1, sn_word *em1, sn_word *e2,
+        const sn_word *xp, size_t k, size_t r) {
+    const sn_word *x0 = xp, *x1 = xp + k, *x2 = xp + 2 * k;
+    bool neg;
+
+    /* e1 = x0 + x2, em1 = |x0 - x1 + x2| */
+    e1[k] = sn_add__(e1, x0, k, x2, r);
+    neg   = sn_abs_sub__(em1, e1, k + 1, x1, k);
+    e1[k] += sn_add_n__(e1, e1, x1, k);
+
+    /* e2 = x0 + 2 x1 + 4 x2 */
+    memcpy(e2, x0, k * sizeof(*e2));
+    e2[k]  = sn_addmul_1__(e2, x1, k, 2);
+    e2[k] += sn_add_1__(e2 + r, e2 + r, k - r, sn_addmul_1__(e2, x2, r, 4));
+
+    return neg;
+}
+
+/**
+ * Recover the coefficients c0..c4 of a Toom-3 product from its values at 0, 1,
+ * -1, 2 and infinity and assemble the `2n` block product at `rp`, where c0 and
+ * c4 have already been stored. Only nonnegative intermediate values are ever
+ * formed, so no signed arithmetic is needed:
+ *
+ *     c1 + c3   = (v(1) - v(-1)) / 2
+ *     c2        = (v(1) + v(-1)) / 2 - c0 - c4
+ *     c1 + 4 c3 = (v(2) - c0 - 4 c2 - 16 c4) / 2
+ *     c3        = ((c1 + 4 c3) - (c1 + c3)) / 3
+ *
+ * `v1`, `vm1` and `v2` have `2k + 2` blocks, `vm1` holds |v(-1)| with the sign
+ * given by `neg`, and `tmp` has room for another `2k + 2` blocks. The values
+ * are overwritten.
+ */
+static void sn_toom3_interpolate__(sn_word *rp, size_t n, sn_word *v1, sn_word *vm1,
+        sn_word *v2, bool neg, sn_word *tmp) {
+    const size_t k = (n + 2) / 3, r = n - 2 * k, vn = 2 * (k + 1);
+    const sn_word *c0 = rp, *c4 = rp + 4 * k;
+    sn_word *c13 = tmp;
+
+    if (neg) {
+        sn_add_n__(c13, v1, vm1, vn);
+        sn_sub_n__(vm1, v1, vm1, vn);
+    } else {
+        sn_sub_n__(c13, v1, vm1, vn);
+        sn_add_n__(vm1, v1, vm1, vn);
+    }
+    sn_rshift__(c13, c13, vn, 1);
+    sn_rshift__(vm1, vm1, vn, 1);
+
+    sn_word *c2 = vm1;
+    sn_sub__(c2, c2, vn, c0, 2 * k);
+    sn_sub__(c2, c2, vn, c4, 2 * r);
+
+    sn_word *c3 = v2;
+    sn_sub__(c3, c3, vn, c0, 2 * k);
+    sn_submul_1__(c3, c2, vn, 4);
+    sn_sub_1__(c3 + 2 * r, c3 + 2 * r, vn - 2 * r, sn_submul_1__(c3, c4, 2 * r, 16));
+    sn_rshift__(c3, c3, vn, 1);
+    sn_sub_n__(c3, c3, c13, vn);
+    sn_divexact_by3__(c3, c3, vn);
+
+    sn_word *c1 = c13;
+    sn_sub_n__(c1, c1, c3, vn);
+
+    memset(rp + 2 * k, 0, 2 * k * sizeof(*rp));
+    sn_add_into__(rp + k, 2 * n - k, c1, vn);
+    sn_add_into__(rp + 2 * k, 2 * n - 2 * k, c2, vn);
+    sn_add_into__(rp + 3 * k, 2 * n - 3 * k, c3, vn);
+}
+
+/**
+ * Toom-Cook 3-way multiplication of two `n` block operands: five products of
+ * a third of the size instead of nine.
+ */
+static void sn_mul_toom3__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        size_t n, sn_word *scratch) {
+    const size_t k = (n + 2) / 3, r = n - 2 * k, m = k + 1, vn = 2 * m;
+    sn_word *ea1 = scratch, *eam1 = ea1 + m, *ea2 = eam1 + m;
+    sn_word *eb1 = ea2 + m, *ebm1 = eb1 + m, *eb2 = ebm1 + m;
+    sn_word *v1 = eb2 + m, *vm1 = v1 + vn, *v2 = vm1 + vn, *next = v2 + vn;
+
+    bool neg = sn_toom3_eval__(ea1, eam1, ea2, ap, k, r)
+             ^ sn_toom3_eval__(eb1, ebm1, eb2, bp, k, r);
+
+    sn_mul_n__(v1, ea1, eb1, m, next);
+    sn_mul_n__(vm1, eam1, ebm1, m, next);
+    sn_mul_n__(v2, ea2, eb2, m, next);
+    sn_mul_n__(rp, ap, bp, k, next);                            /* c0 */
+    sn_mul_n__(rp + 4 * k, ap + 2 * k, bp + 2 * k, r, next);    /* c4 */
+
+    /* The evaluated operands are no longer needed */
+    sn_toom3_interpolate__(rp, n, v1, vm1, v2, neg, scratch);
+}
+
+/**
+ * Multiply two `n` block operands, picking the algorithm by size.
+ */
+static void sn_mul_n__(sn_word *rp, const sn_word *ap, const sn_word *bp, size_t n,
+        sn_word *scratch) {
+    if (n >= sn_thresholds__[SN_THRESHOLD_MUL_NTT] && sn_ntt_fits__(n, n)) {
+        sn_mul_ntt__(rp, ap, n, bp, n, scratch);
+    } else if (n < sn_thresholds__[SN_THRESHOLD_MUL_KARATSUBA] || n < 2) {
+        sn_mul_basecase__(rp, ap, n, bp, n);
+    } else if (n < sn_thresholds__[SN_THRESHOLD_MUL_TOOM3] || n < 5) {
+        sn_mul_karatsuba__(rp, ap, bp, n, scratch);
+    } else {
+        sn_mul_toom3__(rp, ap, bp, n, scratch);
+    }
+}
+
+/**
+ * Multiply `an` >= `bn` block operands. Unbalanced operands are cut into
+ * `bn` block chunks of `a` whose products are accumulated into `rp`.
+ */
+static void sn_mul_internal__(sn_word *rp, const sn_word *ap, size_t an,
+        const sn_word *bp, size_t bn, sn_word *scratch) {
+    assert(an >= bn && bn > 0);
+
+    if (bn >= sn_thresholds__[SN_THRESHOLD_MUL_NTT] && sn_ntt_fits__(an, bn)) {
+        sn_mul_ntt__(rp, ap, an, bp, bn, scratch);
+        return;
+    } else if (bn < sn_thresholds__[SN_THRESHOLD_MUL_KARATSUBA] || bn < 2) {
+        sn_mul_basecase__(rp, ap, an, bp, bn);
+        return;
+    } else if (an == bn) {
+        sn_mul_n__(rp, ap, bp, bn, scratch);
+        return;
+    }
+
+    sn_word *tmp = scratch, *next = scratch + 2 * bn;
+
+    sn_mul_n__(rp, ap, bp, bn, next);
+    for (size_t off = bn; off < an; off += bn) {
+        size_t cn = min(bn, an - off);
+        if (cn == bn) {
+            sn_mul_n__(tmp, ap + off, bp, bn, next);
+        } else {
+            sn_mul_internal__(tmp, bp, bn, ap + off, cn, next);
+        }
+
+        sn_word carry = sn_add_n__(rp + off, rp + off, tmp, bn);
+        memcpy(rp + off + bn, tmp + bn, cn * sizeof(*rp));
+        carry = sn_add_1__(rp + off + bn, rp + off + bn, cn, carry);
+        assert(carry == 0);
+        (void)carry;
+    }
+}
+
+/* **********************************************************************************
+ * Squaring algorithms
+ *
+ * Counterparts of the multiplication algorithms for a = b, which share their
+ * scratch conventions. Each of them saves work by exploiting the symmetry of
+ * the product.
+ */
+
+/**
+ * Number of scratch blocks needed to square an `n` block operand.
+ */
+static size_t sn_sqr_scratch__(size_t n) {
+    const size_t karatsuba = max(sn_thresholds__[SN_THRESHOLD_SQR_KARATSUBA], 2);
+    const size_t toom3     = max(sn_thresholds__[SN_THRESHOLD_SQR_TOOM3], 5);
+
+    if (n >= sn_thresholds__[SN_THRESHOLD_SQR_NTT] && sn_ntt_fits__(n, n)) {
+        return sn_ntt_scratch__(n, n);
+    } else if (n < karatsuba) {
+        return 0;
+    } else if (n < toom3) {
+        size_t h = n - n / 2;
+        size_t next = max(sn_sqr_scratch__(h), sn_sqr_scratch__(n / 2));
+        return 3 * h + max(2 * h + 1, next);
+    } else {
+        size_t k = (n + 2) / 3, r = n - 2 * k;
+        size_t next = max(sn_sqr_scratch__(k + 1),
+                max(sn_sqr_scratch__(k), sn_sqr_scratch__(r)));
+        return 9 * (k + 1) + next;
+    }
+}
+
+/**
+ * Schoolbook squaring of the `n` blocks at `ap` into `2n` blocks at `rp`. Each
+ * cross product a_i a_j, i < j, is computed once and doubled by a shift, and
+ * the squares a_i^2 are added on the diagonal.
+ */
+static void sn_sqr_basecase__(sn_word *rp, const sn_word *ap, size_t n) {
+    rp[0] = rp[2 * n - 1] = 0;
+
+    if (n > 1) {
+        rp[n] = sn_mul_1__(rp + 1, ap + 1, n - 1, ap[0]);
+        for (size_t i = 1; i + 1 < n; ++i) {
+            rp[n + i] = sn_addmul_1__(rp + 2 * i + 1, ap + i + 1, n - i - 1, ap[i]);
+        }
+        rp[2 * n - 1] = sn_lshift__(rp + 1, rp + 1, 2 * n - 2, 1);
+    }
+
+    sn_word carry = 0;
+    sn_dword sq, tmp;
+
+    for (size_t i = 0; i < n; ++i) {
+        sq  = (sn_dword)ap[i] * ap[i];
+        tmp = (sn_dword)rp[2 * i] + (sn_word)sq + carry;
+        rp[2 * i] = (sn_word)tmp;
+        tmp = (sn_dword)rp[2 * i + 1] + (sn_word)(sq >> SN_WORD_BITS) + (tmp >> SN_WORD_BITS);
+        rp[2 * i + 1] = (sn_word)tmp;
+        carry = (sn_word)(tmp >> SN_WORD_BITS);
+    }
+
+    assert(carry == 0);
+}
+
+/**
+ * Karatsuba squaring: with a = a1 B^l + a0, the middle coefficient 2 a0 a1 is
+ * a0^2 + a1^2 - (a1 - a0)^2, which is never negative.
+ */
+static void sn_sqr_karatsuba__(sn_word *rp, const sn_word *ap, size_t n,
+        sn_word *scratch) {
+    const size_t l = n / 2, h = n - l;
+    const sn_word *a0 = ap, *a1 = ap + l;
+    sn_word *d = scratch, *zm = d + h, *next = zm + 2 * h;
+
+    sn_abs_sub__(d, a1, h, a0, l);
+
+    sn_sqr_n__(rp, a0, l, next);
+    sn_sqr_n__(rp + 2 * l, a1, h, next);
+    sn_sqr_n__(zm, d, h, next);
+
+    sn_word *mid = next;
+    mid[2 * h]  = sn_add__(mid, rp + 2 * l, 2 * h, rp, 2 * l);
+    mid[2 * h] -= sn_sub_n__(mid, mid, zm, 2 * h);
+
+    sn_add_into__(rp + l, 2 * n - l, mid, 2 * h + 1);
+}
+
+/**
+ * Toom-3 squaring: the operand is evaluated once and v(-1) is a square, hence
+ * nonnegative.
+ */
+static void sn_sqr_toom3__(sn_word *rp, const sn_word *ap, size_t n, sn_word *scratch) {
+    const size_t k = (n + 2) / 3, r = n - 2 * k, m = k + 1, vn = 2 * m;
+    sn_word *e1 = scratch, *em1 = e1 + m, *e2 = em1 + m;
+    sn_word *v1 = e2 + m, *vm1 = v1 + vn, *v2 = vm1 + vn, *next = v2 + vn;
+
+    sn_toom3_eval__(e1, em1, e2, ap, k, r);
+
+    sn_sqr_n__(v1, e1, m, next);
+    sn_sqr_n__(vm1, em1, m, next);
+    sn_sqr_n__(v2, e2, m, next);
+    sn_sqr_n__(rp, ap, k, next);
+    sn_sqr_n__(rp + 4 * k, ap + 2 * k, r, next);
+
+    sn_toom3_interpolate__(rp, n, v1, vm1, v2, false, scratch);
+}
+
+/**
+ * Square an `n` block operand, picking the algorithm by size.
+ */
+static void sn_sqr_n__(sn_word *rp, const sn_word *ap, size_t n, sn_word *scratch) {
+    if (n >= sn_thresholds__[SN_THRESHOLD_SQR_NTT] && sn_ntt_fits__(n, n)) {
+        sn_mul_ntt__(rp, ap, n, ap, n, scratch);
+    } else if (n < sn_thresholds__[SN_THRESHOLD_SQR_KARATSUBA] || n < 2) {
+        sn_sqr_basecase__(rp, ap, n);
+    } else if (n < sn_thresholds__[SN_THRESHOLD_SQR_TOOM3] || n < 5) {
+        sn_sqr_karatsuba__(rp, ap, n, scratch);
+    } else {
+        sn_sqr_toom3__(rp, ap, n, scratch);
+    }
+}
+
+/* **********************************************************************************
+ * Division algorithms
+ *
+ * The divisor is normalized, i.e. shifted so that the top bit of its most
+ * significant block is set, and each quotient block is estimated with a
+ * precomputed reciprocal of the top divisor block (Möller and Granlund,
+ * "Improved division by invariant integers") instead of a hardware division.
+ */
+
+/** Reciprocal floor((B^2 - 1) / d) - B of the normalized block `d` */
+static sn_word sn_invert_limb__(sn_word d) {
+    assert(d >> (SN_WORD_BITS - 1));
+
+    return (sn_word)((((sn_dword)~d << SN_WORD_BITS) | SN_WORD_MAX) / d);
+}
+
+/**
+ * Divide u1 B + u0 by the normalized block `d` with reciprocal `v`, where
+ * u1 < d. Returns the quotient and stores the remainder at `r`.
+ */
+static inline sn_word sn_div_2by1__(sn_word *r, sn_word u1, sn_word u0, sn_word d,
+        sn_word v) {
+    sn_dword q = (sn_dword)v * u1 + (((sn_dword)u1 << SN_WORD_BITS) | u0);
+    sn_word q1 = (sn_word)(q >> SN_WORD_BITS) + 1, q0 = (sn_word)q;
+    sn_word rem = u0 - q1 * d;
+
+    if (rem > q0) {
+        --q1;
+        rem += d;
+    }
+    if (rem >= d) {
+        ++q1;
+        rem -= d;
+    }
+
+    *r = rem;
+    return q1;
+}
+
+/**
+ * Divide the `n` blocks at `ap` by the nonzero block `d`, store the `n` block
+ * quotient at `qp` and return the remainder.
+ */
+static sn_word sn_divrem_1__(sn_word *qp, const sn_word *ap, size_t n, sn_word d) {
+    const unsigned s = sn_clz__(d);
+    const sn_word dn = d << s, v = sn_invert_limb__(dn);
+    sn_word r = s ? ap[n - 1] >> (SN_WORD_BITS - s) : 0, u0;
+
+    for (size_t i = n; i-- > 0;) {
+        u0 = ap[i] << s;
+        if (s && i > 0) {
+            u0 |= ap[i - 1] >> (SN_WORD_BITS - s);
+        }
+        qp[i] = sn_div_2by1__(&r, r, u0, dn, v);
+    }
+
+    return r >> s;
+}
+
+/** Remainder of the `n` blocks at `ap` by the nonzero block `d` */
+static sn_word sn_mod_1__(const sn_word *ap, size_t n, sn_word d) {
+    const unsigned s = sn_clz__(d);
+    const sn_word dn = d << s, v = sn_invert_limb__(dn);
+    sn_word r = s ? ap[n - 1] >> (SN_WORD_BITS - s) : 0, u0;
+
+    for (size_t i = n; i-- > 0;) {
+        u0 = ap[i] << s;
+        if (s && i > 0) {
+            u0 |= ap[i - 1] >> (SN_WORD_BITS - s);
+        }
+        sn_div_2by1__(&r, r, u0, dn, v);
+    }
+
+    return r >> s;
+}
+
+/**
+ * Knuth's algorithm D. Divide the `un + 1` blocks at `up` by the `dn` >= 2
+ * blocks at `dp`, whose top bit must be set and which must exceed the top `dn`
+ * blocks of `up`. The `un - dn + 1` block quotient is stored at `qp` and the
+ * remainder is left in the low `dn` blocks of `up`.
+ */
+static void sn_div_knuth__(sn_word *qp, sn_word *up, size_t un, const sn_word *dp,
+        size_t dn) {
+    assert(dn >= 2 && un >= dn && (dp[dn - 1] >> (SN_WORD_BITS - 1)));
+
+    const sn_word d1 = dp[dn - 1], d0 = dp[dn - 2], v = sn_invert_limb__(d1);
+
+    for (size_t j = un - dn + 1; j-- > 0;) {
+        sn_word u2 = up[j + dn], u1 = up[j + dn - 1], u0 = up[j + dn - 2];
+        sn_word qhat, rhat;
+        bool rhat_overflow = false;
+
+        if (u2 >= d1) {
+            qhat = SN_WORD_MAX;
+            rhat = u1 + d1;
+            rhat_overflow = rhat < d1;
+        } else {
+            qhat = sn_div_2by1__(&rhat, u2, u1, d1, v);
+        }
+
+        /* The estimate is now at most two too large; the second divisor block
+         * almost always catches that */
+        while (!rhat_overflow
+                && (sn_dword)qhat * d0 > (((sn_dword)rhat << SN_WORD_BITS) | u0)) {
+            --qhat;
+            rhat += d1;
+            rhat_overflow = rhat < d1;
+        }
+
+        if (up[j + dn] < sn_submul_1__(up + j, dp, dn, qhat)) {
+            --qhat;
+            sn_add_n__(up + j, up + j, dp, dn);
+        }
+        up[j + dn] = 0;
+        qp[j] = qhat;
+    }
+}
+
+/**
+ * Number of scratch blocks needed by sn_div_2n1n__() for an `n` block divisor.
+ */
+static size_t sn_div_2n1n_scratch__(size_t n) {
+    if (n == 1) {
+        return 0;
+    } else if (n % 2 || n < sn_thresholds__[SN_THRESHOLD_DIV_BZ]) {
+        return 2 * n;
+    }
+
+    size_t h = n / 2;
+    return 3 * h + (4 * h + 1) + max(sn_div_2n1n_scratch__(h), sn_mul_n_scratch__(h));
+}
+
+/**
+ * Burnikel and Ziegler's recursive division of the `2n` blocks at `ap` by the
+ * normalized `n` blocks at `bp`, where the top `n` blocks of `ap` are less
+ * than `bp`. Stores the `n` block quotient at `qp` and the `n` block remainder
+ * at `rp`. The dividend is split into four halves, and each of the two halves
+ * of the quotient comes from a 3-by-2 division in sn_div_3n2n__().
+ */
+static void sn_div_2n1n__(sn_word *qp, sn_word *rp, const sn_word *ap,
+        const sn_word *bp, size_t n, sn_word *scratch) {
+    if (n == 1) {
+        qp[0] = sn_div_2by1__(rp, ap[1], ap[0], bp[0], sn_invert_limb__(bp[0]));
+        return;
+    } else if (n % 2 || n < sn_thresholds__[SN_THRESHOLD_DIV_BZ]) {
+        sn_word *u = scratch;
+        memcpy(u, ap, 2 * n * sizeof(*u));
+        sn_div_knuth__(qp, u, 2 * n - 1, bp, n);
+        memcpy(rp, u, n * sizeof(*rp));
+        return;
+    }
+
+    const size_t h = n / 2;
+    sn_word *t = scratch, *next = t + 3 * h;
+
+    /* The first remainder lands right above the lowest quarter of the
+     * dividend, where the second 3-by-2 division expects it */
+    memcpy(t, ap, h * sizeof(*t));
+    sn_div_3n2n__(qp + h, t + h, ap + h, bp, h, next);
+    sn_div_3n2n__(qp, rp, t, bp, h, next);
+}
+
+/**
+ * Divide the `3h` blocks at `ap` by the normalized `2h` blocks at `bp`, where
+ * the top `2h` blocks of `ap` are less than `bp`, into an `h` block quotient
+ * at `qp` and a `2h` block remainder at `rp`. The quotient is estimated from
+ * the top halves alone and then corrected at most twice.
+ */
+static void sn_div_3n2n__(sn_word *qp, sn_word *rp, const sn_word *ap,
+        const sn_word *bp, size_t h, sn_word *scratch) {
+    const sn_word *b1 = bp + h, *b2 = bp;
+    sn_word *r = scratch, *d = r + 2 * h + 1, *next = d + 2 * h;
+
+    memcpy(r, ap, h * sizeof(*r));
+    if (sn_cmp__(ap + 2 * h, h, b1, h) < 0) {
+        sn_div_2n1n__(qp, r + h, ap + h, b1, h, next);
+        r[2 * h] = 0;
+    } else {
+        /* The top halves are equal, so the estimate is B^h - 1 and the partial
+         * remainder a1 B^h + a2 - (B^h - 1) b1 is a2 + b1 */
+        memset(qp, 0xff, h * sizeof(*qp));
+        r[2 * h] = sn_add_n__(r + h, ap + h, b1, h);
+    }
+
+    sn_mul_n__(d, qp, b2, h, next);
+    if (sn_sub__(r, r, 2 * h + 1, d, 2 * h)) {
+        /* The remainder went negative, so add the divisor back until the sum
+         * carries out of the top block */
+        do {
+            sn_sub_1__(qp, qp, h, 1);
+        } while (!sn_add__(r, r, 2 * h + 1, bp, 2 * h));
+    }
+
+    memcpy(rp, r, 2 * h * sizeof(*rp));
+}
+
+/**
+ * Divide `an` >= `bn` blocks at `ap` by the `bn` blocks at `bp`, whose top
+ * block must be nonzero. Stores the `an - bn + 1` block quotient at `qp` and
+ * the `bn` block remainder at `rp`. Returns false if a temporary could not be
+ * allocated.
+ */
+static bool sn_divrem__(sn_word *qp, sn_word *rp, const sn_word *ap, size_t an,
+        const sn_word *bp, size_t bn) {
+    assert(an >= bn && bn > 0 && bp[bn - 1] != 0);
+
+    if (bn == 1) {
+        rp[0] = sn_divrem_1__(qp, ap, an, bp[0]);
+        return true;
+    }
+
+    const unsigned s = sn_clz__(bp[bn - 1]);
+    const size_t bz = sn_thresholds__[SN_THRESHOLD_DIV_BZ];
+
+    if (bn < bz || an - bn < bz) {
+        sn_word *u = sn_tmp_alloc__(an + 1 + bn), *d = u + an + 1;
+        if (!u) {
+            return false;
+        }
+
+        if (s) {
+            u[an] = sn_lshift__(u, ap, an, s);
+            sn_lshift__(d, bp, bn, s);
+        } else {
+            u[an] = 0;
+            memcpy(u, ap, an * sizeof(*u));
+            memcpy(d, bp, bn * sizeof(*d));
+        }
+
+        sn_div_knuth__(qp, u, an, d, bn);
+
+        if (s) {
+            sn_rshift__(rp, u, bn, s);
+        } else {
+            memcpy(rp, u, bn * sizeof(*rp));
+        }
+
+        sn_tmp_free__(u, an + 1 + bn);
+        return true;
+    }
+
+    /* Pad the divisor with zero blocks to n << k blocks, with n below the
+     * threshold, so that the recursion halves it evenly down to the base case */
+    size_t n = bn, k = 0;
+    while (n >= bz && n > 1) {
+        n = (n + 1) / 2;
+        ++k;
+    }
+    n <<= k;
+
+    /* Both operands are shifted by the same amount, which leaves the quotient
+     * alone; the dividend grows by one block for the bits shifted out */
+    const size_t pad = n - bn, len = an + pad + 1, m = len / n, rem = len % n;
+    const size_t alloc = len + n + 3 * n + sn_div_2n1n_scratch__(n);
+    sn_word *a = sn_tmp_alloc__(alloc);
+    if (!a) {
+        return false;
+    }
+
+    sn_word *b = a + len, *z = b + n, *r = z + 2 * n, *scratch = r + n;
+
+    memset(a, 0, pad * sizeof(*a));
+    memset(b, 0, pad * sizeof(*b));
+    if (s) {
+        a[len - 1] = sn_lshift__(a + pad, ap, an, s);
+        sn_lshift__(b + pad, bp, bn, s);
+    } else {
+        a[len - 1] = 0;
+        memcpy(a + pad, ap, an * sizeof(*a));
+        memcpy(b + pad, bp, bn * sizeof(*b));
+    }
+
+    /* The top n blocks of the dividend are less than the divisor. The
+     * quotient blocks above the last full n block "digit" come from a short
+     * Knuth division, the others from one 2n-by-n division per digit */
+    if (rem) {
+        sn_div_knuth__(qp + (m - 1) * n, a + (m - 1) * n, rem + n - 1, b, n);
+    }
+    memcpy(r, a + (m - 1) * n, n * sizeof(*r));
+
+    for (size_t i = m - 1; i-- > 0;) {
+        memcpy(z, a + i * n, n * sizeof(*z));
+        memcpy(z + n, r, n * sizeof(*z));
+        sn_div_2n1n__(qp + i * n, r, z, b, n, scratch);
+    }
+
+    if (s) {
+        sn_rshift__(rp, r + pad, bn, s);
+    } else {
+        memcpy(rp, r + pad, bn * sizeof(*rp));
+    }
+
+    sn_tmp_free__(a, alloc);
+    return true;
+}
+
+/* **********************************************************************************
+ * Montgomery arithmetic
+ *
+ * With an odd `n` block modulus m and R = B^n, a residue a is represented by
+ * a R mod m. The product of two such representations only has to be divided
+ * by R modulo m, which REDC does with multiplications by -m^-1 mod B and
+ * shifts instead of a division.
+ */
+
+/** Precomputed constants for arithmetic modulo a fixed odd number */
+struct sn_mont_ctx {
+    sn_word *mod;  /**< The modulus, `n` blocks with a nonzero top block */
+    sn_word *one;  /**< R mod m, i.e. 1 in Montgomery form */
+    sn_word *r2;   /**< R^2 mod m, which converts into Montgomery form */
+    size_t   n;    /**< Number of blocks of the modulus */
+    sn_word  minv; /**< -m^-1 mod B */
+};
+
+/** Number of blocks behind `mod` in a context for an `n` block modulus */
+static inline size_t sn_mont_ctx_size__(size_t n) {
+    return 3 * n + (2 * n + 1) + (n + 2);
+}
+
+/** -a^-1 mod B for an odd block `a`, by Newton iteration */
+static sn_word sn_mont_minv__(sn_word a) {
+    assert(a & 1);
+
+    /* a a = 1 mod 8 for odd a, and every step doubles the correct bits */
+    sn_word inv = a;
+    for (unsigned bits = 3; bits < SN_WORD_BITS; bits *= 2) {
+        inv *= 2 - a * inv;
+    }
+
+    return -inv;
+}
+
+/**
+ * Number of scratch blocks needed by sn_mont_mul__() and sn_mont_sqr__() for
+ * an `n` block modulus.
+ */
+static size_t sn_mont_scratch__(size_t n) {
+    return 2 * n + max(n + 2, max(sn_mul_n_scratch__(n), sn_sqr_scratch__(n)));
+}
+
+/**
+ * Montgomery reduction of the `2n` blocks at `tp`, which must be less than
+ * m R: store t R^-1 mod m at `rp`. `tp` is destroyed. The carry of each row
+ * is parked in the block the row has just cleared and added in at the end.
+ */
+static void sn_mont_redc__(sn_word *rp, sn_word *tp, const sn_mont_ctx *ctx) {
+    const size_t n = ctx->n;
+
+    for (size_t i = 0; i < n; ++i) {
+        tp[i] = sn_addmul_1__(tp + i, ctx->mod, n, tp[i] * ctx->minv);
+    }
+
+    if (sn_add_n__(rp, tp + n, tp, n) || sn_cmp__(rp, n, ctx->mod, n) >= 0) {
+        sn_sub_n__(rp, rp, ctx->mod, n);
+    }
+}
+
+/**
+ * Montgomery product a b R^-1 mod m of the reduced `n` block residues at `ap`
+ * and `bp`. `rp` may alias either operand. Small moduli use the coarsely
+ * integrated operand scanning (CIOS) method, which interleaves every row of
+ * the product with a reduction step in `n + 2` blocks; larger ones multiply
+ * with the fastest algorithm and reduce afterwards.
+ */
+static void sn_mont_mul__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        const sn_mont_ctx *ctx, sn_word *scratch) {
+    const size_t n = ctx->n;
+    sn_word *t = scratch;
+
+    if (n >= sn_thresholds__[SN_THRESHOLD_MUL_KARATSUBA]) {
+        sn_mul_n__(t, ap, bp, n, t + 2 * n);
+        sn_mont_redc__(rp, t, ctx);
+        return;
+    }
+
+    const sn_word *mp = ctx->mod;
+    sn_dword acc;
+    sn_word carry;
+
+    memset(t, 0, (n + 2) * sizeof(*t));
+    for (size_t i = 0; i < n; ++i) {
+        acc = (sn_dword)t[n] + sn_addmul_1__(t, ap, n, bp[i]);
+        t[n]     = (sn_word)acc;
+        t[n + 1] = (sn_word)(acc >> SN_WORD_BITS);
+
+        /* Add q m, which clears the low block, and shift down by one block */
+        const sn_word q = t[0] * ctx->minv;
+        acc   = (sn_dword)q * mp[0] + t[0];
+        carry = (sn_word)(acc >> SN_WORD_BITS);
+        for (size_t j = 1; j < n; ++j) {
+            acc      = (sn_dword)q * mp[j] + t[j] + carry;
+            t[j - 1] = (sn_word)acc;
+            carry    = (sn_word)(acc >> SN_WORD_BITS);
+        }
+        acc      = (sn_dword)t[n] + carry;
+        t[n - 1] = (sn_word)acc;
+        t[n]     = t[n + 1] + (sn_word)(acc >> SN_WORD_BITS);
+    }
+
+    if (t[n] || sn_cmp__(t, n, mp, n) >= 0) {
+        sn_sub_n__(t, t, mp, n);
+    }
+    memcpy(rp, t, n * sizeof(*rp));
+}
+
+/**
+ * Montgomery square a^2 R^-1 mod m of the reduced `n` block residue at `ap`,
+ * which `rp` may alias. Squaring computes only half of the cross products.
+ */
+static void sn_mont_sqr__(sn_word *rp, const sn_word *ap, const sn_mont_ctx *ctx,
+        sn_word *scratch) {
+    const size_t n = ctx->n;
+
+    sn_sqr_n__(scratch, ap, n, scratch + 2 * n);
+    sn_mont_redc__(rp, scratch, ctx);
+}
+
+/** Exponent window width for an exponent of `bits` bits */
+static unsigned sn_powm_window__(size_t bits) {
+    static const size_t limits[] = { 7, 25, 81, 241, 673 };
+    unsigned w = 1;
+
+    while (w <= sizeof(limits) / sizeof(*limits) && bits > limits[w - 1]) {
+        ++w;
+    }
+
+    return w;
+}
+
+/** Bit `i` of the `n` blocks at `ep` */
+static inline unsigned sn_bit__(const sn_word *ep, size_t i) {
+    return (ep[i / SN_WORD_BITS] >> (i % SN_WORD_BITS)) & 1;
+}
+
+/**
+ * Raise the reduced `n` block residue at `bp`, in Montgomery form, to the
+ * power of the `en` blocks at `ep`, whose top block must be nonzero, and store
+ * the result in Montgomery form at `rp`. Scanning the exponent from the top
+ * with a sliding window, a run of `w` bits costs `w` squarings and a single
+ * multiplication by one of the precomputed odd powers b, b^3, ...,
+ * b^(2^w - 1). `scratch` holds the table, one more residue and the kernel
+ * scratch; nothing is allocated here.
+ */
+static void sn_powm__(sn_word *rp, const sn_word *bp, const sn_word *ep, size_t en,
+        const sn_mont_ctx *ctx, sn_word *scratch) {
+    const size_t n = ctx->n;
+    const size_t bits = en * SN_WORD_BITS - sn_clz__(ep[en - 1]);
+    const unsigned w = sn_powm_window__(bits);
+    sn_word *table = scratch, *b2 = table + ((size_t)1 << (w - 1)) * n, *tmp = b2 + n;
+
+    /* table[k] = b^(2k + 1) */
+    memcpy(table, bp, n * sizeof(*table));
+    if (w > 1) {
+        sn_mont_sqr__(b2, bp, ctx, tmp);
+        for (size_t k = 1; k < ((size_t)1 << (w - 1)); ++k) {
+            sn_mont_mul__(table + k * n, table + (k - 1) * n, b2, ctx, tmp);
+        }
+    }
+
+    bool first = true;
+    for (size_t i = bits; i-- > 0;) {
+        if (!sn_bit__(ep, i)) {
+            sn_mont_sqr__(rp, rp, ctx, tmp);
+            continue;
+        }
+
+        /* The longest window of at most `w` bits from `i` down that ends in
+         * a set bit */
+        size_t low = i + 1 >= w ? i + 1 - w : 0;
+        while (!sn_bit__(ep, low)) {
+            ++low;
+        }
+
+        size_t value = 0;
+        for (size_t j = i + 1; j-- > low;) {
+            value = value << 1 | sn_bit__(ep, j);
+            if (!first) {
+                sn_mont_sqr__(rp, rp, ctx, tmp);
+            }
+        }
+
+        if (first) {
+            memcpy(rp, table + (value >> 1) * n, n * sizeof(*rp));
+            first = false;
+        } else {
+            sn_mont_mul__(rp, rp, table + (value >> 1) * n, ctx, tmp);
+        }
+        i = low;
+    }
+}
+
+/** Number of scratch blocks needed by sn_powm__() */
+static size_t sn_powm_scratch__(size_t n, size_t en) {
+    const size_t bits = en * SN_WORD_BITS;
+
+    return (((size_t)1 << (sn_powm_window__(bits) - 1)) + 1) * n + sn_mont_scratch__(n);
+}
+
+/* **********************************************************************************
+ * Batched Montgomery exponentiation
+ *
+ * AVX-512 IFMA multiplies eight pairs of 52-bit numbers at once and adds the
+ * low or high 52 bits of the products to 64-bit accumulators. Eight unrelated
+ * exponentiations then run side by side, one per vector lane: numbers are
+ * split into `k` limbs of 52 bits, and limb i of every lane makes up vector i.
+ * The spare 12 bits of the accumulators absorb the carries of a whole
+ * multiplication, which are only propagated at its end. With R = 2^52k > 4m,
+ * "almost" Montgomery products of residues below 2m stay below 2m, so no lane
+ * ever needs a conditional subtraction until the final conversion.
+ */
+
+#if SN_X86_64_KERNELS
+
+#define SN_IFMA_LANES 8
+#define SN_IFMA_BITS  52
+#define SN_IFMA_MASK  ((UINT64_C(1) << SN_IFMA_BITS) - 1)
+/* Every column of a product collects at most 4 k terms below 2^52, which must
+ * fit into an accumulator */
+#define SN_IFMA_MAX_LIMBS 512
+/* Fixed exponent window, the same for every lane */
+#define SN_IFMA_WINDOW 5
+/* Smallest group worth running in vector lanes rather than one by one */
+#define SN_IFMA_MIN_LANES 3
+
+/**
+ * Almost Montgomery product a b R^-1 mod m in every lane of the `k` limb
+ * vectors at `ap` and `bp`, normalized into `rp`, which may be either operand.
+ * `mp` holds the moduli and `minv` -m^-1 mod 2^52 of every lane; `t` is scratch
+ * for `k` vectors.
+ */
+__attribute__((target("avx512f,avx512ifma")))
+static void sn_ifma_mont_mul__(uint64_t *rp, const uint64_t *ap, const uint64_t *bp,
+        const uint64_t *mp, const uint64_t *minv, size_t k, uint64_t *t) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i mask = _mm512_set1_epi64((long long)SN_IFMA_MASK);
+    const __m512i mi   = _mm512_loadu_si512(minv);
+
+    for (size_t j = 0; j < k; ++j) {
+        _mm512_storeu_si512(t + j * SN_IFMA_LANES, zero);
+    }
+
+    for (size_t i = 0; i < k; ++i) {
+        const __m512i b = _mm512_loadu_si512(bp + i * SN_IFMA_LANES);
+        __m512i a = _mm512_loadu_si512(ap), m = _mm512_loadu_si512(mp);
+
+        /* Column 0 of t + a b_i + q m is divisible by 2^52 */
+        __m512i x = _mm512_madd52lo_epu64(_mm512_loadu_si512(t), a, b);
+        const __m512i q = _mm512_madd52lo_epu64(zero, x, mi);
+        x = _mm512_madd52lo_epu64(x, q, m);
+        const __m512i carry = _mm512_srli_epi64(x, SN_IFMA_BITS);
+
+        /* Add the other columns and shift them down by one limb */
+        for (size_t j = 1; j < k; ++j) {
+            const __m512i aj = _mm512_loadu_si512(ap + j * SN_IFMA_LANES);
+            const __m512i mj = _mm512_loadu_si512(mp + j * SN_IFMA_LANES);
+
+            x = _mm512_madd52lo_epu64(_mm512_loadu_si512(t + j * SN_IFMA_LANES), aj, b);
+            x = _mm512_madd52lo_epu64(x, q, mj);
+            x = _mm512_madd52hi_epu64(x, a, b);
+            x = _mm512_madd52hi_epu64(x, q, m);
+            _mm512_storeu_si512(t + (j - 1) * SN_IFMA_LANES, x);
+
+            a = aj;
+            m = mj;
+        }
+
+        x = _mm512_madd52hi_epu64(zero, a, b);
+        x = _mm512_madd52hi_epu64(x, q, m);
+        _mm512_storeu_si512(t + (k - 1) * SN_IFMA_LANES, x);
+        _mm512_storeu_si512(t, _mm512_add_epi64(_mm512_loadu_si512(t), carry));
+    }
+
+    __m512i carry = zero;
+    for (size_t j = 0; j < k; ++j) {
+        const __m512i x = _mm512_add_epi64(_mm512_loadu_si512(t + j * SN_IFMA_LANES), carry);
+        _mm512_storeu_si512(rp + j * SN_IFMA_LANES, _mm512_and_si512(x, mask));
+        carry = _mm512_srli_epi64(x, SN_IFMA_BITS);
+    }
+}
+
+/**
+ * Copy entry `idx[j]` of the `entries` entry table at `table` into lane `j` of
+ * the `k` limb vectors at `rp`. Every entry is read, so the memory accesses do
+ * not depend on the indices.
+ */
+__attribute__((target("avx512f")))
+static void sn_ifma_select__(uint64_t *rp, const uint64_t *table, size_t entries,
+        const uint64_t *idx, size_t k) {
+    const __m512i index = _mm512_loadu_si512(idx);
+
+    for (size_t i = 0; i < k; ++i) {
+        __m512i v = _mm512_setzero_si512();
+        for (size_t e = 0; e < entries; ++e) {
+            const __mmask8 hit = _mm512_cmpeq_epi64_mask(index, _mm512_set1_epi64((long long)e));
+            v = _mm512_mask_mov_epi64(v, hit,
+                    _mm512_loadu_si512(table + (e * k + i) * SN_IFMA_LANES));
+        }
+        _mm512_storeu_si512(rp + i * SN_IFMA_LANES, v);
+    }
+}
+
+/** Split the `n` blocks at `src` into the `k` limbs of lane `lane` at `dst` */
+static void sn_ifma_load__(uint64_t *dst, size_t lane, const sn_word *src, size_t n,
+        size_t k) {
+    for (size_t i = 0; i < k; ++i) {
+        const size_t bit = i * SN_IFMA_BITS, w = bit / 64, off = bit % 64;
+        uint64_t v = 0;
+
+        if (w < n) {
+            v = src[w] >> off;
+            if (off > 64 - SN_IFMA_BITS && w + 1 < n) {
+                v |= src[w + 1] << (64 - off);
+            }
+        }
+        dst[i * SN_IFMA_LANES + lane] = v & SN_IFMA_MASK;
+    }
+}
+
+/** Join the `k` normalized limbs of lane `lane` at `src` into `n` blocks at `dst` */
+static void sn_ifma_store__(sn_word *dst, size_t n, const uint64_t *src, size_t lane,
+        size_t k) {
+    memset(dst, 0, n * sizeof(*dst));
+
+    for (size_t i = 0; i < k; ++i) {
+        const size_t bit = i * SN_IFMA_BITS, w = bit / 64, off = bit % 64;
+        const uint64_t v = src[i * SN_IFMA_LANES + lane];
+
+        if (w < n) {
+            dst[w] |= v << off;
+        }
+        if (off > 64 - SN_IFMA_BITS && w + 1 < n) {
+            dst[w + 1] |= v >> (64 - off);
+        }
+    }
+}
+
+/**
+ * Number of 52-bit limbs for the moduli of `count` contexts in lanes, so that
+ * 4m < R for each of them, or 0 if that is too many.
+ */
+static size_t sn_ifma_limbs__(const sn_mont_ctx * const ctx[], size_t count) {
+    size_t bits = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        const size_t n = ctx[i]->n;
+        bits = max(bits, n * SN_WORD_BITS - sn_clz__(ctx[i]->mod[n - 1]));
+    }
+
+    const size_t k = (bits + 2 + SN_IFMA_BITS - 1) / SN_IFMA_BITS;
+    return k <= SN_IFMA_MAX_LIMBS ? k : 0;
+}
+
+/**
+ * sn_powm() for up to eight items at once, one per lane, with `k` limbs; the
+ * spare lanes repeat the first item. All inputs are read before any result is
+ * stored. Returns false on allocation failure.
+ */
+static bool sn_powm_ifma__(SN * const res[], const SN * const base[], const SN * const exp[],
+        const sn_mont_ctx * const ctx[], size_t count, size_t k) {
+    const size_t entries = (size_t)1 << SN_IFMA_WINDOW, vec = k * SN_IFMA_LANES;
+    /* B^2 = 2^104k, and its remainders or the results in blocks */
+    const size_t un = SN_IFMA_BITS * 2 * k / SN_WORD_BITS + 1;
+    const size_t len = (entries + 5) * vec + 2 * SN_IFMA_LANES + 2 * un;
+
+    sn_word *buf = sn_tmp_alloc__(len);
+    if (!buf) {
+        return false;
+    }
+
+    uint64_t *table = buf, *mods = table + entries * vec, *rr = mods + vec, *acc = rr + vec,
+             *sel = acc + vec, *t = sel + vec, *minv = t + vec, *idx = minv + SN_IFMA_LANES;
+    sn_word *u = idx + SN_IFMA_LANES, *q = u + un;
+    size_t ebits = 0;
+    bool ok = true;
+    SN tmp;
+
+    sn_init(&tmp);
+    for (size_t lane = 0; lane < SN_IFMA_LANES; ++lane) {
+        const size_t j = lane < count ? lane : 0;
+        const sn_mont_ctx *c = ctx[j];
+        SN m = { .blocks = c->mod, .size = c->n, .neg = false };
+
+        sn_ifma_load__(mods, lane, c->mod, c->n, k);
+        minv[lane] = c->minv & SN_IFMA_MASK;
+        ebits = max(ebits, sn_num_bits(exp[j]));
+
+        /* R^2 mod m, with the remainder stored over u */
+        memset(u, 0, un * sizeof(*u));
+        u[un - 1] = (sn_word)1 << (SN_IFMA_BITS * 2 * k % SN_WORD_BITS);
+        if (!sn_divrem__(q, u, u, un, c->mod, c->n) || !sn_mod(&tmp, base[j], &m)) {
+            ok = false;
+            break;
+        }
+        sn_ifma_load__(rr, lane, u, c->n, k);
+        sn_ifma_load__(sel, lane, tmp.blocks, tmp.size, k);
+    }
+    sn_release(&tmp);
+
+    if (!ok) {
+        sn_tmp_free__(buf, len);
+        return false;
+    }
+
+    /* acc = 1, table[e] = b^e R */
+    memset(acc, 0, vec * sizeof(*acc));
+    for (size_t lane = 0; lane < SN_IFMA_LANES; ++lane) {
+        acc[lane] = 1;
+    }
+    sn_ifma_mont_mul__(table, rr, acc, mods, minv, k, t);
+    sn_ifma_mont_mul__(table + vec, sel, rr, mods, minv, k, t);
+    for (size_t e = 2; e < entries; ++e) {
+        sn_ifma_mont_mul__(table + e * vec, table + (e - 1) * vec, table + vec, mods, minv,
+                k, t);
+    }
+
+    /* Fixed windows from the top, with leading zero windows multiplying by 1 */
+    const size_t windows = (ebits + SN_IFMA_WINDOW - 1) / SN_IFMA_WINDOW;
+    memcpy(acc, table, vec * sizeof(*acc));
+    for (size_t win = windows; win-- > 0;) {
+        for (size_t lane = 0; lane < SN_IFMA_LANES; ++lane) {
+            const SN *e = exp[lane < count ? lane : 0];
+            const size_t en = e->size * SN_WORD_BITS;
+
+            idx[lane] = 0;
+            for (size_t b = SN_IFMA_WINDOW; b-- > 0;) {
+                const size_t bit = win * SN_IFMA_WINDOW + b;
+                idx[lane] = idx[lane] << 1 | (bit < en ? sn_bit__(e->blocks, bit) : 0);
+            }
+        }
+
+        if (win + 1 == windows) {
+            sn_ifma_select__(acc, table, entries, idx, k);
+            continue;
+        }
+        for (unsigned s = 0; s < SN_IFMA_WINDOW; ++s) {
+            sn_ifma_mont_mul__(acc, acc, acc, mods, minv, k, t);
+        }
+        sn_ifma_select__(sel, table, entries, idx, k);
+        sn_ifma_mont_mul__(acc, acc, sel, mods, minv, k, t);
+    }
+
+    /* Out of Montgomery form, which leaves each lane in [0, m] */
+    memset(sel, 0, vec * sizeof(*sel));
+    for (size_t lane = 0; lane < SN_IFMA_LANES; ++lane) {
+        sel[lane] = 1;
+    }
+    sn_ifma_mont_mul__(acc, acc, sel, mods, minv, k, t);
+
+    for (size_t lane = 0; lane < count; ++lane) {
+        const sn_mont_ctx *c = ctx[lane];
+
+        sn_ifma_store__(u, c->n, acc, lane, k);
+        if (sn_cmp__(u, c->n, c->mod, c->n) >= 0) {
+            sn_sub_n__(u, u, c->mod, c->n);
+        }
+        if (!sn_set_blocks__(res[lane], u, c->n, false)) {
+            ok = false;
+        }
+    }
+
+    sn_tmp_free__(buf, len);
+    return ok;
+}
+
+#endif // SN_X86_64_KERNELS
+
+/* **********************************************************************************
+ * Barrett reduction
+ *
+ * With an `n` block modulus m and the cached reciprocal mu = floor(B^2n / m),
+ * the quotient of any x < B^2n by m is estimated from the top blocks of x mu
+ * to within two, so a reduction costs two multiplications and at most two
+ * subtractions. Unlike Montgomery arithmetic this works for even moduli.
+ */
+
+/** Precomputed reciprocal of a fixed modulus */
+struct sn_barrett_ctx {
+    sn_word *mod; /**< The modulus, `n` blocks with a nonzero top block */
+    sn_word *mu;  /**< floor(B^2n / m), `mun` blocks */
+    size_t   n;   /**< Number of blocks of the modulus */
+    size_t   mun; /**< Number of blocks of the reciprocal, n + 1 or n + 2 */
+};
+
+/** Number of blocks behind `mod` in a context for an `n` block modulus */
+static inline size_t sn_barrett_ctx_size__(size_t n) {
+    return n + (n + 2) + (2 * n + 1) + n;
+}
+
+/** Number of scratch blocks needed by sn_barrett_reduce__() */
+static size_t sn_barrett_scratch__(const sn_barrett_ctx *ctx) {
+    const size_t n = ctx->n, mun = ctx->mun;
+
+    return (n + 1) + (mun + n + 1) + (mun + n) + (n + 1)
+         + max(sn_mul_scratch__(mun, n + 1), sn_mul_scratch__(mun, n));
+}
+
+/**
+ * Reduce the `xn` <= 2n blocks at `xp` modulo m and store the `n` block
+ * remainder at `rp`.
+ */
+static void sn_barrett_reduce__(sn_word *rp, const sn_word *xp, size_t xn,
+        const sn_barrett_ctx *ctx, sn_word *scratch) {
+    const size_t n = ctx->n, mun = ctx->mun;
+
+    assert(xn <= 2 * n);
+
+    if (sn_cmp__(xp, xn, ctx->mod, n) < 0) {
+        memcpy(rp, xp, min(xn, n) * sizeof(*rp));
+        memset(rp + min(xn, n), 0, (n - min(xn, n)) * sizeof(*rp));
+        return;
+    }
+
+    sn_word *q1 = scratch, *q2 = q1 + n + 1, *prod = q2 + mun + n + 1;
+    sn_word *r = prod + mun + n, *tmp = r + n + 1;
+
+    /* q3 = floor(floor(x / B^(n - 1)) mu / B^(n + 1)), which is at most two
+     * less than the quotient. The operands are padded to fixed sizes so that
+     * the scratch size does not depend on x. */
+    memcpy(q1, xp + n - 1, (xn - n + 1) * sizeof(*q1));
+    memset(q1 + xn - n + 1, 0, (2 * n - xn) * sizeof(*q1));
+    sn_mul_internal__(q2, ctx->mu, mun, q1, n + 1, tmp);
+
+    /* r = x - q3 m mod B^(n + 1), which lies in [0, 3m) */
+    sn_mul_internal__(prod, q2 + n + 1, mun, ctx->mod, n, tmp);
+    memcpy(r, xp, min(xn, n + 1) * sizeof(*r));
+    memset(r + min(xn, n + 1), 0, (n + 1 - min(xn, n + 1)) * sizeof(*r));
+    sn_sub_n__(r, r, prod, n + 1);
+
+    while (sn_cmp__(r, n + 1, ctx->mod, n) >= 0) {
+        sn_sub__(r, r, n + 1, ctx->mod, n);
+    }
+    memcpy(rp, r, n * sizeof(*rp));
+}
+
+/* **********************************************************************************
+ * Basic arithmetic operations
+ */
+/* addition
+ * --------
+ *  a +  b =   a + b
+ * -a +  b =   b - a  ↓
+ *  a + -b =   a - b  ↓
+ * -a + -b = -(a + b)
+ *
+ * subtraction
+ * -----------
+ *  a -  b =   a - b
+ * -a -  b = -(a + b) ↑
+ *  a - -b =   a + b  ↑
+ * -a - -b =   b - a
+ */
+
+/**
+ * Add `a` and `b`. `res` may be the same number as either operand or both, in
+ * which case the sum is computed in place without any temporary.
+ */
+SN *sn_add(SN * const res, const SN *a, const SN *b) {
+    assert(res && a && b && sn_valid__(res) && sn_valid__(a) && sn_valid__(b));
+
+    if (a->neg && !b->neg) {
+        return sn_sub_internal__(res, b, a);
+    } else if (!a->neg && b->neg) {
+        return sn_sub_internal__(res, a, b);
+    }
+
+    assert(a->neg == b->neg);
+
+    return sn_add_internal__(res, a, b, a->neg);
+}
+
+/**
+ * Subtract `b` from `a`. Like sn_add(), this works in place when `res` is the
+ * same number as either operand.
+ */
+SN *sn_sub(SN * const res, const SN *a, const SN *b) {
+    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
+
+    if (a->neg && !b->neg) {
+        return sn_add_internal__(res, a, b, true);
+    } else if (!a->neg && b->neg) {
+        return sn_add_internal__(res, a, b, false);
+    }
+
+    assert(a->neg == b->neg);
+
+    if (a->neg) {
+        return sn_sub_internal__(res, b, a);
+    } else {
+        return sn_sub_internal__(res, a, b);
+    }
+}
+
+/**
+ * Multiply `a` by `b`. `res` may be the same number as either operand; the
+ * product is then formed in scratch space and copied back, so that `res`
+ * keeps its blocks and capacity.
+ */
+SN *sn_mul(SN * const res, const SN *a, const SN *b) {
+    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
+
+    /* The same blocks may carry opposite signs, e.g. in two views of them */
+    if (a->blocks == b->blocks && a->size == b->size) {
+        SN *ret = sn_sqr(res, a);
+        if (ret && a->neg != b->neg) {
+            ret->neg = !sn_is_zero(ret);
+        }
+        return ret;
+    }
+
+    if (a->size < b->size) {
+        const SN *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    const size_t an = a->size, bn = b->size;
+    const bool in_place = res->blocks == a->blocks || res->blocks == b->blocks;
+    const bool neg = a->neg ^ b->neg;
+    const size_t len = (in_place ? an + bn : 0) + sn_mul_scratch__(an, bn);
+    sn_word *scratch = NULL, *rp;
+
+    if (!in_place && !sn_resize__(res, an + bn)) {
+        return NULL;
+    }
+    if (len) {
+        scratch = sn_tmp_alloc__(len);
+        if (!scratch) {
+            return NULL;
+        }
+    }
+
+    SN *ret = res;
+    if (in_place) {
+        rp = scratch;
+        sn_mul_internal__(rp, a->blocks, an, b->blocks, bn, scratch + an + bn);
+        ret = sn_set_blocks__(res, rp, an + bn, neg);
+    } else {
+        sn_mul_internal__(res->blocks, a->blocks, an, b->blocks, bn, scratch);
+        res->neg = neg;
+        sn_normalize__(res);
+    }
+    sn_tmp_free__(scratch, len);
+
+    return ret;
+}
+
+/**
+ * Square `a`. Like sn_mul(), this works in place when `res` is `a`.
+ */
+SN *sn_sqr(SN * const res, const SN *a) {
+    assert(res && a && sn_valid__(a));
+
+    const size_t n = a->size;
+    const bool in_place = res->blocks == a->blocks;
+    const size_t len = (in_place ? 2 * n : 0) + sn_sqr_scratch__(n);
+    sn_word *scratch = NULL;
+
+    if (!in_place && !sn_resize__(res, 2 * n)) {
+        return NULL;
+    }
+    if (len) {
+        scratch = sn_tmp_alloc__(len);
+        if (!scratch) {
+            return NULL;
+        }
+    }
+
+    SN *ret = res;
+    if (in_place) {
+        sn_sqr_n__(scratch, a->blocks, n, scratch + 2 * n);
+        ret = sn_set_blocks__(res, scratch, 2 * n, false);
+    } else {
+        sn_sqr_n__(res->blocks, a->blocks, n, scratch);
+        res->neg = false;
+        sn_normalize__(res);
+    }
+    sn_tmp_free__(scratch, len);
+
+    return ret;
+}
+
+SN *sn_add_inplace(SN * const a, const SN *b) {
+    return sn_add(a, a, b);
+}
+
+SN *sn_sub_inplace(SN * const a, const SN *b) {
+    return sn_sub(a, a, b);
+}
+
+SN *sn_mul_inplace(SN * const a, const SN *b) {
+    return sn_mul(a, a, b);
+}
+
+/**
+ * Divide `a` by `b`, truncating towards zero as C does: `q` receives the
+ * quotient and `r` the remainder a - q b, which has the sign of `a`. Either
+ * of `q` and `r` may be NULL, and either may be the same number as `a` or
+ * `b`. Returns `q`, or `r` if `q` is NULL, and NULL when `b` is zero or on
+ * allocation failure.
+ */
+SN *sn_divmod(SN * const q, SN * const r, const SN *a, const SN *b) {
+    assert(a && b && sn_valid__(a) && sn_valid__(b));
+    assert(!q || q != r);
+
+    return sn_divmod_internal__(q, r, a, b, false);
+}
+
+/**
+ * Truncated quotient of `a` and `b`, see sn_divmod().
+ */
+SN *sn_div(SN * const q, const SN *a, const SN *b) {
+    assert(q && a && b && sn_valid__(a) && sn_valid__(b));
+
+    return sn_divmod_internal__(q, NULL, a, b, false);
+}
+
+/**
+ * Reduce `a` modulo `b`. Unlike the remainder of sn_divmod(), the result is
+ * never negative: it lies in [0, |b|) whatever the signs of `a` and `b`.
+ */
+SN *sn_mod(SN * const r, const SN *a, const SN *b) {
+    assert(r && a && b && sn_valid__(a) && sn_valid__(b));
+
+    return sn_divmod_internal__(NULL, r, a, b, true);
+}
+
+/**
+ * Add the magnitudes of `a` and `b`. Every block of the sum only depends on
+ * the blocks of the operands at the same position, so `res` may be either of
+ * them. Their sizes are read before `res` is resized, which may change them.
+ */
+static SN *sn_add_internal__(SN * const res, const SN *a, const SN *b, bool negative) {
+    if (a->size < b->size) {
+        const SN *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    const size_t an = a->size, bn = b->size;
+
+    /* Make room for a carry out of the top block up front */
+    if (!sn_resize__(res, an + 1)) {
+        return NULL;
+    }
+
+    res->blocks[an] = sn_add__(res->blocks, a->blocks, an, b->blocks, bn);
+    res->neg = negative;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Subtract the magnitude of `b` from the magnitude of `a`. The smaller
+ * magnitude is subtracted from the larger one, and the sign flag is set if
+ * that was |a|. As with sn_add_internal__(), `res` may be either operand.
+ */
+static SN *sn_sub_internal__(SN * const res, const SN *a, const SN *b) {
+    size_t an = a->size, bn = b->size;
+    const bool negative = sn_cmp__(a->blocks, an, b->blocks, bn) < 0;
+
+    if (negative) {
+        const SN *tmp = a;
+        a  = b;
+        b  = tmp;
+        an = a->size;
+        bn = b->size;
+    }
+
+    /* Only leading zero blocks of the smaller magnitude can stick out */
+    bn = min(an, bn);
+
+    if (!sn_resize__(res, an)) {
+        return NULL;
+    }
+
+    sn_sub__(res->blocks, a->blocks, an, b->blocks, bn);
+    res->neg = negative;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Division with remainder. The quotient and remainder are computed into a
+ * temporary array and only then stored, so `q` and `r` may alias the operands.
+ * With `euclidean` set, a negative remainder is moved into [0, |b|) and the
+ * magnitude of the quotient grows by one to match.
+ */
+static SN *sn_divmod_internal__(SN * const q, SN * const r, const SN *a, const SN *b,
+        bool euclidean) {
+    size_t an = a->size, bn = b->size;
+    while (an > 1 && a->blocks[an - 1] == 0) {
+        --an;
+    }
+    while (bn > 1 && b->blocks[bn - 1] == 0) {
+        --bn;
+    }
+
+    if (bn == 1 && b->blocks[0] == 0) {
+        return NULL;
+    }
+
+    /* One spare quotient block for the Euclidean adjustment */
+    const size_t qn = an >= bn ? an - bn + 1 : 0;
+    sn_word *qp = sn_tmp_alloc__(qn + 1 + bn), *rp = qp + qn + 1;
+    if (!qp) {
+        return NULL;
+    }
+
+    qp[qn] = 0;
+    if (an < bn) {
+        memcpy(rp, a->blocks, an * sizeof(*rp));
+        memset(rp + an, 0, (bn - an) * sizeof(*rp));
+    } else if (!sn_divrem__(qp, rp, a->blocks, an, b->blocks, bn)) {
+        sn_tmp_free__(qp, qn + 1 + bn);
+        return NULL;
+    }
+
+    bool r_neg = a->neg;
+    if (euclidean && r_neg && sn_cmp__(rp, bn, NULL, 0) != 0) {
+        sn_sub_n__(rp, b->blocks, rp, bn);
+        sn_add_1__(qp, qp, qn + 1, 1);
+        r_neg = false;
+    }
+
+    SN *ret = q ? q : r;
+    if ((q && !sn_set_blocks__(q, qp, qn + 1, a->neg ^ b->neg))
+            || (r && !sn_set_blocks__(r, rp, bn, r_neg))) {
+        ret = NULL;
+    }
+
+    sn_tmp_free__(qp, qn + 1 + bn);
+    return ret;
+}
+
+/* **********************************************************************************
+ * Shifts and bitwise operations
+ *
+ * Negative numbers are stored as sign and magnitude, but behave as their
+ * two's complement with infinitely many sign bits. The complement of a
+ * negative x is ~(|x| - 1), which is formed a block at a time from the bottom
+ * up with a borrow; a negative result is turned back into its magnitude
+ * ~r + 1 with a carry in the same pass.
+ */
+
+/**
+ * Multiply `a` by 2^`bits`. Whole blocks are moved with the bit shift, which
+ * works from the top down, so `res` may be `a`.
+ */
+SN *sn_shl(SN * const res, const SN *a, size_t bits) {
+    assert(res && a && sn_valid__(a));
+
+    const size_t skip = bits / SN_WORD_BITS, n = a->size;
+    const unsigned cnt = bits % SN_WORD_BITS;
+    const bool neg = a->neg;
+
+    if (sn_is_zero(a)) {
+        sn_zero(res);
+        return res;
+    }
+
+    if (!sn_resize__(res, skip + n + 1)) {
+        return NULL;
+    }
+
+    sn_word *rp = res->blocks;
+    const sn_word *ap = a->blocks;
+    if (cnt) {
+        rp[skip + n] = sn_lshift__(rp + skip, ap, n, cnt);
+    } else {
+        memmove(rp + skip, ap, n * sizeof(*rp));
+        rp[skip + n] = 0;
+    }
+    memset(rp, 0, skip * sizeof(*rp));
+    res->neg = neg;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Divide `a` by 2^`bits`, rounding towards minus infinity like an arithmetic
+ * shift, i.e. a negative quotient is rounded away from zero if any of the
+ * bits shifted out is set. `res` may be `a`.
+ */
+SN *sn_shr(SN * const res, const SN *a, size_t bits) {
+    assert(res && a && sn_valid__(a));
+
+    const size_t skip = bits / SN_WORD_BITS, n = a->size;
+    const unsigned cnt = bits % SN_WORD_BITS;
+    const bool neg = a->neg;
+
+    /* A nonzero magnitude always loses a bit when all of its blocks go */
+    if (skip >= n) {
+        if (neg) {
+            sn_one(res);
+            res->neg = true;
+        } else {
+            sn_zero(res);
+        }
+        return res;
+    }
+
+    bool inexact = neg && sn_cmp__(a->blocks, skip, NULL, 0) != 0;
+    const size_t m = n - skip;
+    if (!sn_resize__(res, m + neg)) {
+        return NULL;
+    }
+
+    sn_word *rp = res->blocks;
+    const sn_word *ap = a->blocks + skip;
+    if (cnt) {
+        inexact |= sn_rshift__(rp, ap, m, cnt) != 0;
+    } else {
+        memmove(rp, ap, m * sizeof(*rp));
+    }
+    if (neg) {
+        rp[m] = sn_add_1__(rp, rp, m, inexact);
+    }
+    res->neg = neg;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Combine the two's complements x and y of `a` and `b` into
+ * (x & y & `mand`) ^ ((x ^ y) & `mxor`), which is x & y, x ^ y or x | y for
+ * the masks (~0, 0), (0, ~0) and (~0, ~0). Every block of the result only
+ * depends on the blocks of the operands at the same position, so `res` may be
+ * either of them.
+ */
+static SN *sn_bitwise__(SN * const res, const SN *a, const SN *b, sn_word mand, sn_word mxor) {
+    if (a->size < b->size) {
+        const SN *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    const size_t an = a->size, bn = b->size;
+    const sn_word sa = -(sn_word)a->neg, sb = -(sn_word)b->neg;
+    const sn_word sr = (sa & sb & mand) ^ ((sa ^ sb) & mxor);
+    /* The blocks of x & y above a nonnegative y are all zero */
+    const size_t n = mand && !mxor && !sb ? bn : an;
+
+    if (!sn_resize__(res, n + 1)) {
+        return NULL;
+    }
+
+    sn_word *rp = res->blocks;
+    const sn_word *ap = a->blocks, *bp = b->blocks;
+    if (!sa && !sb) {
+        for (size_t i = 0; i < min(n, bn); ++i) {
+            rp[i] = (ap[i] & bp[i] & mand) ^ ((ap[i] ^ bp[i]) & mxor);
+        }
+        if (rp != ap && n > bn) {
+            memcpy(rp + bn, ap + bn, (n - bn) * sizeof(*rp));
+        }
+        rp[n] = 0;
+    } else {
+        sn_word borrow_a = sa & 1, borrow_b = sb & 1, carry = sr & 1;
+        for (size_t i = 0; i < n; ++i) {
+            const sn_word u = ap[i], v = i < bn ? bp[i] : 0;
+            const sn_word x = (u - borrow_a) ^ sa, y = (v - borrow_b) ^ sb;
+            borrow_a = u < borrow_a;
+            borrow_b = v < borrow_b;
+            rp[i] = (((x & y & mand) ^ ((x ^ y) & mxor)) ^ sr) + carry;
+            carry = rp[i] < carry;
+        }
+        rp[n] = carry;
+    }
+    res->neg = sr != 0;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Bitwise AND of `a` and `b`. `res` may be the same number as either operand.
+ */
+SN *sn_and(SN * const res, const SN *a, const SN *b) {
+    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
+
+    return sn_bitwise__(res, a, b, SN_WORD_MAX, 0);
+}
+
+/**
+ * Bitwise OR of `a` and `b`. `res` may be the same number as either operand.
+ */
+SN *sn_or(SN * const res, const SN *a, const SN *b) {
+    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
+
+    return sn_bitwise__(res, a, b, SN_WORD_MAX, SN_WORD_MAX);
+}
+
+/**
+ * Bitwise exclusive OR of `a` and `b`. `res` may be the same number as either
+ * operand.
+ */
+SN *sn_xor(SN * const res, const SN *a, const SN *b) {
+    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
+
+    return sn_bitwise__(res, a, b, 0, SN_WORD_MAX);
+}
+
+/**
+ * Bitwise complement of `a`, which is -`a` - 1. `res` may be `a`.
+ */
+SN *sn_not(SN * const res, const SN *a) {
+    assert(res && a && sn_valid__(a));
+
+    const size_t n = a->size;
+    const bool neg = !a->neg;
+
+    if (!sn_resize__(res, n + 1)) {
+        return NULL;
+    }
+
+    sn_word *rp = res->blocks;
+    const sn_word *ap = a->blocks;
+    if (neg) {
+        rp[n] = sn_add_1__(rp, ap, n, 1);
+    } else {
+        sn_sub_1__(rp, ap, n, 1);
+        rp[n] = 0;
+    }
+    res->neg = neg;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Bit `bit` of the two's complement of `num`. Below the lowest set bit of the
+ * magnitude that of a negative number has zeros, at it a one, and above it
+ * the inverted bits of the magnitude.
+ */
+bool sn_testbit(const SN *num, size_t bit) {
+    assert(num && sn_valid__(num));
+
+    const size_t k = bit / SN_WORD_BITS, n = num->size;
+    const sn_word mask = (sn_word)1 << (bit % SN_WORD_BITS);
+    const bool set = k < n && (num->blocks[k] & mask);
+
+    if (!num->neg) {
+        return set;
+    }
+
+    /* A negative magnitude has a set bit below block n */
+    const bool below = sn_cmp__(num->blocks, min(k, n), NULL, 0) != 0
+        || (k < n && (num->blocks[k] & (mask - 1)));
+    return set != below;
+}
+
+/**
+ * Add 2^`bit` to the magnitude of `num`, or subtract it if `sub`, in which case
+ * the magnitude must have that bit set or be larger than it.
+ */
+static SN *sn_add_pow2__(SN * const num, size_t bit, bool sub) {
+    const size_t k = bit / SN_WORD_BITS, n = num->size;
+    const sn_word b = (sn_word)1 << (bit % SN_WORD_BITS);
+    const size_t m = sub ? n : max(n, k + 1) + 1;
+
+    assert(!sub || k < n);
+
+    if (!sn_resize__(num, m)) {
+        return NULL;
+    }
+
+    sn_word *rp = num->blocks;
+    if (sub) {
+        sn_sub_1__(rp + k, rp + k, n - k, b);
+    } else {
+        memset(rp + n, 0, (m - n) * sizeof(*rp));
+        rp[m - 1] = sn_add_1__(rp + k, rp + k, m - 1 - k, b);
+    }
+    sn_normalize__(num);
+
+    return num;
+}
+
+/**
+ * Set bit `bit` of the two's complement of `num`, which adds 2^`bit` to it if
+ * the bit was clear.
+ */
+SN *sn_setbit(SN * const num, size_t bit) {
+    assert(num && sn_valid__(num));
+
+    if (sn_testbit(num, bit)) {
+        return num;
+    }
+
+    return sn_add_pow2__(num, bit, num->neg);
+}
+
+/**
+ * Clear bit `bit` of the two's complement of `num`, which subtracts 2^`bit`
+ * from it if the bit was set.
+ */
+SN *sn_clrbit(SN * const num, size_t bit) {
+    assert(num && sn_valid__(num));
+
+    if (!sn_testbit(num, bit)) {
+        return num;
+    }
+
+    return sn_add_pow2__(num, bit, !num->neg);
+}
+
+/**
+ * Number of set bits in `num`, or SIZE_MAX for a negative number, whose two's
+ * complement has infinitely many.
+ */
+size_t sn_popcount(const SN *num) {
+    assert(num && sn_valid__(num));
+
+    if (num->neg) {
+        return SIZE_MAX;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < num->size; ++i) {
+        count += sn_popcount__(num->blocks[i]);
+    }
+
+    return count;
+}
+
+/* **********************************************************************************
+ * Roots
+ *
+ * Newton's method doubles the number of correct bits of a root with every
+ * step, so the root is built up from a double precision estimate of its top
+ * bits while the precision of the operand it is computed from doubles as
+ * well. Each step costs about half as much as the next one, and all of them
+ * together about as much as a few full-size multiplications and a division.
+ */
+
+/** Roots of at most this many bits are estimated in double precision */
+#define SN_ROOT_FLOAT_BITS 25
+
+/**
+ * Approximate the magnitude of `num` by d 2^`exp`, with d formed from its top
+ * 64 / W + 1 blocks, which makes it exact for numbers of up to 53 bits.
+ */
+static double sn_to_double__(const SN *num, size_t *exp) {
+    const size_t k = min(num->size, 64 / SN_WORD_BITS + 1);
+    double d = 0;
+
+    for (size_t i = num->size; i-- > num->size - k;) {
+        d = ldexp(d, SN_WORD_BITS) + (double)num->blocks[i];
+    }
+    *exp = (num->size - k) * SN_WORD_BITS;
+
+    return d;
+}
+
+/**
+ * Store the floor of the square root of `a` > 0 in `x` and its square in
+ * `sq`, with one scratch number `t`. For c = floor((bits(a) - 1) / 2), x holds
+ * the root of a / 2^(2(c - d)) to within one, starting from a small d, and
+ * each step with d' = floor(c / 2^s) for the next s,
+ *
+ *     x' = 2^(d' - d - 1) x + floor(a / 2^(2c - d - d' + 1)) / x,
+ *
+ * is a Newton step for the root of a / 2^(2(c - d')) that keeps it so, which
+ * leaves x the root or one above it for d = c.
+ */
+static bool sn_sqrt__(SN * const x, SN * const sq, const SN *a, SN * const t) {
+    const size_t c = (sn_num_bits(a) - 1) / 2;
+    unsigned s = 0;
+    size_t exp;
+
+    while ((c >> s) > SN_ROOT_FLOAT_BITS) {
+        ++s;
+    }
+    size_t d = c >> s;
+
+    /* a / 2^(2(c - d)) has at most 2d + 2 <= 52 bits, which a double holds
+     * exactly, and its square root is correctly rounded */
+    if (!sn_shr(t, a, 2 * (c - d))) {
+        return false;
+    }
+    const sn_word w = (sn_word)sqrt(sn_to_double__(t, &exp));
+    bool ok = sn_set_blocks__(x, &w, 1, false) != NULL;
+
+    while (ok && s-- > 0) {
+        const size_t e = d;
+        d = c >> s;
+        ok = sn_shr(t, a, 2 * c - e - d + 1) && sn_div(t, t, x) && sn_shl(x, x, d - e - 1)
+            && sn_add(x, x, t);
+    }
+
+    ok = ok && sn_sqr(sq, x);
+    if (ok && sn_cmp(sq, a) > 0) {
+        /* (x - 1)^2 = x^2 - x - (x - 1) */
+        sn_one(t);
+        ok = sn_sub(sq, sq, x) && sn_sub(x, x, t) && sn_sub(sq, sq, x);
+    }
+
+    return ok;
+}
+
+/**
+ * Raise `a` to the power `k` >= 1 into `x`, which must not be `a`.
+ */
+static bool sn_root_pow__(SN * const x, const SN *a, unsigned k) {
+    assert(x != a && k >= 1);
+
+    unsigned bit = SN_WORD_BITS - 1 - sn_clz__(k);
+    bool ok = sn_set_blocks__(x, a->blocks, a->size, a->neg) != NULL;
+
+    while (ok && bit-- > 0) {
+        ok = sn_sqr(x, x) && (!(k >> bit & 1) || sn_mul(x, x, a));
+    }
+
+    return ok;
+}
+
+/**
+ * Store the floor of the `k`-th root of `a` > 0 in `x` for 3 <= k < bits(a),
+ * with two scratch numbers `t`. With 2^(c - 1) <= root < 2^c, short roots
+ * come from a double estimate. Longer ones are built from the root y of
+ * a / 2^(kh), which is the root shifted right by h bits give or take one:
+ * starting at most 2^h above the root, at (y + 1) 2^h, a Newton step lands
+ * within about (k - 1) 2^(2h - c) above it, which h keeps to a few.
+ */
+static bool sn_root__(SN * const x, const SN *a, unsigned k, SN t[2]) {
+    const size_t c = (sn_num_bits(a) - 1) / k + 1;
+    bool ok;
+
+    if (c <= SN_ROOT_FLOAT_BITS) {
+        size_t exp;
+        const double d = sn_to_double__(a, &exp);
+        /* The estimate is off by far less than one */
+        const sn_word w = (sn_word)exp2((log2(d) + (double)exp) / k) + 1;
+        ok = sn_set_blocks__(x, &w, 1, false) != NULL;
+    } else {
+        const size_t kbits = SN_WORD_BITS - sn_clz__(k);
+        const size_t h = c >= kbits + 2 ? (c - kbits) / 2 : 1;
+        const sn_word km1 = k - 1, kw = k;
+        SN top;
+
+        sn_init(&top);
+        ok = sn_shr(&top, a, k * h) && sn_root__(x, &top, k, t);
+        sn_release(&top);
+
+        /* x' = ((k - 1) x + floor(a / x^(k - 1))) / k */
+        sn_one(&t[1]);
+        ok = ok && sn_add(x, x, &t[1]) && sn_shl(x, x, h) && sn_root_pow__(&t[0], x, k - 1)
+            && sn_div(&t[0], a, &t[0]) && sn_set_blocks__(&t[1], &km1, 1, false)
+            && sn_mul(x, x, &t[1]) && sn_add(x, x, &t[0])
+            && sn_set_blocks__(&t[1], &kw, 1, false) && sn_div(x, x, &t[1]);
+    }
+
+    /* Either estimate is at or above the root, and the Newton step keeps it
+     * so by the inequality of arithmetic and geometric means */
+    sn_one(&t[1]);
+    while (ok && (ok = sn_root_pow__(&t[0], x, k)) && sn_cmp(&t[0], a) > 0) {
+        ok = sn_sub(x, x, &t[1]);
+    }
+
+    return ok;
+}
+
+/**
+ * Set `s` to the floor of the square root of `a` and `r` to the remainder
+ * a - s^2. Either of `s` and `r` may be NULL, and either may be the same
+ * number as `a`. Returns `s`, or `r` if `s` is NULL, and NULL when `a` is
+ * negative or on allocation failure.
+ */
+SN *sn_sqrtrem(SN * const s, SN * const r, const SN *a) {
+    assert(a && sn_valid__(a));
+    assert(!s || s != r);
+
+    if (a->neg) {
+        return NULL;
+    }
+
+    SN x, sq, t;
+    sn_init(&x);
+    sn_init(&sq);
+    sn_init(&t);
+
+    /* The remainder goes first, as `s` may be `a` */
+    bool ok = sn_is_zero(a) || sn_sqrt__(&x, &sq, a, &t);
+    ok = ok && (!r || sn_sub(r, a, &sq))
+        && (!s || sn_set_blocks__(s, x.blocks, x.size, false));
+
+    sn_release(&x);
+    sn_release(&sq);
+    sn_release(&t);
+    return ok ? (s ? s : r) : NULL;
+}
+
+/**
+ * Floor of the square root of `a`, see sn_sqrtrem().
+ */
+SN *sn_sqrt(SN * const res, const SN *a) {
+    assert(res && a && sn_valid__(a));
+
+    return sn_sqrtrem(res, NULL, a);
+}
+
+/**
+ * Set `res` to the `k`-th root of `a` truncated towards zero, i.e. the
+ * largest x with x^k <= a for nonnegative a, and minus the root of -a for
+ * negative a and odd k. Returns NULL when k is zero, when `a` is negative and
+ * k is even, or on allocation failure. `res` may be `a`.
+ */
+SN *sn_root(SN * const res, const SN *a, unsigned k) {
+    assert(res && a && sn_valid__(a));
+
+    const bool neg = a->neg;
+
+    if (k == 0 || (neg && k % 2 == 0)) {
+        return NULL;
+    }
+    if (k == 1 || sn_is_zero(a)) {
+        return sn_set_blocks__(res, a->blocks, a->size, neg);
+    }
+    if (k == 2) {
+        return sn_sqrtrem(res, NULL, a);
+    }
+
+    SN mag, x, t[2];
+    sn_view(&mag, a->blocks, a->size);
+    sn_init(&x);
+    sn_init(&t[0]);
+    sn_init(&t[1]);
+
+    /* Roots of numbers below 2^k are one */
+    bool ok = true;
+    if (k >= sn_num_bits(a)) {
+        sn_one(&x);
+    } else {
+        ok = sn_root__(&x, &mag, k, t);
+    }
+    SN *ret = ok ? sn_set_blocks__(res, x.blocks, x.size, neg) : NULL;
+
+    sn_release(&x);
+    sn_release(&t[0]);
+    sn_release(&t[1]);
+    return ret;
+}
+
+/* **********************************************************************************
+ * Modular arithmetic
+ */
+
+/**
+ * Precompute the Montgomery constants for the odd modulus |`mod`|. Returns
+ * NULL if the modulus is even or on allocation failure. The context is never
+ * modified afterwards and can be shared between threads.
+ */
+sn_mont_ctx *sn_mont_ctx_new(const SN *mod) {
+    assert(mod && sn_valid__(mod));
+
+    size_t n = mod->size;
+    while (n > 1 && mod->blocks[n - 1] == 0) {
+        --n;
+    }
+
+    if (!(mod->blocks[0] & 1)) {
+        return NULL;
+    }
+
+    sn_mont_ctx *ctx = sn_mem_alloc__(sizeof(*ctx));
+    if (!ctx) {
+        return NULL;
+    }
+
+    /* The constants, followed by a temporary for B^2n and its quotient */
+    ctx->mod = sn_mem_alloc__(sn_mont_ctx_size__(n) * sizeof(*ctx->mod));
+    if (!ctx->mod) {
+        sn_mem_free__(ctx, sizeof(*ctx));
+        return NULL;
+    }
+
+    ctx->one  = ctx->mod + n;
+    ctx->r2   = ctx->one + n;
+    ctx->n    = n;
+    ctx->minv = sn_mont_minv__(mod->blocks[0]);
+    memcpy(ctx->mod, mod->blocks, n * sizeof(*ctx->mod));
+
+    sn_word *u = ctx->r2 + n, *q = u + 2 * n + 1;
+    memset(u, 0, 2 * n * sizeof(*u));
+    u[2 * n] = 1;
+    if (!sn_divrem__(q, ctx->r2, u, 2 * n + 1, ctx->mod, n)
+            || !sn_divrem__(q, ctx->one, u + n, n + 1, ctx->mod, n)) {
+        sn_mont_ctx_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+void sn_mont_ctx_free(sn_mont_ctx *ctx) {
+    if (ctx) {
+        sn_mem_free__(ctx->mod, sn_mont_ctx_size__(ctx->n) * sizeof(*ctx->mod));
+        sn_mem_free__(ctx, sizeof(*ctx));
+    }
+}
+
+/**
+ * Copy the residue `a` into the `n` blocks at `rp`, padding it with zeros.
+ * Returns false unless 0 <= `a` < m.
+ */
+static bool sn_mont_load__(sn_word *rp, const SN *a, const sn_mont_ctx *ctx) {
+    size_t an = a->size;
+    while (an > 1 && a->blocks[an - 1] == 0) {
+        --an;
+    }
+
+    if ((a->neg && (an > 1 || a->blocks[0]))
+            || sn_cmp__(a->blocks, an, ctx->mod, ctx->n) >= 0) {
+        return false;
+    }
+
+    memcpy(rp, a->blocks, an * sizeof(*rp));
+    memset(rp + an, 0, (ctx->n - an) * sizeof(*rp));
+
+    return true;
+}
+
+/**
+ * Convert `a`, which may be any integer, into Montgomery form a R mod m.
+ */
+SN *sn_mont_to(SN * const res, const SN *a, const sn_mont_ctx *ctx) {
+    assert(res && a && ctx && sn_valid__(a));
+
+    const size_t n = ctx->n;
+    SN m = { .blocks = ctx->mod, .size = n, .neg = false }, t;
+
+    if (!sn_init(&t)) {
+        return NULL;
+    }
+
+    const size_t len = n + sn_mont_scratch__(n);
+    sn_word *buf = sn_tmp_alloc__(len);
+    if (!buf || !sn_mod(&t, a, &m)) {
+        sn_tmp_free__(buf, len);
+        sn_release(&t);
+        return NULL;
+    }
+
+    sn_mont_load__(buf, &t, ctx);
+    sn_mont_mul__(buf, buf, ctx->r2, ctx, buf + n);
+    sn_release(&t);
+
+    SN *ret = sn_set_blocks__(res, buf, n, false);
+    sn_tmp_free__(buf, len);
+
+    return ret;
+}
+
+/**
+ * Convert the residue `a` out of Montgomery form. Returns NULL unless
+ * 0 <= `a` < m.
+ */
+SN *sn_mont_from(SN * const res, const SN *a, const sn_mont_ctx *ctx) {
+    assert(res && a && ctx && sn_valid__(a));
+
+    const size_t n = ctx->n;
+    sn_word *buf = sn_tmp_alloc__(3 * n), *t = buf + n;
+    if (!buf) {
+        return NULL;
+    }
+
+    if (!sn_mont_load__(t, a, ctx)) {
+        sn_tmp_free__(buf, 3 * n);
+        return NULL;
+    }
+    memset(t + n, 0, n * sizeof(*t));
+    sn_mont_redc__(buf, t, ctx);
+
+    SN *ret = sn_set_blocks__(res, buf, n, false);
+    sn_tmp_free__(buf, 3 * n);
+
+    return ret;
+}
+
+/**
+ * Montgomery product a b R^-1 mod m of two residues in Montgomery form. Returns
+ * NULL unless both are in [0, m). `res` may be the same number as either.
+ */
+SN *sn_mont_mul(SN * const res, const SN *a, const SN *b, const sn_mont_ctx *ctx) {
+    assert(res && a && b && ctx && sn_valid__(a) && sn_valid__(b));
+
+    const size_t n = ctx->n;
+    const size_t len = 2 * n + sn_mont_scratch__(n);
+    sn_word *ap = sn_tmp_alloc__(len), *bp = ap + n;
+    if (!ap) {
+        return NULL;
+    }
+
+    SN *ret = NULL;
+    if (sn_mont_load__(ap, a, ctx) && sn_mont_load__(bp, b, ctx)) {
+        sn_mont_mul__(ap, ap, bp, ctx, bp + n);
+        ret = sn_set_blocks__(res, ap, n, false);
+    }
+
+    sn_tmp_free__(ap, len);
+    return ret;
+}
+
+/**
+ * Montgomery square a^2 R^-1 mod m of a residue in Montgomery form, see
+ * sn_mont_mul().
+ */
+SN *sn_mont_sqr(SN * const res, const SN *a, const sn_mont_ctx *ctx) {
+    assert(res && a && ctx && sn_valid__(a));
+
+    const size_t n = ctx->n;
+    const size_t len = n + sn_mont_scratch__(n);
+    sn_word *ap = sn_tmp_alloc__(len);
+    if (!ap) {
+        return NULL;
+    }
+
+    SN *ret = NULL;
+    if (sn_mont_load__(ap, a, ctx)) {
+        sn_mont_sqr__(ap, ap, ctx, ap + n);
+        ret = sn_set_blocks__(res, ap, n, false);
+    }
+
+    sn_tmp_free__(ap, len);
+    return ret;
+}
+
+/**
+ * Modular exponentiation `base`^`exp` mod m for an ordinary (not Montgomery
+ * form) `base` and a nonnegative `exp`. The result lies in [0, m). All
+ * temporaries are allocated up front, so the exponentiation loop itself never
+ * allocates. Returns NULL if `exp` is negative or on allocation failure.
+ */
+SN *sn_powm(SN * const res, const SN *base, const SN *exp, const sn_mont_ctx *ctx) {
+    assert(res && base && exp && ctx && sn_valid__(base) && sn_valid__(exp));
+
+    size_t en = exp->size;
+    while (en > 1 && exp->blocks[en - 1] == 0) {
+        --en;
+    }
+
+    if (exp->neg && (en > 1 || exp->blocks[0])) {
+        return NULL;
+    }
+
+    const size_t n = ctx->n;
+    SN m = { .blocks = ctx->mod, .size = n, .neg = false }, t;
+
+    if (!sn_init(&t)) {
+        return NULL;
+    }
+
+    const size_t len = 4 * n + sn_powm_scratch__(n, en);
+    sn_word *buf = sn_tmp_alloc__(len);
+    if (!buf || !sn_mod(&t, base, &m)) {
+        sn_tmp_free__(buf, len);
+        sn_release(&t);
+        return NULL;
+    }
+
+    sn_word *bp = buf, *rp = bp + n, *tp = rp + n, *scratch = tp + 2 * n;
+
+    if (en == 1 && exp->blocks[0] == 0) {
+        memcpy(rp, ctx->one, n * sizeof(*rp));
+    } else {
+        sn_mont_load__(bp, &t, ctx);
+        sn_mont_mul__(bp, bp, ctx->r2, ctx, scratch);
+        sn_powm__(rp, bp, exp->blocks, en, ctx, scratch);
+    }
+    sn_release(&t);
+
+    memcpy(tp, rp, n * sizeof(*tp));
+    memset(tp + n, 0, n * sizeof(*tp));
+    sn_mont_redc__(rp, tp, ctx);
+
+    SN *ret = sn_set_blocks__(res, rp, n, false);
+    sn_tmp_free__(buf, len);
+
+    return ret;
+}
+
+/**
+ * sn_powm() for `count` independent items: res[i] = base[i]^exp[i] modulo the
+ * modulus of ctx[i], e.g. to verify many signatures under different keys.
+ * Processors with AVX-512 IFMA run eight items at a time in vector lanes,
+ * others run them one after the other. Each result may be the same number as
+ * the inputs of its own item, but not as those of any other. Returns false if
+ * an exponent is negative or on allocation failure.
+ */
+bool sn_powm_batch(SN * const res[], const SN * const base[], const SN * const exp[],
+        const sn_mont_ctx * const ctx[], size_t count) {
+    assert(count == 0 || (res && base && exp && ctx));
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(res[i] && base[i] && exp[i] && ctx[i]);
+        if (exp[i]->neg && !sn_is_zero(exp[i])) {
+            return false;
+        }
+    }
+
+    size_t i = 0;
+#if SN_X86_64_KERNELS
+    while (sn_have_ifma__ && count - i >= SN_IFMA_MIN_LANES) {
+        const size_t lanes = min(count - i, (size_t)SN_IFMA_LANES);
+        const size_t k = sn_ifma_limbs__(ctx + i, lanes);
+
+        if (!k) {
+            break;
+        }
+        if (!sn_powm_ifma__(res + i, base + i, exp + i, ctx + i, lanes, k)) {
+            return false;
+        }
+        i += lanes;
+    }
+#endif // SN_X86_64_KERNELS
+
+    for (; i < count; ++i) {
+        if (!sn_powm(res[i], base[i], exp[i], ctx[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Cache the reciprocal of the nonzero modulus |`mod`|, which may be even.
+ * Returns NULL if the modulus is zero or on allocation failure. The context is
+ * never modified afterwards and can be shared between threads.
+ */
+sn_barrett_ctx *sn_barrett_ctx_new(const SN *mod) {
+    assert(mod && sn_valid__(mod));
+
+    size_t n = mod->size;
+    while (n > 1 && mod->blocks[n - 1] == 0) {
+        --n;
+    }
+
+    if (n == 1 && mod->blocks[0] == 0) {
+        return NULL;
+    }
+
+    sn_barrett_ctx *ctx = sn_mem_alloc__(sizeof(*ctx));
+    if (!ctx) {
+        return NULL;
+    }
+
+    /* The modulus and reciprocal, followed by a temporary for B^2n and the
+     * remainder of its division */
+    ctx->mod = sn_mem_alloc__(sn_barrett_ctx_size__(n) * sizeof(*ctx->mod));
+    if (!ctx->mod) {
+        sn_mem_free__(ctx, sizeof(*ctx));
+        return NULL;
+    }
+
+    ctx->mu = ctx->mod + n;
+    ctx->n  = n;
+    memcpy(ctx->mod, mod->blocks, n * sizeof(*ctx->mod));
+
+    sn_word *u = ctx->mu + n + 2, *rem = u + 2 * n + 1;
+    memset(u, 0, 2 * n * sizeof(*u));
+    u[2 * n] = 1;
+    if (!sn_divrem__(ctx->mu, rem, u, 2 * n + 1, ctx->mod, n)) {
+        sn_barrett_ctx_free(ctx);
+        return NULL;
+    }
+    ctx->mun = ctx->mu[n + 1] ? n + 2 : n + 1;
+
+    return ctx;
+}
+
+void sn_barrett_ctx_free(sn_barrett_ctx *ctx) {
+    if (ctx) {
+        sn_mem_free__(ctx->mod, sn_barrett_ctx_size__(ctx->n) * sizeof(*ctx->mod));
+        sn_mem_free__(ctx, sizeof(*ctx));
+    }
+}
+
+/**
+ * Reduce the magnitude in the `xn` blocks at `xp`, with the sign `neg`, modulo
+ * m into [0, m) and store it in `res`. Magnitudes above B^2n, which Barrett
+ * reduction cannot handle, fall back to a full division.
+ */
+static SN *sn_barrett_store__(SN * const res, const sn_word *xp, size_t xn, bool neg,
+        const sn_barrett_ctx *ctx) {
+    const size_t n = ctx->n;
+
+    while (xn > 1 && xp[xn - 1] == 0) {
+        --xn;
+    }
+
+    const size_t size = xn > 2 * n ? (xn - n + 1) : sn_barrett_scratch__(ctx);
+    sn_word *rp = sn_tmp_alloc__(n + size);
+    if (!rp) {
+        return NULL;
+    }
+
+    if (xn <= 2 * n) {
+        sn_barrett_reduce__(rp, xp, xn, ctx, rp + n);
+    } else if (!sn_divrem__(rp + n, rp, xp, xn, ctx->mod, n)) {
+        sn_tmp_free__(rp, n + size);
+        return NULL;
+    }
+
+    /* -x mod m = m - (x mod m) */
+    if (neg && sn_cmp__(rp, n, NULL, 0) != 0) {
+        sn_sub_n__(rp, ctx->mod, rp, n);
+    }
+
+    SN *ret = sn_set_blocks__(res, rp, n, false);
+    sn_tmp_free__(rp, n + size);
+
+    return ret;
+}
+
+/**
+ * Reduce `a` modulo m into [0, m), like sn_mod(). `a` should be below B^2n for
+ * an `n` block modulus, e.g. a product of two reduced residues; larger values
+ * take a full division.
+ */
+SN *sn_mod_barrett(SN * const res, const SN *a, const sn_barrett_ctx *ctx) {
+    assert(res && a && ctx && sn_valid__(a));
+
+    return sn_barrett_store__(res, a->blocks, a->size, a->neg, ctx);
+}
+
+/**
+ * Modular product a b mod m in [0, m). `res` may be the same number as either
+ * operand.
+ */
+SN *sn_mulmod_barrett(SN * const res, const SN *a, const SN *b, const sn_barrett_ctx *ctx) {
+    assert(res && a && b && ctx && sn_valid__(a) && sn_valid__(b));
+
+    if (a->size < b->size) {
+        const SN *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    const size_t pn = a->size + b->size;
+    const size_t len = pn + sn_mul_scratch__(a->size, b->size);
+    sn_word *pp = sn_tmp_alloc__(len);
+    if (!pp) {
+        return NULL;
+    }
+
+    sn_mul_internal__(pp, a->blocks, a->size, b->blocks, b->size, pp + pn);
+    SN *ret = sn_barrett_store__(res, pp, pn, a->neg ^ b->neg, ctx);
+    sn_tmp_free__(pp, len);
+
+    return ret;
+}
+
+/* **********************************************************************************
+ * Greatest common divisors
+ *
+ * All algorithms work on a pair (a, b) of magnitudes and take steps that
+ * subtract a multiple of the smaller value from the larger one. A sequence of
+ * steps is a matrix M with nonnegative entries and determinant one such that
+ * (a; b) = M (a'; b') for the reduced pair, i.e.
+ *
+ *     a' = m11 a - m01 b,    b' = m00 b - m10 a.
+ *
+ * Matrices are stored as m[0] = m00, m[1] = m01, m[2] = m10, m[3] = m11.
+ * Pairs of a few blocks go through binary GCD. Larger ones take Lehmer steps,
+ * which find up to a block worth of steps at a time from the leading two
+ * blocks, and large ones half-GCD, which finds the steps that halve the size
+ * of a pair recursively from its top half. sn_gcdext() also multiplies the
+ * second row of the identity by every matrix, which yields the cofactor of a.
+ */
+
+/**
+ * Binary GCD of the single blocks `a` and `b`, either of which may be zero.
+ */
+static sn_word sn_gcd_1__(sn_word a, sn_word b) {
+    if (a == 0 || b == 0) {
+        return a | b;
+    }
+
+    const unsigned twos = sn_ctz__(a | b);
+    a >>= sn_ctz__(a);
+    do {
+        b >>= sn_ctz__(b);
+        if (a > b) {
+            const sn_word tmp = a;
+            a = b;
+            b = tmp;
+        }
+        b -= a;
+    } while (b);
+
+    return a << twos;
+}
+
+/**
+ * Binary GCD of the double blocks `a` and `b`, neither of which may be zero,
+ * which drops to single blocks once both fit.
+ */
+static sn_dword sn_gcd_2__(sn_dword a, sn_dword b) {
+    const sn_dword both = a | b;
+    const unsigned twos = (sn_word)both ? sn_ctz__((sn_word)both)
+        : SN_WORD_BITS + sn_ctz__((sn_word)(both >> SN_WORD_BITS));
+
+    a >>= twos;
+    b >>= twos;
+    while ((a | b) >> SN_WORD_BITS) {
+        if (!(sn_word)a) {
+            a >>= SN_WORD_BITS;
+        }
+        a >>= sn_ctz__((sn_word)a);
+        if (!(sn_word)b) {
+            b >>= SN_WORD_BITS;
+        }
+        b >>= sn_ctz__((sn_word)b);
+        if (a > b) {
+            const sn_dword tmp = a;
+            a = b;
+            b = tmp;
+        }
+        b -= a;
+        if (b == 0) {
+            return a << twos;
+        }
+    }
+
+    return (sn_dword)sn_gcd_1__((sn_word)a, (sn_word)b) << twos;
+}
+
+/**
+ * Shift the nonzero `n` block value at `rp` right past its trailing zero bits
+ * and return its normalized size. The number of bits shifted out is stored at
+ * `twos` unless it is NULL.
+ */
+static size_t sn_strip_twos__(sn_word *rp, size_t n, size_t *twos) {
+    size_t skip = 0;
+    while (rp[skip] == 0) {
+        ++skip;
+    }
+
+    const unsigned cnt = sn_ctz__(rp[skip]);
+    n -= skip;
+    if (cnt) {
+        sn_rshift__(rp, rp + skip, n, cnt);
+    } else if (skip) {
+        memmove(rp, rp + skip, n * sizeof(*rp));
+    }
+
+    while (n > 1 && rp[n - 1] == 0) {
+        --n;
+    }
+    if (twos) {
+        *twos = skip * SN_WORD_BITS + cnt;
+    }
+
+    return n;
+}
+
+/**
+ * GCD of the nonzero magnitudes of `a` and `b` by the binary algorithm: strip
+ * the common power of two, then keep subtracting the smaller odd value from
+ * the larger one and stripping the zeros this leaves at the bottom. Each round
+ * clears at least one bit, so this is only meant for a few blocks. `res` may
+ * be either operand.
+ */
+static SN *sn_gcd_binary__(SN * const res, const SN *a, const SN *b) {
+    const size_t n = max(max(a->size, b->size), 2);
+    sn_word *buf = sn_tmp_alloc__(2 * n);
+    if (!buf) {
+        return NULL;
+    }
+
+    sn_word *up = buf, *vp = buf + n;
+    size_t un, vn, ku, kv;
+    memcpy(up, a->blocks, a->size * sizeof(*up));
+    memcpy(vp, b->blocks, b->size * sizeof(*vp));
+    un = sn_strip_twos__(up, a->size, &ku);
+    vn = sn_strip_twos__(vp, b->size, &kv);
+
+    while (un > 2 || vn > 2) {
+        const int c = sn_cmp__(up, un, vp, vn);
+        if (c == 0) {
+            break;
+        }
+        if (c < 0) {
+            sn_word *tp = up;
+            up = vp;
+            vp = tp;
+            const size_t tn = un;
+            un = vn;
+            vn = tn;
+        }
+        sn_sub__(up, up, un, vp, vn);
+        un = sn_strip_twos__(up, un, NULL);
+    }
+    if (un <= 2) {
+        const sn_dword g = sn_gcd_2__(
+                up[0] | (un > 1 ? (sn_dword)up[1] << SN_WORD_BITS : 0),
+                vp[0] | (vn > 1 ? (sn_dword)vp[1] << SN_WORD_BITS : 0));
+        up[0] = (sn_word)g;
+        up[1] = (sn_word)(g >> SN_WORD_BITS);
+        un    = up[1] ? 2 : 1;
+    }
+
+    /* Put the common power of two back */
+    const size_t twos = min(ku, kv), skip = twos / SN_WORD_BITS;
+    const unsigned cnt = twos % SN_WORD_BITS;
+    SN *ret = sn_resize__(res, skip + un + 1);
+    if (ret) {
+        memset(res->blocks, 0, skip * sizeof(*res->blocks));
+        if (cnt) {
+            res->blocks[skip + un] = sn_lshift__(res->blocks + skip, up, un, cnt);
+        } else {
+            memcpy(res->blocks + skip, up, un * sizeof(*up));
+            res->blocks[skip + un] = 0;
+        }
+        res->neg = false;
+        sn_normalize__(res);
+    }
+
+    sn_tmp_free__(buf, 2 * n);
+    return ret;
+}
+
+/** The block of the magnitude of `num` starting at bit `pos` */
+static sn_word sn_gcd_word__(const SN *num, size_t pos) {
+    const size_t j = pos / SN_WORD_BITS;
+    const unsigned shift = pos % SN_WORD_BITS;
+
+    if (j >= num->size) {
+        return 0;
+    }
+
+    sn_word w = num->blocks[j] >> shift;
+    if (shift && j + 1 < num->size) {
+        w |= num->blocks[j + 1] << (SN_WORD_BITS - shift);
+    }
+
+    return w;
+}
+
+/**
+ * Quotient x / y >= 1 of double blocks. Most quotients of a Euclidean sequence
+ * are small, so try subtracting before falling back to a division, and divide
+ * single blocks where the operands fit.
+ */
+static inline sn_dword sn_lehmer_quotient__(sn_dword x, sn_dword y) {
+    sn_dword r = x - y;
+
+    if (r < y) {
+        return 1;
+    }
+    if (r - y < y) {
+        return 2;
+    }
+
+    return x >> SN_WORD_BITS ? x / y : (sn_word)x / (sn_word)y;
+}
+
+/**
+ * Lehmer step: find a single-block matrix `m` of steps for the magnitudes
+ * (a, b) from their leading two blocks x and y alone, i.e. from the values
+ * shifted right by h bits. With the reduced pair (x', y') and the low bits
+ * (x0, y0), a' = 2^h x' + m11 x0 - m01 y0 is above 2^h (x' - max(m01, m11)),
+ * and likewise for b'. Steps are taken while these bounds keep both reduced
+ * values at or above 2^s, so that they never go negative and the entries stay
+ * below the square root of x. Returns false if not even one step is safe.
+ */
+static bool sn_lehmer_matrix__(sn_word m[4], const SN *a, const SN *b, size_t s) {
+    const size_t bits = max(sn_num_bits(a), sn_num_bits(b));
+    const size_t h = bits > 2 * SN_WORD_BITS ? bits - 2 * SN_WORD_BITS : 0;
+
+    if (s >= h + 2 * SN_WORD_BITS) {
+        return false;
+    }
+
+    const sn_dword lim = s > h ? (sn_dword)1 << (s - h) : 1;
+    sn_dword x = sn_gcd_word__(a, h), y = sn_gcd_word__(b, h);
+    x |= (sn_dword)sn_gcd_word__(a, h + SN_WORD_BITS) << SN_WORD_BITS;
+    y |= (sn_dword)sn_gcd_word__(b, h + SN_WORD_BITS) << SN_WORD_BITS;
+    sn_word m00 = 1, m01 = 0, m10 = 0, m11 = 1;
+    bool progress = false;
+
+    if (x <= lim || y <= lim) {
+        return false;
+    }
+
+    /*
+     * The entries never overflow: x = m00 x' + m01 y' holds throughout for
+     * the approximations, so q m00 + m01 <= x / y' before a step on x'.
+     */
+    for (;;) {
+        if (x >= y) {
+            const sn_dword q = sn_lehmer_quotient__(x, y), r = x - q * y;
+            const sn_dword n01 = m01 + q * m00, n11 = m11 + q * m10;
+            if (r < lim || r - lim < max(n01, n11)) {
+                break;
+            }
+            x   = r;
+            m01 = (sn_word)n01;
+            m11 = (sn_word)n11;
+        } else {
+            const sn_dword q = sn_lehmer_quotient__(y, x), r = y - q * x;
+            const sn_dword n00 = m00 + q * m01, n10 = m10 + q * m11;
+            if (r < lim || r - lim < max(n00, n10)) {
+                break;
+            }
+            y   = r;
+            m00 = (sn_word)n00;
+            m10 = (sn_word)n10;
+        }
+        progress = true;
+    }
+
+    m[0] = m00;
+    m[1] = m01;
+    m[2] = m10;
+    m[3] = m11;
+
+    return progress;
+}
+
+/**
+ * Store m11 a - m01 b at `xp` and m00 b - m10 a at `yp` for `n` blocks at `ap`
+ * and `bp`, which the matrix `m` must keep nonnegative. All four products go
+ * through one pass, which reads each block of the operands once.
+ */
+static void sn_gcd_matvec_1__(sn_word *xp, sn_word *yp, const sn_word *ap, const sn_word *bp,
+        size_t n, const sn_word m[4]) {
+    sn_word cx = 0, cy = 0, dx = 0, dy = 0, bx = 0, by = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const sn_dword px = (sn_dword)m[3] * ap[i] + cx, qx = (sn_dword)m[1] * bp[i] + dx;
+        const sn_dword py = (sn_dword)m[0] * bp[i] + cy, qy = (sn_dword)m[2] * ap[i] + dy;
+        const sn_word lx = (sn_word)qx + bx, ly = (sn_word)qy + by;
+
+        /* Subtract the low halves and the borrow, which may wrap the latter */
+        bx = (lx < bx) | ((sn_word)px < lx);
+        by = (ly < by) | ((sn_word)py < ly);
+        xp[i] = (sn_word)px - lx;
+        yp[i] = (sn_word)py - ly;
+        cx = (sn_word)(px >> SN_WORD_BITS);
+        dx = (sn_word)(qx >> SN_WORD_BITS);
+        cy = (sn_word)(py >> SN_WORD_BITS);
+        dy = (sn_word)(qy >> SN_WORD_BITS);
+    }
+
+    assert(cx == dx + bx && cy == dy + by);
+}
+
+/**
+ * Grow `num` to `n` blocks, padding it with leading zero blocks.
+ */
+static bool sn_gcd_extend__(SN * const num, size_t n) {
+    const size_t old = num->size;
+
+    if (n > old) {
+        if (!sn_resize__(num, n)) {
+            return false;
+        }
+        memset(num->blocks + old, 0, (n - old) * sizeof(*num->blocks));
+    }
+
+    return true;
+}
+
+/**
+ * Replace (a; b) by M^-1 (a; b) for the single-block matrix `m`, which must
+ * keep both nonnegative. Neither value grows, since a = m00 a' + m01 b' with
+ * m00 >= 1. `t` holds two scratch numbers.
+ */
+static bool sn_gcd_apply_1__(SN * const a, SN * const b, const sn_word m[4], SN t[2]) {
+    const size_t n = max(a->size, b->size);
+
+    if (!sn_gcd_extend__(a, n) || !sn_gcd_extend__(b, n)
+            || !sn_resize__(&t[0], n) || !sn_resize__(&t[1], n)) {
+        return false;
+    }
+
+    sn_gcd_matvec_1__(t[0].blocks, t[1].blocks, a->blocks, b->blocks, n, m);
+
+    t[0].neg = t[1].neg = false;
+    sn_normalize__(&t[0]);
+    sn_normalize__(&t[1]);
+    sn_swap(a, &t[0]);
+    sn_swap(b, &t[1]);
+
+    return true;
+}
+
+/**
+ * Multiply each of the `rows` rows (u[2i], u[2i + 1]) of a matrix by the
+ * single-block matrix `m` on the right.
+ */
+static bool sn_gcd_rows_1__(SN * const u, size_t rows, const sn_word m[4], SN t[2]) {
+    for (size_t i = 0; i < rows; ++i) {
+        SN * const u0 = &u[2 * i], * const u1 = &u[2 * i + 1];
+        const size_t n = max(u0->size, u1->size);
+
+        if (!sn_gcd_extend__(u0, n) || !sn_gcd_extend__(u1, n)
+                || !sn_resize__(&t[0], n + 2) || !sn_resize__(&t[1], n + 2)) {
+            return false;
+        }
+
+        /* u0' = u0 m00 + u1 m10, u1' = u0 m01 + u1 m11 */
+        for (size_t j = 0; j < 2; ++j) {
+            sn_word *tp = t[j].blocks;
+            const sn_word hi = sn_mul_1__(tp, u0->blocks, n, m[j]);
+            tp[n]     = hi + sn_addmul_1__(tp, u1->blocks, n, m[j + 2]);
+            tp[n + 1] = tp[n] < hi;
+            t[j].neg  = false;
+            sn_normalize__(&t[j]);
+        }
+
+        sn_swap(u0, &t[0]);
+        sn_swap(u1, &t[1]);
+    }
+
+    return true;
+}
+
+/**
+ * Store the low `bits` bits of the magnitude of `a` in `res`.
+ */
+static SN *sn_gcd_low__(SN * const res, const SN *a, size_t bits) {
+    const size_t n = min(a->size, (bits + SN_WORD_BITS - 1) / SN_WORD_BITS);
+
+    if (!sn_set_blocks__(res, a->blocks, n, false)) {
+        return NULL;
+    }
+    if (n == (bits + SN_WORD_BITS - 1) / SN_WORD_BITS && bits % SN_WORD_BITS) {
+        res->blocks[n - 1] &= ((sn_word)1 << (bits % SN_WORD_BITS)) - 1;
+        sn_normalize__(res);
+    }
+
+    return res;
+}
+
+/**
+ * Replace (a; b) by R^-1 (a; b) once a recursive call has reduced the top
+ * bits (a >> p; b >> p) of the pair to (a1; b1) with the matrix `r`. Only the
+ * low p bits are left to multiply: a' = 2^p a1 + r11 a0 - r01 b0 and
+ * b' = 2^p b1 + r00 b0 - r10 a0. `t` holds four scratch numbers.
+ */
+static bool sn_hgcd_lift__(SN * const a, SN * const b, const SN *a1, const SN *b1, size_t p,
+        const SN r[4], SN t[4]) {
+    return sn_gcd_low__(&t[2], a, p) && sn_gcd_low__(&t[3], b, p)
+        && sn_mul(&t[0], &r[3], &t[2]) && sn_mul(&t[1], &r[1], &t[3])
+        && sn_sub(&t[0], &t[0], &t[1]) && sn_shl(a, a1, p) && sn_add(a, a, &t[0])
+        && sn_mul(&t[0], &r[0], &t[3]) && sn_mul(&t[1], &r[2], &t[2])
+        && sn_sub(&t[0], &t[0], &t[1]) && sn_shl(b, b1, p) && sn_add(b, b, &t[0]);
+}
+
+/**
+ * Multiply each of the `rows` rows (u[2i], u[2i + 1]) of a matrix by the
+ * matrix `r` on the right.
+ */
+static bool sn_gcd_rows__(SN * const u, size_t rows, const SN r[4], SN t[2]) {
+    for (size_t i = 0; i < rows; ++i) {
+        SN * const u0 = &u[2 * i], * const u1 = &u[2 * i + 1];
+
+        if (!sn_mul(&t[0], u0, &r[0]) || !sn_mul(&t[1], u1, &r[2])
+                || !sn_add(&t[0], &t[0], &t[1]) || !sn_mul(&t[1], u0, &r[1])
+                || !sn_mul(u1, u1, &r[3]) || !sn_add(u1, u1, &t[1])) {
+            return false;
+        }
+        sn_swap(u0, &t[0]);
+    }
+
+    return true;
+}
+
+/**
+ * Division step: subtract from the larger of `a` and `b` the largest multiple
+ * of the smaller one that leaves it at or above 2^s, or for s = 0 the full
+ * quotient, and multiply the `rows` rows of `u` by the step. The caller makes
+ * sure that at least one subtraction is possible.
+ */
+static bool sn_gcd_div_step__(SN * const a, SN * const b, size_t s, SN * const u, size_t rows,
+        SN t[2]) {
+    const bool swap = sn_ucmp(a, b) < 0;
+    SN * const x = swap ? b : a, * const y = swap ? a : b;
+    SN q;
+    bool ok;
+
+    sn_init(&q);
+    if (s == 0) {
+        ok = sn_divmod(&q, &t[0], x, y);
+        sn_swap(x, &t[0]);
+    } else {
+        /* q = floor((x - 2^s) / y) */
+        ok = sn_resize__(&t[1], s / SN_WORD_BITS + 1);
+        if (ok) {
+            memset(t[1].blocks, 0, t[1].size * sizeof(*t[1].blocks));
+            t[1].blocks[s / SN_WORD_BITS] = (sn_word)1 << (s % SN_WORD_BITS);
+            t[1].neg = false;
+            ok = sn_sub(&t[0], x, &t[1]) && sn_div(&q, &t[0], y) && sn_mul(&t[0], &q, y)
+                && sn_sub(x, x, &t[0]);
+        }
+    }
+
+    /* x -= q y adds q times the column of y to the column of x */
+    for (size_t i = 0; ok && i < rows; ++i) {
+        SN * const dst = &u[2 * i + !swap], * const src = &u[2 * i + swap];
+        ok = sn_mul(&t[0], &q, src) && sn_add(dst, dst, &t[0]);
+    }
+
+    sn_release(&q);
+    return ok;
+}
+
+/**
+ * Whether a step can keep `a` and `b` at or above 2^s: both are, and so is
+ * their difference.
+ */
+static bool sn_hgcd_reducible__(const SN *a, const SN *b, size_t s, SN * const t) {
+    return sn_num_bits(a) > s && sn_num_bits(b) > s && sn_sub(t, a, b) && sn_num_bits(t) > s;
+}
+
+/** Set the matrix `m` to the identity */
+static void sn_gcd_identity__(SN m[4]) {
+    sn_one(&m[0]);
+    sn_zero(&m[1]);
+    sn_zero(&m[2]);
+    sn_one(&m[3]);
+}
+
+/**
+ * Half-GCD: for magnitudes `a` and `b` of at most n bits and s = floor(n/2) + 1,
+ * take steps that keep both at or above 2^s until |a - b| < 2^s, which leaves
+ * them at about half the size, and multiply them into `m`, which must be the
+ * identity on entry. The entries of M stay below 2^(n - s), as a = m00 a' +
+ * m01 b' and so on.
+ *
+ * Reducing the top n - p bits of the pair in the same way gives a matrix whose
+ * entries are below the reduced top values, so that it also reduces the whole
+ * pair: the low p bits only change a' and b' by less than 2^p times an entry.
+ * One recursive call on the top half takes the pair from n to about 3n/4 bits
+ * and a second one on the top of the rest to about n/2; Lehmer steps do the
+ * few that remain, and all of the work below SN_THRESHOLD_GCD_HGCD blocks.
+ */
+static bool sn_hgcd__(SN * const a, SN * const b, SN m[4]) {
+    const size_t n = max(sn_num_bits(a), sn_num_bits(b)), s = n / 2 + 1;
+    SN t[4], r[4], a1, b1;
+    bool ok = true;
+
+    sn_init(&a1);
+    sn_init(&b1);
+    for (size_t i = 0; i < 4; ++i) {
+        sn_init(&t[i]);
+        sn_init(&r[i]);
+    }
+
+    if (n >= sn_thresholds__[SN_THRESHOLD_GCD_HGCD] * SN_WORD_BITS
+            && sn_hgcd_reducible__(a, b, s, &t[0])) {
+        const size_t p = n / 2;
+        if (min(sn_num_bits(a), sn_num_bits(b)) > p + n / 4) {
+            /* The reduced top halves stay at or above 2^(n/4 + 1), which
+             * keeps the whole pair at or above 2^(p + n/4) >= 2^s */
+            sn_gcd_identity__(r);
+            ok = sn_shr(&a1, a, p) && sn_shr(&b1, b, p) && sn_hgcd__(&a1, &b1, r)
+                && sn_hgcd_lift__(a, b, &a1, &b1, p, r, t) && sn_gcd_rows__(m, 2, r, t);
+        } else {
+            /* The top half of the smaller one is too short to be reduced;
+             * a division step brings the larger one down to its size */
+            ok = sn_gcd_div_step__(a, b, s, m, 2, t);
+        }
+
+        /* For the top k bits of the rest, whose reduced values stay at or
+         * above 2^(k/2), split at 2s + 1 - bits so that those land on 2^s.
+         * Pairs that are still longer than 3n/4 bits, whose top would be
+         * nearly the whole pair, are left to the steps below. */
+        const size_t bits = max(sn_num_bits(a), sn_num_bits(b));
+        if (ok && 8 * bits <= 7 * n && sn_hgcd_reducible__(a, b, s, &t[0])) {
+            const size_t p2 = 2 * s + 1 - bits;
+            sn_gcd_identity__(r);
+            ok = sn_shr(&a1, a, p2) && sn_shr(&b1, b, p2)
+                && sn_hgcd__(&a1, &b1, r) && sn_hgcd_lift__(a, b, &a1, &b1, p2, r, t)
+                && sn_gcd_rows__(m, 2, r, t);
+        }
+    }
+
+    while (ok && sn_hgcd_reducible__(a, b, s, &t[0])) {
+        sn_word q[4];
+        if (sn_lehmer_matrix__(q, a, b, s)) {
+            ok = sn_gcd_apply_1__(a, b, q, t) && sn_gcd_rows_1__(m, 2, q, t);
+        } else {
+            ok = sn_gcd_div_step__(a, b, s, m, 2, t);
+        }
+    }
+
+    sn_release(&a1);
+    sn_release(&b1);
+    for (size_t i = 0; i < 4; ++i) {
+        sn_release(&t[i]);
+        sn_release(&r[i]);
+    }
+
+    return ok;
+}
+
+/**
+ * Reduce the magnitudes `a` and `b` until one of them is zero, which leaves
+ * the GCD in the other one. If `u` is not NULL, the row (u[0], u[1]) is
+ * multiplied by every step on the way.
+ */
+static bool sn_gcd_reduce__(SN * const a, SN * const b, SN * const u) {
+    SN t[2], m[4];
+    bool ok = true;
+
+    sn_init(&t[0]);
+    sn_init(&t[1]);
+    for (size_t i = 0; i < 4; ++i) {
+        sn_init(&m[i]);
+    }
+
+    while (ok && !sn_is_zero(a) && !sn_is_zero(b)) {
+        const size_t n = max(a->size, b->size);
+        const size_t rows = u ? 1 : 0;
+        sn_word q[4];
+
+        if (n >= sn_thresholds__[SN_THRESHOLD_GCD_HGCD] && 4 * min(a->size, b->size) < 3 * n) {
+            /* Half-GCD would only chip away at the top of such a pair; a
+             * division brings the larger one down to the size of the other */
+            ok = sn_gcd_div_step__(a, b, 0, u, rows, t);
+            continue;
+        } else if (n >= sn_thresholds__[SN_THRESHOLD_GCD_HGCD]) {
+            sn_gcd_identity__(m);
+            ok = sn_hgcd__(a, b, m);
+            if (!ok || !sn_is_zero(&m[1]) || !sn_is_zero(&m[2])) {
+                ok = ok && sn_gcd_rows__(u, rows, m, t);
+                continue;
+            }
+        } else if (!u && n < sn_thresholds__[SN_THRESHOLD_GCD_LEHMER]) {
+            ok = sn_gcd_binary__(a, a, b) != NULL;
+            sn_zero(b);
+            break;
+        } else if (n == 1) {
+            /* Plain Euclid on single blocks, whose quotients are exact */
+            sn_word x = a->blocks[0], y = b->blocks[0];
+            q[0] = q[3] = 1;
+            q[1] = q[2] = 0;
+            while (x && y) {
+                if (x >= y) {
+                    q[1] += x / y * q[0];
+                    q[3] += x / y * q[2];
+                    x %= y;
+                } else {
+                    q[0] += y / x * q[1];
+                    q[2] += y / x * q[3];
+                    y %= x;
+                }
+            }
+            a->blocks[0] = x;
+            b->blocks[0] = y;
+            ok = sn_gcd_rows_1__(u, rows, q, t);
+            continue;
+        } else if (sn_lehmer_matrix__(q, a, b, 0)) {
+            ok = sn_gcd_apply_1__(a, b, q, t) && sn_gcd_rows_1__(u, rows, q, t);
+            continue;
+        }
+
+        ok = sn_gcd_div_step__(a, b, 0, u, rows, t);
+    }
+
+    sn_release(&t[0]);
+    sn_release(&t[1]);
+    for (size_t i = 0; i < 4; ++i) {
+        sn_release(&m[i]);
+    }
+
+    return ok;
+}
+
+/**
+ * Greatest common divisor of `a` and `b`, which is never negative; gcd(a, 0)
+ * = |a|. `res` may be the same number as either operand.
+ */
+SN *sn_gcd(SN * const res, const SN *a, const SN *b) {
+    assert(res && a && b && sn_valid__(a) && sn_valid__(b));
+
+    if (a->size == 1 && b->size == 1) {
+        const sn_word g = sn_gcd_1__(a->blocks[0], b->blocks[0]);
+        return sn_set_blocks__(res, &g, 1, false);
+    }
+
+    SN x, y;
+    sn_init(&x);
+    sn_init(&y);
+
+    bool ok = sn_copy(&x, a) && sn_copy(&y, b);
+    x.neg = y.neg = false;
+    ok = ok && sn_gcd_reduce__(&x, &y, NULL);
+
+    const SN *g = sn_is_zero(&x) ? &y : &x;
+    SN *ret = ok ? sn_set_blocks__(res, g->blocks, g->size, false) : NULL;
+
+    sn_release(&x);
+    sn_release(&y);
+    return ret;
+}
+
+/**
+ * Extended GCD: set `g` to gcd(a, b) and `s` and `t`, either of which may be
+ * NULL, to cofactors with s a + t b = g. As in GMP, s is the one with
+ * |s| <= |b| / 2g, which makes t the one with |t| <= |a| / 2g, except that
+ * s = sgn(a) and t = 0 if b = 0, and s = 0 and t = sgn(b) if |a| = |b| or
+ * a = 0. Any output may be the same number as an operand. Returns `g`, or
+ * NULL on allocation failure.
+ */
+SN *sn_gcdext(SN * const g, SN * const s, SN * const t, const SN *a, const SN *b) {
+    assert(g && a && b && sn_valid__(a) && sn_valid__(b));
+    assert(g != s && g != t && (!s || s != t));
+
+    /* The second row of U, which starts out as the identity */
+    SN x, y, u[2], bg, tv;
+    sn_init(&x);
+    sn_init(&y);
+    sn_init(&u[0]);
+    sn_init(&u[1]);
+    sn_init(&bg);
+    sn_init(&tv);
+    sn_one(&u[1]);
+
+    const bool cofactors = s || t;
+    bool ok = sn_copy(&x, a) && sn_copy(&y, b);
+    x.neg = y.neg = false;
+    ok = ok && sn_gcd_reduce__(&x, &y, cofactors ? u : NULL);
+
+    /* (|a|; |b|) = U (x; 0) gives x = u11 |a| - u01 |b|, and (0; y) gives
+     * y = u00 |b| - u10 |a| */
+    SN * const gcd = sn_is_zero(&x) ? &y : &x;
+    SN * const cof = gcd == &x ? &u[1] : &u[0];
+    if (ok && cofactors) {
+        cof->neg = (gcd == &y) != a->neg && !sn_is_zero(cof);
+
+        if (sn_is_zero(gcd)) {
+            sn_zero(cof);
+        } else if (!sn_is_zero(b)) {
+            /* Bring s into (-|b| / 2g, |b| / 2g] */
+            ok = sn_div(&bg, b, gcd) && sn_mod(cof, cof, &bg);
+            bg.neg = false;
+            ok = ok && sn_sub(&bg, &bg, cof);
+            if (ok && sn_ucmp(&bg, cof) < 0) {
+                sn_swap(&bg, cof);
+                cof->neg = true;
+            }
+            /* t = (g - s a) / b, which is exact */
+            ok = ok && (!t || (sn_mul(&tv, cof, a) && sn_sub(&tv, gcd, &tv)
+                        && sn_div(&tv, &tv, b)));
+        }
+    }
+
+    SN *ret = NULL;
+    if (ok && sn_set_blocks__(g, gcd->blocks, gcd->size, false)
+            && (!s || sn_set_blocks__(s, cof->blocks, cof->size, cof->neg))
+            && (!t || sn_set_blocks__(t, tv.blocks, tv.size, tv.neg))) {
+        ret = g;
+    }
+
+    sn_release(&x);
+    sn_release(&y);
+    sn_release(&u[0]);
+    sn_release(&u[1]);
+    sn_release(&bg);
+    sn_release(&tv);
+    return ret;
+}
+
+/**
+ * Inverse of `a` modulo `m`, in [0, |m|). Returns NULL if there is none, i.e.
+ * if gcd(a, m) != 1 or m = 0, and on allocation failure. `res` may be the
+ * same number as either operand.
+ */
+SN *sn_invert(SN * const res, const SN *a, const SN *m) {
+    assert(res && a && m && sn_valid__(a) && sn_valid__(m));
+
+    if (sn_is_zero(m)) {
+        return NULL;
+    }
+
+    SN x, y, u[2];
+    sn_init(&x);
+    sn_init(&y);
+    sn_init(&u[0]);
+    sn_init(&u[1]);
+    sn_one(&u[1]);
+
+    /* With a reduced first, s a = s x = 1 mod m */
+    bool ok = sn_mod(&x, a, m) && sn_copy(&y, m);
+    y.neg = false;
+    ok = ok && sn_gcd_reduce__(&x, &y, u);
+
+    SN *ret = NULL;
+    if (ok && sn_is_one(sn_is_zero(&x) ? &y : &x)) {
+        /* s = u11 for (1, 0) and s = -u10 for (0, 1), see sn_gcdext() */
+        SN * const cof = sn_is_zero(&x) ? &u[0] : &u[1];
+        cof->neg = sn_is_zero(&x) && !sn_is_zero(cof);
+        ret = sn_mod(res, cof, m);
+    }
+
+    sn_release(&x);
+    sn_release(&y);
+    sn_release(&u[0]);
+    sn_release(&u[1]);
+    return ret;
+}
+
+/* **********************************************************************************
+ * Primality
+ *
+ * Candidates are first divided by the odd primes below 1024. Consecutive
+ * primes are multiplied together as long as the product fits a block, so one
+ * pass over the number yields the remainders by a whole group of them. The
+ * survivors take the Baillie-PSW test: a strong probable prime test to base 2
+ * followed by a strong Lucas probable prime test with Selfridge's parameters,
+ * both in Montgomery arithmetic. No composite below 2^64 passes it, and none
+ * at all is known to.
+ */
+
+/** Number of odd primes below 1024 */
+#define SN_SMALL_PRIMES 171
+
+/** Odd numbers below this are prime unless one of the small primes divides them */
+#define SN_SMALL_PRIMES_LIMIT ((sn_word)1024 * 1024)
+
+/** The odd primes below 1024 */
+static const uint16_t sn_small_primes__[SN_SMALL_PRIMES] = {
+    3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83,
+    89, 97, 101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173,
+    179, 181, 191, 193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251, 257, 263, 269,
+    271, 277, 281, 283, 293, 307, 311, 313, 317, 331, 337, 347, 349, 353, 359, 367, 373,
+    379, 383, 389, 397, 401, 409, 419, 421, 431, 433, 439, 443, 449, 457, 461, 463, 467,
+    479, 487, 491, 499, 503, 509, 521, 523, 541, 547, 557, 563, 569, 571, 577, 587, 593,
+    599, 601, 607, 613, 617, 619, 631, 641, 643, 647, 653, 659, 661, 673, 677, 683, 691,
+    701, 709, 719, 727, 733, 739, 743, 751, 757, 761, 769, 773, 787, 797, 809, 811, 821,
+    823, 827, 829, 839, 853, 857, 859, 863, 877, 881, 883, 887, 907, 911, 919, 929, 937,
+    941, 947, 953, 967, 971, 977, 983, 991, 997, 1009, 1013, 1019, 1021
+};
+
+/** Whether `w` < SN_SMALL_PRIMES_LIMIT is prime, by trial division */
+static bool sn_small_prime__(sn_word w) {
+    if (w < 3 || w % 2 == 0) {
+        return w == 2;
+    }
+
+    for (size_t i = 0; i < SN_SMALL_PRIMES; ++i) {
+        const sn_word p = sn_small_primes__[i];
+        if (p * p > w) {
+            break;
+        }
+        if (w % p == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Whether none of the small primes divides the `n` blocks at `ap`. If `rems`
+ * is not NULL, all SN_SMALL_PRIMES remainders are stored there; otherwise the
+ * first divisor ends the search.
+ */
+static bool sn_presieve__(unsigned *rems, const sn_word *ap, size_t n) {
+    bool coprime = true;
+
+    for (size_t i = 0; i < SN_SMALL_PRIMES && (coprime || rems);) {
+        sn_word prod = sn_small_primes__[i];
+        size_t end = i + 1;
+        while (end < SN_SMALL_PRIMES && prod <= SN_WORD_MAX / sn_small_primes__[end]) {
+            prod *= sn_small_primes__[end++];
+        }
+
+        const sn_word r = sn_mod_1__(ap, n, prod);
+        for (; i < end; ++i) {
+            const unsigned rem = (unsigned)(r % sn_small_primes__[i]);
+            if (rems) {
+                rems[i] = rem;
+            }
+            coprime = coprime && rem != 0;
+        }
+    }
+
+    return coprime;
+}
+
+/** Jacobi symbol (a/b) for odd `b` */
+static int sn_jacobi_1__(sn_word a, sn_word b) {
+    int j = 1;
+
+    a %= b;
+    while (a) {
+        const unsigned twos = sn_ctz__(a);
+        a >>= twos;
+        /* (2/b) = -1 for b = 3, 5 mod 8 */
+        if ((twos & 1) && ((b & 7) == 3 || (b & 7) == 5)) {
+            j = -j;
+        }
+        /* Reciprocity: (a/b) = -(b/a) if both are 3 mod 4 */
+        if ((a & 3) == 3 && (b & 3) == 3) {
+            j = -j;
+        }
+        const sn_word t = a;
+        a = b % a;
+        b = t;
+    }
+
+    return b == 1 ? j : 0;
+}
+
+/** Jacobi symbol (d/n) for odd |`d`| and odd `n` */
+static int sn_jacobi_small__(long d, const SN *n) {
+    const sn_word a = (sn_word)(d < 0 ? -d : d), n0 = n->blocks[0];
+    int j = sn_jacobi_1__(sn_mod_1__(n->blocks, n->size, a), a);
+
+    /* (a/n) = (n/a) unless both are 3 mod 4, and (-1/n) = -1 for n = 3 mod 4 */
+    if ((a & 3) == 3 && (n0 & 3) == 3) {
+        j = -j;
+    }
+    if (d < 0 && (n0 & 3) == 3) {
+        j = -j;
+    }
+
+    return j;
+}
+
+/** (a + b) mod n for residues `a` and `b` in [0, n) */
+static SN *sn_addmod__(SN * const res, const SN *a, const SN *b, const SN *n) {
+    if (!sn_add(res, a, b)) {
+        return NULL;
+    }
+
+    return sn_ucmp(res, n) >= 0 ? sn_sub(res, res, n) : res;
+}
+
+/** (a - b) mod n for residues `a` and `b` in [0, n) */
+static SN *sn_submod__(SN * const res, const SN *a, const SN *b, const SN *n) {
+    if (!sn_sub(res, a, b)) {
+        return NULL;
+    }
+
+    return res->neg ? sn_add(res, res, n) : res;
+}
+
+/** Halve the residue `x` modulo the odd `n` */
+static SN *sn_halfmod__(SN * const x, const SN *n) {
+    if (sn_is_odd(x) && !sn_add(x, x, n)) {
+        return NULL;
+    }
+
+    return sn_shr(x, x, 1);
+}
+
+/**
+ * Find Selfridge's D for the odd `n` > 1024, the first of 5, -7, 9, -11, ...
+ * with (D/n) = -1. Returns 1 if there is one, 0 if n turns out composite on
+ * the way, as a multiple of some |D| or a square, and -1 on allocation
+ * failure.
+ */
+static int sn_selfridge__(long *d, const SN *n) {
+    int j;
+
+    for (*d = 5; (j = sn_jacobi_small__(*d, n)) != -1; *d = *d > 0 ? -*d - 2 : -*d + 2) {
+        if (j == 0) {
+            return 0;
+        }
+        /* Squares have no such D; rule them out once the search drags on */
+        if (*d == 13) {
+            SN r;
+            sn_init(&r);
+            const bool ok = sn_sqrtrem(NULL, &r, n), square = ok && sn_is_zero(&r);
+            sn_release(&r);
+            if (!ok || square) {
+                return ok ? 0 : -1;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/** The constants of the probable prime tests of an odd n */
+struct sn_prime_test {
+    const SN    *n;
+    sn_mont_ctx *ctx;
+    SN           one, minus_one; /**< 1 and -1 in Montgomery form */
+    SN           d;              /**< Odd part of n - 1 */
+    size_t       s;              /**< n - 1 = d 2^s */
+};
+
+/**
+ * Strong probable prime test of n to the base `base` < n: n passes if b^d = 1
+ * or b^(d 2^r) = -1 for some 0 <= r < s. Returns 1 if it does, 0 if not and
+ * -1 on allocation failure. `x` is scratch space.
+ */
+static int sn_strong_fermat__(const struct sn_prime_test *pt, sn_word base, SN * const x) {
+    SN b;
+    sn_view(&b, &base, 1);
+
+    if (!sn_powm(x, &b, &pt->d, pt->ctx) || !sn_mont_to(x, x, pt->ctx)) {
+        return -1;
+    }
+    if (sn_cmp(x, &pt->one) == 0 || sn_cmp(x, &pt->minus_one) == 0) {
+        return 1;
+    }
+
+    for (size_t r = 1; r < pt->s; ++r) {
+        if (!sn_mont_sqr(x, x, pt->ctx)) {
+            return -1;
+        }
+        if (sn_cmp(x, &pt->minus_one) == 0) {
+            return 1;
+        }
+        /* A square root of one other than -1 and 1 */
+        if (sn_cmp(x, &pt->one) == 0) {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Strong Lucas probable prime test of n > 1024 with Selfridge's D, P = 1 and
+ * Q = (1 - D) / 4. With n + 1 = e 2^s for odd e, n passes if U_e = 0 or
+ * V_(e 2^r) = 0 for some 0 <= r < s. The Lucas sequences are climbed along
+ * the bits of e with
+ *
+ *     U_2k = U_k V_k,              V_2k = V_k^2 - 2 Q^k,
+ *     U_k+1 = (U_k + V_k) / 2,     V_k+1 = (D U_k + V_k) / 2.
+ *
+ * Returns 1 if n passes, 0 if not and -1 on allocation failure.
+ */
+static int sn_strong_lucas__(const struct sn_prime_test *pt) {
+    const SN * const n = pt->n;
+    const sn_mont_ctx * const ctx = pt->ctx;
+    SN t[7];
+    SN * const e = &t[0], * const u = &t[1], * const v = &t[2], * const qk = &t[3],
+       * const q = &t[4], * const dm = &t[5], * const w = &t[6];
+
+    long d;
+    int ret = sn_selfridge__(&d, n);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    for (size_t i = 0; i < 7; ++i) {
+        sn_init(&t[i]);
+    }
+
+    const sn_word one = 1, dw = (sn_word)(d < 0 ? -d : d),
+          qw = (sn_word)(d < 0 ? 1 - d : d - 1) / 4;
+    SN ones, ds, qs;
+    sn_view(&ones, &one, 1);
+    sn_view(&ds, &dw, 1);
+    sn_view(&qs, &qw, 1);
+    ds.neg = d < 0;
+    qs.neg = d > 0;
+
+    size_t s = 0;
+    bool ok = sn_add(e, n, &ones);
+    while (ok && !sn_testbit(e, s)) {
+        ++s;
+    }
+    ok = ok && sn_shr(e, e, s) && sn_mont_to(dm, &ds, ctx) && sn_mont_to(q, &qs, ctx)
+        && sn_set_blocks__(u, pt->one.blocks, pt->one.size, false)
+        && sn_set_blocks__(v, pt->one.blocks, pt->one.size, false)
+        && sn_set_blocks__(qk, q->blocks, q->size, false);
+
+    for (size_t i = ok ? sn_num_bits(e) - 1 : 0; ok && i-- > 0;) {
+        ok = sn_mont_mul(u, u, v, ctx) && sn_mont_sqr(v, v, ctx)
+            && sn_addmod__(w, qk, qk, n) && sn_submod__(v, v, w, n)
+            && sn_mont_sqr(qk, qk, ctx);
+        if (ok && sn_testbit(e, i)) {
+            ok = sn_mont_mul(w, dm, u, ctx)
+                && sn_addmod__(u, u, v, n) && sn_halfmod__(u, n)
+                && sn_addmod__(v, v, w, n) && sn_halfmod__(v, n)
+                && sn_mont_mul(qk, qk, q, ctx);
+        }
+    }
+
+    ret = ok && (sn_is_zero(u) || sn_is_zero(v));
+    for (size_t r = 1; ok && !ret && r < s; ++r) {
+        ok = sn_mont_sqr(v, v, ctx) && sn_addmod__(w, qk, qk, n) && sn_submod__(v, v, w, n)
+            && (r + 1 == s || sn_mont_sqr(qk, qk, ctx));
+        ret = ok && sn_is_zero(v);
+    }
+
+    for (size_t i = 0; i < 7; ++i) {
+        sn_release(&t[i]);
+    }
+    return ok ? ret : -1;
+}
+
+/**
+ * Baillie-PSW test of the odd `n` > 1024, followed by `reps` strong probable
+ * prime tests to the bases 3, 5, 7 and so on unless n < 2^64. Returns 2 if n
+ * is certainly prime, 1 if it is a probable prime, 0 if it is composite and
+ * -1 on allocation failure.
+ */
+static int sn_prime_test__(const SN *n, unsigned reps) {
+    struct sn_prime_test pt = { .n = n, .ctx = sn_mont_ctx_new(n) };
+    const sn_word one = 1;
+    SN ones, x;
+
+    sn_view(&ones, &one, 1);
+    sn_init(&pt.one);
+    sn_init(&pt.minus_one);
+    sn_init(&pt.d);
+    sn_init(&x);
+
+    bool ok = pt.ctx && sn_sub(&pt.d, n, &ones) && sn_mont_to(&pt.one, &ones, pt.ctx)
+        && sn_mont_to(&pt.minus_one, &pt.d, pt.ctx);
+    pt.s = 0;
+    while (ok && !sn_testbit(&pt.d, pt.s)) {
+        ++pt.s;
+    }
+    ok = ok && sn_shr(&pt.d, &pt.d, pt.s);
+
+    int ret = ok ? sn_strong_fermat__(&pt, 2, &x) : -1;
+    if (ret == 1) {
+        ret = sn_strong_lucas__(&pt);
+    }
+    if (ret == 1 && sn_num_bits(n) <= 64) {
+        ret = 2;
+    }
+    for (unsigned i = 0; ret == 1 && i < reps && i < SN_SMALL_PRIMES; ++i) {
+        ret = sn_strong_fermat__(&pt, sn_small_primes__[i], &x);
+    }
+
+    sn_release(&pt.one);
+    sn_release(&pt.minus_one);
+    sn_release(&pt.d);
+    sn_release(&x);
+    sn_mont_ctx_free(pt.ctx);
+    return ret;
+}
+
+/**
+ * Test whether |`n`| is prime. Returns 2 if it certainly is, 1 if it is a
+ * probable prime, 0 if it is composite and -1 on allocation failure. Numbers
+ * below 2^64 are decided exactly; larger ones must also pass `reps` strong
+ * probable prime tests to the bases 3, 5, 7 and so on, at most 171 of them.
+ */
+int sn_probab_prime(const SN *n, unsigned reps) {
+    assert(n && sn_valid__(n));
+
+    SN a;
+    sn_view(&a, n->blocks, n->size);
+
+    if (a.size == 1 && a.blocks[0] < SN_SMALL_PRIMES_LIMIT) {
+        return sn_small_prime__(a.blocks[0]) ? 2 : 0;
+    }
+    if (sn_is_even(&a) || !sn_presieve__(NULL, a.blocks, a.size)) {
+        return 0;
+    }
+
+    return sn_prime_test__(&a, reps);
+}
+
+/**
+ * Set `res` to the smallest prime larger than `n`; that is 2 for n < 2. The
+ * odd candidates are sieved with the small primes a window at a time, and
+ * the survivors take the Baillie-PSW test, so that above 2^64 the result is a
+ * probable prime. `res` may be `n`. Returns NULL on allocation failure.
+ */
+SN *sn_next_prime(SN * const res, const SN *n) {
+    assert(res && n && sn_valid__(n));
+
+    SN a;
+    sn_view(&a, n->blocks, n->size);
+
+    /* The next prime is below twice the number */
+    if (n->neg || (a.size == 1 && a.blocks[0] < SN_SMALL_PRIMES_LIMIT / 2)) {
+        sn_word w = n->neg ? 1 : a.blocks[0];
+        do {
+            ++w;
+        } while (!sn_small_prime__(w));
+        return sn_set_blocks__(res, &w, 1, false);
+    }
+
+    /* A window holds twice as many odd candidates as the expected gap */
+    const size_t len = max(64, 2 * sn_num_bits(&a));
+    const sn_word one = 1;
+    unsigned rems[SN_SMALL_PRIMES];
+    uint8_t *sieve = sn_mem_alloc__(len);
+    SN ones, start, cand;
+
+    sn_view(&ones, &one, 1);
+    sn_init(&start);
+    sn_init(&cand);
+
+    bool ok = sieve && sn_add(&start, &a, &ones)
+        && (sn_is_odd(&start) || sn_add(&start, &start, &ones));
+    int found = 0;
+    if (ok) {
+        sn_presieve__(rems, start.blocks, start.size);
+    }
+
+    while (ok && !found) {
+        /* Candidate j is start + 2j, which p divides for j = -r / 2 mod p */
+        memset(sieve, 0, len);
+        for (size_t i = 0; i < SN_SMALL_PRIMES; ++i) {
+            const size_t p = sn_small_primes__[i];
+            for (size_t j = (p - rems[i]) % p * ((p + 1) / 2) % p; j < len; j += p) {
+                sieve[j] = 1;
+            }
+        }
+
+        for (size_t j = 0; ok && !found && j < len; ++j) {
+            if (sieve[j]) {
+                continue;
+            }
+            const sn_word off = (sn_word)(2 * j);
+            SN offs;
+            sn_view(&offs, &off, 1);
+            found = sn_add(&cand, &start, &offs) ? sn_prime_test__(&cand, 0) : -1;
+            ok = found >= 0;
+        }
+
+        if (ok && !found) {
+            const sn_word off = (sn_word)(2 * len);
+            SN offs;
+            sn_view(&offs, &off, 1);
+            ok = sn_add(&start, &start, &offs);
+            for (size_t i = 0; i < SN_SMALL_PRIMES; ++i) {
+                rems[i] = (unsigned)((rems[i] + 2 * len) % sn_small_primes__[i]);
+            }
+        }
+    }
+
+    SN *ret = ok ? sn_set_blocks__(res, cand.blocks, cand.size, false) : NULL;
+
+    if (sieve) {
+        sn_mem_free__(sieve, len);
+    }
+    sn_release(&start);
+    sn_release(&cand);
+    return ret;
+}
+
+/* **********************************************************************************
+ * Batches
+ *
+ * A batch stores `count` unsigned numbers of `blocks` blocks each in one
+ * array, block by block: block j of number i is data[j count + i]. The kernels
+ * walk the blocks in the outer loop and the numbers in the inner one, so the
+ * inner loops read and write consecutive words without any dependency from
+ * one number to the next, which compilers turn into vector code. The numbers
+ * are processed in chunks of SN_BATCH_CHUNK to keep the per-number carries on
+ * the stack.
+ */
+
+#define SN_BATCH_CHUNK 64
+
+struct sn_batch {
+    sn_word *data;   /* `blocks` rows of `count` words */
+    size_t   count;  /* Number of numbers */
+    size_t   blocks; /* Number of blocks of every number */
+};
+
+/**
+ * Create a batch of `count` numbers of `blocks` > 0 blocks each, all zero.
+ * Returns NULL on allocation failure.
+ */
+sn_batch *sn_batch_new(size_t count, size_t blocks) {
+    assert(blocks > 0);
+
+    sn_batch *batch = sn_mem_alloc__(sizeof(*batch));
+    if (!batch) {
+        return NULL;
+    }
+
+    batch->count  = count;
+    batch->blocks = blocks;
+    batch->data   = sn_mem_alloc__(max(count * blocks, 1) * sizeof(*batch->data));
+    if (!batch->data) {
+        sn_mem_free__(batch, sizeof(*batch));
+        return NULL;
+    }
+    memset(batch->data, 0, count * blocks * sizeof(*batch->data));
+
+    return batch;
+}
+
+void sn_batch_free(sn_batch *batch) {
+    if (batch) {
+        sn_mem_free__(batch->data, max(batch->count * batch->blocks, 1) * sizeof(*batch->data));
+        sn_mem_free__(batch, sizeof(*batch));
+    }
+}
+
+size_t sn_batch_count(const sn_batch *batch) {
+    assert(batch);
+
+    return batch->count;
+}
+
+size_t sn_batch_blocks(const sn_batch *batch) {
+    assert(batch);
+
+    return batch->blocks;
+}
+
+/**
+ * Store `num` as number `i` of the batch. Returns NULL if `num` is negative or
+ * does not fit into the blocks of the batch.
+ */
+sn_batch *sn_batch_set(sn_batch * const batch, size_t i, const SN *num) {
+    assert(batch && num && sn_valid__(num) && i < batch->count);
+
+    size_t n = num->size;
+    while (n > 1 && num->blocks[n - 1] == 0) {
+        --n;
+    }
+
+    if ((num->neg && (n > 1 || num->blocks[0])) || n > batch->blocks) {
+        return NULL;
+    }
+
+    for (size_t j = 0; j < batch->blocks; ++j) {
+        batch->data[j * batch->count + i] = j < n ? num->blocks[j] : 0;
+    }
+
+    return batch;
+}
+
+/** Load number `i` of the batch into `res` */
+SN *sn_batch_get(SN * const res, const sn_batch *batch, size_t i) {
+    assert(res && batch && i < batch->count);
+
+    const size_t n = batch->blocks;
+    if (!sn_resize__(res, n)) {
+        return NULL;
+    }
+
+    for (size_t j = 0; j < n; ++j) {
+        res->blocks[j] = batch->data[j * batch->count + i];
+    }
+    res->neg = false;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Add the numbers of `a` and `b` pairwise into `res`, modulo 2^(W blocks). All
+ * three batches must have the same shape, and `res` may be either operand.
+ * Unless `carry` is NULL, carry[i] tells whether sum `i` wrapped around.
+ */
+sn_batch *sn_batch_add(sn_batch * const res, const sn_batch *a, const sn_batch *b,
+        uint8_t *carry) {
+    assert(res && a && b);
+    assert(a->count == res->count && b->count == res->count);
+    assert(a->blocks == res->blocks && b->blocks == res->blocks);
+
+    const size_t count = res->count;
+    sn_word c[SN_BATCH_CHUNK];
+
+    for (size_t lo = 0; lo < count; lo += SN_BATCH_CHUNK) {
+        const size_t len = min(count - lo, (size_t)SN_BATCH_CHUNK);
+        memset(c, 0, sizeof(c));
+
+        for (size_t j = 0; j < res->blocks; ++j) {
+            const sn_word *ap = a->data + j * count + lo, *bp = b->data + j * count + lo;
+            sn_word *rp = res->data + j * count + lo;
+
+            for (size_t i = 0; i < len; ++i) {
+                const sn_word s = ap[i] + bp[i], t = s + c[i];
+                c[i]  = (s < ap[i]) | (t < s);
+                rp[i] = t;
+            }
+        }
+
+        if (carry) {
+            for (size_t i = 0; i < len; ++i) {
+                carry[lo + i] = (uint8_t)c[i];
+            }
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Subtract the numbers of `b` from those of `a` pairwise into `res`, modulo
+ * 2^(W blocks), like sn_batch_add(). Unless `borrow` is NULL, borrow[i] tells
+ * whether difference `i` wrapped around, i.e. b[i] > a[i].
+ */
+sn_batch *sn_batch_sub(sn_batch * const res, const sn_batch *a, const sn_batch *b,
+        uint8_t *borrow) {
+    assert(res && a && b);
+    assert(a->count == res->count && b->count == res->count);
+    assert(a->blocks == res->blocks && b->blocks == res->blocks);
+
+    const size_t count = res->count;
+    sn_word c[SN_BATCH_CHUNK];
+
+    for (size_t lo = 0; lo < count; lo += SN_BATCH_CHUNK) {
+        const size_t len = min(count - lo, (size_t)SN_BATCH_CHUNK);
+        memset(c, 0, sizeof(c));
+
+        for (size_t j = 0; j < res->blocks; ++j) {
+            const sn_word *ap = a->data + j * count + lo, *bp = b->data + j * count + lo;
+            sn_word *rp = res->data + j * count + lo;
+
+            for (size_t i = 0; i < len; ++i) {
+                const sn_word d = ap[i] - bp[i], t = d - c[i];
+                c[i]  = (ap[i] < bp[i]) | (d < c[i]);
+                rp[i] = t;
+            }
+        }
+
+        if (borrow) {
+            for (size_t i = 0; i < len; ++i) {
+                borrow[lo + i] = (uint8_t)c[i];
+            }
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Multiply the numbers of `a` and `b` pairwise into `res`, whose numbers may
+ * have any size: products wider than them are cut down to their low blocks.
+ * `res` must be distinct from the operands, which must have the same count.
+ */
+sn_batch *sn_batch_mul(sn_batch * const res, const sn_batch *a, const sn_batch *b) {
+    assert(res && a && b && res != a && res != b);
+    assert(a->count == res->count && b->count == res->count);
+
+    const size_t count = res->count, rn = res->blocks;
+    sn_word c[SN_BATCH_CHUNK];
+
+    memset(res->data, 0, count * rn * sizeof(*res->data));
+
+    for (size_t lo = 0; lo < count; lo += SN_BATCH_CHUNK) {
+        const size_t len = min(count - lo, (size_t)SN_BATCH_CHUNK);
+
+        /* Schoolbook rows r += a b_k B^k, the numbers side by side */
+        for (size_t k = 0; k < b->blocks && k < rn; ++k) {
+            const sn_word *bp = b->data + k * count + lo;
+            memset(c, 0, sizeof(c));
+
+            for (size_t j = 0; j < a->blocks && j + k < rn; ++j) {
+                const sn_word *ap = a->data + j * count + lo;
+                sn_word *rp = res->data + (j + k) * count + lo;
+
+                for (size_t i = 0; i < len; ++i) {
+                    const sn_dword t = (sn_dword)ap[i] * bp[i] + rp[i] + c[i];
+                    rp[i] = (sn_word)t;
+                    c[i]  = (sn_word)(t >> SN_WORD_BITS);
+                }
+            }
+
+            if (a->blocks + k < rn) {
+                sn_word *rp = res->data + (a->blocks + k) * count + lo;
+                for (size_t i = 0; i < len; ++i) {
+                    rp[i] = c[i];
+                }
+            }
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Compare the numbers of `a` and `b` pairwise, which must have the same shape,
+ * and store -1, 0 or 1 in `cmp`, like sn_ucmp(). Higher blocks are visited
+ * later and override the verdict of the lower ones, which keeps the loop free
+ * of early exits.
+ */
+void sn_batch_cmp(int8_t *cmp, const sn_batch *a, const sn_batch *b) {
+    assert(cmp && a && b);
+    assert(a->count == b->count && a->blocks == b->blocks);
+
+    const size_t count = a->count;
+    sn_word gt[SN_BATCH_CHUNK], lt[SN_BATCH_CHUNK];
+
+    for (size_t lo = 0; lo < count; lo += SN_BATCH_CHUNK) {
+        const size_t len = min(count - lo, (size_t)SN_BATCH_CHUNK);
+        memset(gt, 0, sizeof(gt));
+        memset(lt, 0, sizeof(lt));
+
+        for (size_t j = 0; j < a->blocks; ++j) {
+            const sn_word *ap = a->data + j * count + lo, *bp = b->data + j * count + lo;
+
+            for (size_t i = 0; i < len; ++i) {
+                const sn_word eq = ap[i] == bp[i];
+                gt[i] = (ap[i] > bp[i]) | (eq & gt[i]);
+                lt[i] = (ap[i] < bp[i]) | (eq & lt[i]);
+            }
+        }
+
+        for (size_t i = 0; i < len; ++i) {
+            cmp[lo + i] = (int8_t)((int)gt[i] - (int)lt[i]);
+        }
+    }
+}
+
+/* **********************************************************************************
+ * Fixed-width numbers
+ *
+ * The kernels below take the number of blocks as a parameter, but every caller
+ * is generated by SN_FIXED_DEFINE() with a constant, so that after inlining the
+ * loops over the blocks have a known trip count and are unrolled completely.
+ * Beyond SN_FIXED_UNROLL_BLOCKS, products instead go row by row through the
+ * block kernels, whose carry chains on x86-64 outrun the unrolled code. None
+ * of them branches on the values.
+ */
+
+#define SN_FIXED_UNROLL_BLOCKS (512 / SN_WORD_BITS)
+
+#if defined(__clang__)
+#  define SN_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#  define SN_UNROLL _Pragma("GCC unroll 64")
+#else
+#  define SN_UNROLL
+#endif
+
+/**
+ * Store the magnitude of `num` in the `n` blocks at `rp`. Returns false if
+ * `num` is negative or does not fit.
+ */
+static bool sn_fixed_from_sn__(sn_word *rp, size_t n, const SN *num) {
+    assert(num && sn_valid__(num));
+
+    size_t size = num->size;
+    while (size > 1 && num->blocks[size - 1] == 0) {
+        --size;
+    }
+
+    if ((num->neg && (size > 1 || num->blocks[0])) || size > n) {
+        return false;
+    }
+
+    memcpy(rp, num->blocks, size * sizeof(*rp));
+    memset(rp + size, 0, (n - size) * sizeof(*rp));
+
+    return true;
+}
+
+static inline int sn_fixed_cmp__(const sn_word *ap, const sn_word *bp, size_t n) {
+    int cmp = 0;
+
+    /* Higher blocks override the verdict of the lower ones */
+    SN_UNROLL
+    for (size_t i = 0; i < n; ++i) {
+        const int v = (ap[i] > bp[i]) - (ap[i] < bp[i]);
+        cmp = v ? v : cmp;
+    }
+
+    return cmp;
+}
+
+static inline sn_word sn_fixed_add__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        size_t n) {
+    sn_word carry = 0;
+
+    SN_UNROLL
+    for (size_t i = 0; i < n; ++i) {
+        const sn_dword t = (sn_dword)ap[i] + bp[i] + carry;
+        rp[i] = (sn_word)t;
+        carry = (sn_word)(t >> SN_WORD_BITS);
+    }
+
+    return carry;
+}
+
+static inline sn_word sn_fixed_sub__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        size_t n) {
+    sn_word borrow = 0;
+
+    SN_UNROLL
+    for (size_t i = 0; i < n; ++i) {
+        const sn_dword t = (sn_dword)ap[i] - bp[i] - borrow;
+        rp[i] = (sn_word)t;
+        borrow = (sn_word)(t >> SN_WORD_BITS) & 1;
+    }
+
+    return borrow;
+}
+
+/** The 2 `n` block product of the `n` blocks at `ap` and `bp` into `tp` */
+static inline void sn_fixed_mul__(sn_word *tp, const sn_word *ap, const sn_word *bp,
+        size_t n) {
+    if (n > SN_FIXED_UNROLL_BLOCKS) {
+        sn_mul_basecase__(tp, ap, n, bp, n);
+        return;
+    }
+
+    memset(tp, 0, n * sizeof(*tp));
+
+    for (size_t j = 0; j < n; ++j) {
+        sn_word carry = 0;
+
+        SN_UNROLL
+        for (size_t i = 0; i < n; ++i) {
+            const sn_dword t = (sn_dword)ap[i] * bp[j] + tp[i + j] + carry;
+            tp[i + j] = (sn_word)t;
+            carry = (sn_word)(t >> SN_WORD_BITS);
+        }
+        tp[n + j] = carry;
+    }
+}
+
+/**
+ * The 2 `n` block square of the `n` blocks at `ap` into `tp`: the products of
+ * distinct blocks are computed once and doubled, then the squares of the
+ * blocks are added along the diagonal.
+ */
+static inline void sn_fixed_sqr__(sn_word *tp, const sn_word *ap, size_t n) {
+    if (n > SN_FIXED_UNROLL_BLOCKS) {
+        sn_sqr_basecase__(tp, ap, n);
+        return;
+    }
+
+    memset(tp, 0, 2 * n * sizeof(*tp));
+
+    for (size_t i = 0; i + 1 < n; ++i) {
+        sn_word carry = 0;
+
+        for (size_t j = i + 1; j < n; ++j) {
+            const sn_dword t = (sn_dword)ap[i] * ap[j] + tp[i + j] + carry;
+            tp[i + j] = (sn_word)t;
+            carry = (sn_word)(t >> SN_WORD_BITS);
+        }
+        tp[i + n] = carry;
+    }
+
+    sn_word shifted = 0, carry = 0;
+
+    SN_UNROLL
+    for (size_t i = 0; i < n; ++i) {
+        const sn_dword sq = (sn_dword)ap[i] * ap[i];
+        const sn_word lo = tp[2 * i], hi = tp[2 * i + 1];
+
+        sn_dword t = (sn_dword)((lo << 1) | shifted) + (sn_word)sq + carry;
+        tp[2 * i] = (sn_word)t;
+        t = (sn_dword)((hi << 1) | (lo >> (SN_WORD_BITS - 1)))
+            + (sn_word)(sq >> SN_WORD_BITS) + (sn_word)(t >> SN_WORD_BITS);
+        tp[2 * i + 1] = (sn_word)t;
+        carry = (sn_word)(t >> SN_WORD_BITS);
+        shifted = hi >> (SN_WORD_BITS - 1);
+    }
+}
+
+/**
+ * Subtract the `n` block modulus at `mp` from the `n` + 1 block value at `tp`,
+ * which is below 2 m, unless that goes negative, and store the result at `rp`.
+ */
+static inline void sn_fixed_mont_final__(sn_word *rp, sn_word *tp, const sn_word *mp,
+        size_t n) {
+    const sn_word borrow = sn_fixed_sub__(rp, tp, mp, n);
+    const sn_word keep = -(borrow & (tp[n] ^ 1));
+
+    SN_UNROLL
+    for (size_t i = 0; i < n; ++i) {
+        rp[i] = (tp[i] & keep) | (rp[i] & ~keep);
+    }
+}
+
+/**
+ * Montgomery product a b R^-1 mod m of `n` block residues below the modulus at
+ * `mp` into `rp`, which may be either operand. Up to SN_FIXED_UNROLL_BLOCKS,
+ * this uses coarsely integrated operand scanning in `n` + 2 blocks of scratch
+ * space at `tp`, and beyond a full product and a reduction in 2 `n` + 1.
+ */
+static inline void sn_fixed_mont_mul__(sn_word *rp, const sn_word *ap, const sn_word *bp,
+        const sn_word *mp, sn_word minv, size_t n, sn_word *tp) {
+    if (n > SN_FIXED_UNROLL_BLOCKS) {
+        sn_mul_basecase__(tp, ap, n, bp, n);
+
+        /* The carry of each row is parked in the block it has just cleared */
+        for (size_t i = 0; i < n; ++i) {
+            tp[i] = sn_addmul_1__(tp + i, mp, n, tp[i] * minv);
+        }
+        tp[2 * n] = sn_add_n__(tp + n, tp + n, tp, n);
+
+        sn_fixed_mont_final__(rp, tp + n, mp, n);
+        return;
+    }
+
+    memset(tp, 0, (n + 2) * sizeof(*tp));
+
+    for (size_t i = 0; i < n; ++i) {
+        sn_word carry = 0;
+        sn_dword t;
+
+        SN_UNROLL
+        for (size_t j = 0; j < n; ++j) {
+            t = (sn_dword)ap[j] * bp[i] + tp[j] + carry;
+            tp[j] = (sn_word)t;
+            carry = (sn_word)(t >> SN_WORD_BITS);
+        }
+        t = (sn_dword)tp[n] + carry;
+        tp[n] = (sn_word)t;
+        tp[n + 1] = (sn_word)(t >> SN_WORD_BITS);
+
+        /* Add q m for the q that clears the low block, and shift it out */
+        const sn_word q = tp[0] * minv;
+        t = (sn_dword)q * mp[0] + tp[0];
+        carry = (sn_word)(t >> SN_WORD_BITS);
+
+        SN_UNROLL
+        for (size_t j = 1; j < n; ++j) {
+            t = (sn_dword)q * mp[j] + tp[j] + carry;
+            tp[j - 1] = (sn_word)t;
+            carry = (sn_word)(t >> SN_WORD_BITS);
+        }
+        t = (sn_dword)tp[n] + carry;
+        tp[n - 1] = (sn_word)t;
+        tp[n] = tp[n + 1] + (sn_word)(t >> SN_WORD_BITS);
+    }
+
+    sn_fixed_mont_final__(rp, tp, mp, n);
+}
+
+/**
+ * Set up the `n` block Montgomery constants for the modulus at `mp`: R^2 mod m
+ * into `r2`, by doubling 1 modulo m 2 W `n` times, and -m^-1 mod B into
+ * `minv`. Returns false for an even modulus.
+ */
+static bool sn_fixed_mont_init__(sn_word *r2, sn_word *minv, const sn_word *mp, size_t n) {
+    if (!(mp[0] & 1)) {
+        return false;
+    }
+
+    *minv = sn_mont_minv__(mp[0]);
+
+    /* Start from 1 mod m, which is 0 for m = 1 */
+    memset(r2, 0, n * sizeof(*r2));
+    r2[0] = 1;
+    r2[0] = sn_fixed_cmp__(r2, mp, n) != 0;
+
+    for (size_t i = 0; i < 2 * SN_WORD_BITS * n; ++i) {
+        const sn_word carry = sn_fixed_add__(r2, r2, r2, n);
+        if (carry || sn_fixed_cmp__(r2, mp, n) >= 0) {
+            sn_fixed_sub__(r2, r2, mp, n);
+        }
+    }
+
+    return true;
+}
+
+/* Public functions of the width `bits`, declared by SN_FIXED_DECLARE() */
+#define SN_FIXED_DEFINE(bits) \
+    sn##bits *sn##bits##_from_sn(sn##bits * const res, const SN *num) { \
+        assert(res); \
+        return sn_fixed_from_sn__(res->blocks, SN_FIXED_BLOCKS(bits), num) ? res : NULL; \
+    } \
+    \
+    SN *sn##bits##_to_sn(SN * const res, const sn##bits *a) { \
+        assert(res && a); \
+        return sn_set_blocks__(res, a->blocks, SN_FIXED_BLOCKS(bits), false); \
+    } \
+    \
+    int sn##bits##_cmp(const sn##bits *a, const sn##bits *b) { \
+        assert(a && b); \
+        return sn_fixed_cmp__(a->blocks, b->blocks, SN_FIXED_BLOCKS(bits)); \
+    } \
+    \
+    sn_word sn##bits##_add(sn##bits * const res, const sn##bits *a, const sn##bits *b) { \
+        assert(res && a && b); \
+        return sn_fixed_add__(res->blocks, a->blocks, b->blocks, SN_FIXED_BLOCKS(bits)); \
+    } \
+    \
+    sn_word sn##bits##_sub(sn##bits * const res, const sn##bits *a, const sn##bits *b) { \
+        assert(res && a && b); \
+        return sn_fixed_sub__(res->blocks, a->blocks, b->blocks, SN_FIXED_BLOCKS(bits)); \
+    } \
+    \
+    void sn##bits##_mul(sn##bits * const lo, sn##bits * const hi, const sn##bits *a, \
+            const sn##bits *b) { \
+        assert(lo && a && b && lo != hi); \
+        sn_word t[2 * SN_FIXED_BLOCKS(bits)]; \
+        sn_fixed_mul__(t, a->blocks, b->blocks, SN_FIXED_BLOCKS(bits)); \
+        memcpy(lo->blocks, t, sizeof(lo->blocks)); \
+        if (hi) { \
+            memcpy(hi->blocks, t + SN_FIXED_BLOCKS(bits), sizeof(hi->blocks)); \
+        } \
+    } \
+    \
+    void sn##bits##_sqr(sn##bits * const lo, sn##bits * const hi, const sn##bits *a) { \
+        assert(lo && a && lo != hi); \
+        sn_word t[2 * SN_FIXED_BLOCKS(bits)]; \
+        sn_fixed_sqr__(t, a->blocks, SN_FIXED_BLOCKS(bits)); \
+        memcpy(lo->blocks, t, sizeof(lo->blocks)); \
+        if (hi) { \
+            memcpy(hi->blocks, t + SN_FIXED_BLOCKS(bits), sizeof(hi->blocks)); \
+        } \
+    } \
+    \
+    sn##bits##_mont_ctx *sn##bits##_mont_init(sn##bits##_mont_ctx * const ctx, \
+            const sn##bits *mod) { \
+        assert(ctx && mod); \
+        ctx->mod = *mod; \
+        return sn_fixed_mont_init__(ctx->r2.blocks, &ctx->minv, mod->blocks, \
+                SN_FIXED_BLOCKS(bits)) ? ctx : NULL; \
+    } \
+    \
+    sn##bits *sn##bits##_mont_mul(sn##bits * const res, const sn##bits *a, \
+            const sn##bits *b, const sn##bits##_mont_ctx *ctx) { \
+        assert(res && a && b && ctx); \
+        sn_word t[2 * SN_FIXED_BLOCKS(bits) + 1]; \
+        sn_fixed_mont_mul__(res->blocks, a->blocks, b->blocks, ctx->mod.blocks, ctx->minv, \
+                SN_FIXED_BLOCKS(bits), t); \
+        return res; \
+    } \
+    \
+    sn##bits *sn##bits##_mont_sqr(sn##bits * const res, const sn##bits *a, \
+            const sn##bits##_mont_ctx *ctx) { \
+        return sn##bits##_mont_mul(res, a, a, ctx); \
+    } \
+    \
+    sn##bits *sn##bits##_mont_to(sn##bits * const res, const sn##bits *a, \
+            const sn##bits##_mont_ctx *ctx) { \
+        assert(ctx); \
+        return sn##bits##_mont_mul(res, a, &ctx->r2, ctx); \
+    } \
+    \
+    sn##bits *sn##bits##_mont_from(sn##bits * const res, const sn##bits *a, \
+            const sn##bits##_mont_ctx *ctx) { \
+        sn##bits one = { { 1 } }; \
+        return sn##bits##_mont_mul(res, a, &one, ctx); \
+    }
+
+SN_FIXED_DEFINE(256)
+SN_FIXED_DEFINE(512)
+SN_FIXED_DEFINE(1024)
+SN_FIXED_DEFINE(2048)
+
+/* **********************************************************************************
+ * Printing and loading
+ */
+
+/*
+ * Binary import and export, as in GMP's mpz_import() and mpz_export(): the
+ * magnitude is split into words of `size` bytes, the top `nails` bits of which
+ * are unused. `order` is 1 for the most significant word first and -1 for the
+ * least significant first; `endian` is 1 for big-endian words, -1 for
+ * little-endian and 0 for the byte order of the host. Whenever the words line
+ * up with the blocks or the data is one plain byte string, whole blocks are
+ * copied at once, byte-swapped if need be.
+ */
+
+/** 1 if the host is big-endian, -1 if it is little-endian */
+static inline int sn_host_endian__(void) {
+    const union {
+        sn_word w;
+        uint8_t b[sizeof(sn_word)];
+    } probe = { 1 };
+
+    return probe.b[0] ? -1 : 1;
+}
+
+static inline sn_word sn_bswap__(sn_word w) {
+#if defined(__GNUC__) && SN_WORD_BITS == 64
+    return __builtin_bswap64(w);
+#elif defined(__GNUC__)
+    return __builtin_bswap32(w);
+#else
+    sn_word r = 0;
+    for (size_t i = 0; i < sizeof(w); ++i) {
+        r = (r << 8) | (w & 0xff);
+        w >>= 8;
+    }
+    return r;
+#endif // __GNUC__
+}
+
+/** The `bits` <= 8 bits of the magnitude of `num` from bit `pos` on */
+static unsigned sn_get_bits__(const SN *num, size_t pos, unsigned bits) {
+    const size_t j = pos / SN_WORD_BITS;
+    const unsigned shift = pos % SN_WORD_BITS;
+
+    if (j >= num->size) {
+        return 0;
+    }
+
+    sn_word w = num->blocks[j] >> shift;
+    if (shift + bits > SN_WORD_BITS && j + 1 < num->size) {
+        w |= num->blocks[j + 1] << (SN_WORD_BITS - shift);
+    }
+
+    return (unsigned)(w & ((1u << bits) - 1));
+}
+
+/**
+ * Write the magnitude of `num`, which must fit, as the `length` byte string
+ * at `dst`, with leading zeros, most significant byte first if `big`.
+ */
+static void sn_export_bytes__(uint8_t *dst, size_t length, const SN *num, bool big) {
+    const size_t word_bytes = sizeof(sn_word);
+    const bool swap = big != (sn_host_endian__() > 0);
+
+    size_t j = 0;
+    for (; (j + 1) * word_bytes <= length; ++j) {
+        sn_word w = j < num->size ? num->blocks[j] : 0;
+        w = swap ? sn_bswap__(w) : w;
+        memcpy(dst + (big ? length - (j + 1) * word_bytes : j * word_bytes), &w, word_bytes);
+    }
+
+    /* The top block is cut short */
+    const sn_word top = j < num->size ? num->blocks[j] : 0;
+    for (size_t i = j * word_bytes; i < length; ++i) {
+        dst[big ? length - 1 - i : i] = (uint8_t)(top >> (8 * (i - j * word_bytes)));
+    }
+}
+
+/**
+ * Set the `n` >= ceil(`length` / word bytes) blocks of `res` to the `length`
+ * byte string at `src`, most significant byte first if `big`.
+ */
+static void sn_import_bytes__(SN * const res, const uint8_t *src, size_t length, bool big) {
+    const size_t word_bytes = sizeof(sn_word);
+    const bool swap = big != (sn_host_endian__() > 0);
+
+    size_t j = 0;
+    for (; (j + 1) * word_bytes <= length; ++j) {
+        sn_word w;
+        memcpy(&w, src + (big ? length - (j + 1) * word_bytes : j * word_bytes), word_bytes);
+        res->blocks[j] = swap ? sn_bswap__(w) : w;
+    }
+
+    if (j * word_bytes < length) {
+        sn_word top = 0;
+        for (size_t i = j * word_bytes; i < length; ++i) {
+            top |= (sn_word)src[big ? length - 1 - i : i] << (8 * (i - j * word_bytes));
+        }
+        res->blocks[j++] = top;
+    }
+
+    memset(res->blocks + j, 0, (res->size - j) * sizeof(*res->blocks));
+}
+
+/**
+ * Number of words of `size` bytes with `nails` unused top bits that
+ * sn_export() writes for `num`; zero needs none.
+ */
+size_t sn_export_size(const SN *num, size_t size, size_t nails) {
+    assert(num && size > 0 && nails < 8 * size);
+
+    const size_t word_bits = 8 * size - nails;
+
+    return (sn_num_bits(num) + word_bits - 1) / word_bits;
+}
+
+/**
+ * Store the magnitude of `num` at `dst` as sn_export_size() words in the given
+ * format, see above, and return their number. The sign is not stored and the
+ * nails are set to zero.
+ */
+size_t sn_export(void * const dst, int order, size_t size, int endian, size_t nails,
+        const SN *num) {
+    assert(dst && num && sn_valid__(num));
+    assert((order == 1 || order == -1) && endian >= -1 && endian <= 1);
+
+    const size_t count = sn_export_size(num, size, nails);
+    uint8_t *out = dst;
+
+    endian = endian ? endian : sn_host_endian__();
+
+    if (nails == 0 && order == endian) {
+        sn_export_bytes__(out, count * size, num, order > 0);
+    } else if (nails == 0 && size == sizeof(sn_word)) {
+        const bool swap = endian != sn_host_endian__();
+
+        for (size_t i = 0; i < count; ++i) {
+            sn_word w = i < num->size ? num->blocks[i] : 0;
+            w = swap ? sn_bswap__(w) : w;
+            memcpy(out + (order > 0 ? count - 1 - i : i) * size, &w, size);
+        }
+    } else {
+        const size_t word_bits = 8 * size - nails;
+
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t *word = out + (order > 0 ? count - 1 - i : i) * size;
+
+            for (size_t b = 0; b < size; ++b) {
+                const size_t low = 8 * b;
+                const unsigned bits = low < word_bits ? (unsigned)min(word_bits - low, 8) : 0;
+                word[endian > 0 ? size - 1 - b : b] = (uint8_t)(bits
+                    ? sn_get_bits__(num, i * word_bits + low, bits) : 0);
+            }
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Set `res`, or a new number if it is NULL, to the `count` words at `src` in
+ * the given format, see above. The nails are ignored.
+ */
+SN *sn_import(SN *res, size_t count, int order, size_t size, int endian, size_t nails,
+        const void * const src) {
+    assert((src || count == 0) && size > 0 && nails < 8 * size);
+    assert((order == 1 || order == -1) && endian >= -1 && endian <= 1);
+
+    const size_t word_bits = 8 * size - nails;
+    const size_t new_size  = max((count * word_bits + SN_WORD_BITS - 1) / SN_WORD_BITS, 1);
+    const uint8_t *in = src;
+
+    SN *num = res ? res : sn_new();
+    if (!num) {
+        return NULL;
+    }
+    if (!sn_resize__(num, new_size)) {
+        if (!res) {
+            sn_free(num);
+        }
+        return NULL;
+    }
+
+    endian = endian ? endian : sn_host_endian__();
+
+    if (nails == 0 && order == endian) {
+        sn_import_bytes__(num, in, count * size, order > 0);
+    } else if (nails == 0 && size == sizeof(sn_word)) {
+        const bool swap = endian != sn_host_endian__();
+
+        for (size_t i = 0; i < count; ++i) {
+            sn_word w;
+            memcpy(&w, in + (order > 0 ? count - 1 - i : i) * size, size);
+            num->blocks[i] = swap ? sn_bswap__(w) : w;
+        }
+        memset(num->blocks + count, 0, (new_size - count) * sizeof(*num->blocks));
+    } else {
+        memset(num->blocks, 0, new_size * sizeof(*num->blocks));
+
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t *word = in + (order > 0 ? count - 1 - i : i) * size;
+
+            for (size_t b = 0; b * 8 < word_bits; ++b) {
+                const unsigned bits = (unsigned)min(word_bits - 8 * b, 8);
+                const sn_word byte = word[endian > 0 ? size - 1 - b : b] & ((1u << bits) - 1);
+                const size_t pos = i * word_bits + 8 * b, j = pos / SN_WORD_BITS;
+                const unsigned shift = pos % SN_WORD_BITS;
+
+                num->blocks[j] |= byte << shift;
+                if (shift + bits > SN_WORD_BITS) {
+                    num->blocks[j + 1] |= byte >> (SN_WORD_BITS - shift);
+                }
+            }
+        }
+    }
+
+    num->neg = false;
+    sn_normalize__(num);
+
+    return num;
+}
+
+/**
+ * Store the magnitude of `num` at `dst` in big-endian order, without leading
+ * zero bytes, and return the number of bytes written, i.e. sn_num_bytes().
+ */
+size_t sn_sn2bin(const SN *num, uint8_t * const dst) {
+    assert(num && dst);
+
+    return sn_export(dst, 1, 1, 1, 0, num);
+}
+
+SN *sn_bin2sn(const uint8_t *src, size_t length, SN *res) {
+    assert(src && length > 0);
+
+    return sn_import(res, length, 1, 1, 1, 0, src);
+}
+
+/*
+ * Character strings in any radix from 2 to 36, with digits beyond 9 written
+ * as lowercase letters. Radixes that are powers of two map every digit to a
+ * fixed group of bits. Other radixes work in chunks of as many digits as fit
+ * into a block, e.g. 19 decimal digits for 64-bit blocks, which is quadratic;
+ * from SN_THRESHOLD_STR_DC blocks on, the value is split in two around a power
+ * of the chunk base B^(2^i), and the halves are converted recursively. The
+ * powers B, B^2, B^4, ... are computed once per conversion.
+ */
+
+static const char sn_digits__[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+/** log2(`radix`) for a power of two, otherwise 0 */
+static unsigned sn_radix_bits__(unsigned radix) {
+    return radix & (radix - 1) ? 0 : SN_WORD_BITS - 1 - sn_clz__(radix);
+}
+
+/** The largest power of `radix` that fits into a block, and its exponent */
+static sn_word sn_radix_chunk__(unsigned radix, unsigned *digits) {
+    sn_word base = radix;
+
+    *digits = 1;
+    while (base <= SN_WORD_MAX / radix) {
+        base *= radix;
+        ++*digits;
+    }
+
+    return base;
+}
+
+/** The value of the digit `c`, or 36 if it is none */
+static unsigned sn_digit_value__(char c) {
+    if (c >= '0' && c <= '9') {
+        return (unsigned)(c - '0');
+    }
+    if (c >= 'a' && c <= 'z') {
+        return (unsigned)(c - 'a') + 10;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return (unsigned)(c - 'A') + 10;
+    }
+
+    return 36;
+}
+
+/**
+ * Fill `pows` with B^(2^i) for the chunk base B of `radix` and `digits` with
+ * the number of digits each of them stands for, as long as the powers have
+ * at most half of `n` blocks. Store their number in `count`. On failure the
+ * powers computed so far are freed.
+ */
+static bool sn_radix_powers__(SN *pows[], size_t digits[], size_t *count, unsigned radix,
+        size_t n) {
+    unsigned chunk_digits;
+    const sn_word base = sn_radix_chunk__(radix, &chunk_digits);
+
+    *count = 0;
+    do {
+        SN *pow = sn_new();
+        if (!pow || (*count == 0 ? !sn_resize__(pow, 1)
+                                 : !sn_sqr(pow, pows[*count - 1]))) {
+            if (pow) {
+                sn_free(pow);
+            }
+            while (*count > 0) {
+                sn_free(pows[--*count]);
+            }
+            return false;
+        }
+        if (*count == 0) {
+            pow->blocks[0] = base;
+        }
+
+        digits[*count] = *count == 0 ? chunk_digits : 2 * digits[*count - 1];
+        pows[(*count)++] = pow;
+    } while (2 * pows[*count - 1]->size <= n);
+
+    return true;
+}
+
+/** Write the `len` lowest digits of `num` to `dst`, in a power of two radix */
+static void sn_to_str_pow2__(char *dst, size_t len, const SN *num, unsigned radix) {
+    const unsigned bits = sn_radix_bits__(radix);
+
+    for (size_t i = 0; i < len; ++i) {
+        dst[len - 1 - i] = sn_digits__[sn_get_bits__(num, i * bits, bits)];
+    }
+}
+
+/**
+ * Write `num` < `radix`^`len` to `dst` as exactly `len` digits, with leading
+ * zeros, by repeated division by the chunk base.
+ */
+static bool sn_to_str_basecase__(char *dst, size_t len, const SN *num, unsigned radix) {
+    unsigned chunk_digits;
+    const sn_word base = sn_radix_chunk__(radix, &chunk_digits);
+
+    size_t n = num->size;
+    sn_word *tp = sn_tmp_alloc__(n);
+    if (!tp) {
+        return false;
+    }
+    memcpy(tp, num->blocks, n * sizeof(*tp));
+
+    while (len > 0) {
+        sn_word chunk = 0;
+        if (n > 1 || tp[0]) {
+            chunk = sn_divrem_1__(tp, tp, n, base);
+            n -= n > 1 && tp[n - 1] == 0;
+        }
+
+        for (unsigned i = 0; i < chunk_digits && len > 0; ++i) {
+            dst[--len] = sn_digits__[chunk % radix];
+            chunk /= radix;
+        }
+    }
+
+    sn_tmp_free__(tp, num->size);
+
+    return true;
+}
+
+/**
+ * Write `num` < `radix`^`len` to `dst` as exactly `len` digits, splitting it
+ * around the largest of the first `count` powers that has at most half of its
+ * blocks.
+ */
+static bool sn_to_str_dc__(char *dst, size_t len, const SN *num, unsigned radix,
+        SN * const pows[], const size_t digits[], size_t count) {
+    while (count > 0 && (2 * pows[count - 1]->size > num->size + 1
+                         || digits[count - 1] >= len)) {
+        --count;
+    }
+
+    if (count == 0 || num->size < sn_thresholds__[SN_THRESHOLD_STR_DC]) {
+        return sn_to_str_basecase__(dst, len, num, radix);
+    }
+
+    const size_t low = digits[count - 1];
+    SN q, r;
+    sn_init(&q);
+    sn_init(&r);
+
+    bool ok = sn_divmod(&q, &r, num, pows[count - 1])
+        && sn_to_str_dc__(dst, len - low, &q, radix, pows, digits, count - 1)
+        && sn_to_str_dc__(dst + len - low, low, &r, radix, pows, digits, count - 1);
+
+    sn_release(&q);
+    sn_release(&r);
+
+    return ok;
+}
+
+/**
+ * Upper bound on the length of the string sn_to_str() writes for `num` in
+ * `radix`, including the sign and the terminating null character.
+ */
+size_t sn_str_size(const SN *num, unsigned radix) {
+    assert(num && radix >= 2 && radix <= 36);
+
+    const size_t bits = sn_num_bits(num);
+    size_t len;
+
+    if (sn_radix_bits__(radix)) {
+        len = (bits + sn_radix_bits__(radix) - 1) / sn_radix_bits__(radix);
+    } else {
+        /* Every chunk of `chunk_digits` digits takes at least log2(base) bits */
+        unsigned chunk_digits;
+        const sn_word base = sn_radix_chunk__(radix, &chunk_digits);
+        const size_t chunk_bits = SN_WORD_BITS - 1 - sn_clz__(base);
+
+        len = (bits + chunk_bits - 1) / chunk_bits * chunk_digits;
+    }
+
+    return max(len, 1) + 2;
+}
+
+/**
+ * Write `num` to `dst` in `radix` from 2 to 36, with a leading minus sign if
+ * it is negative and a terminating null character, and return its length
+ * without the latter. `dst` must have room for sn_str_size() characters.
+ * Returns 0 if memory runs out.
+ */
+size_t sn_to_str(const SN *num, unsigned radix, char * const dst) {
+    assert(num && dst && sn_valid__(num) && radix >= 2 && radix <= 36);
+
+    char *digits = dst + (num->neg ? 1 : 0);
+    size_t len = sn_str_size(num, radix) - 2;
+
+    if (sn_radix_bits__(radix)) {
+        sn_to_str_pow2__(digits, len, num, radix);
+    } else if (num->size < sn_thresholds__[SN_THRESHOLD_STR_DC]) {
+        if (!sn_to_str_basecase__(digits, len, num, radix)) {
+            return 0;
+        }
+    } else {
+        SN *pows[SN_WORD_BITS];
+        size_t pow_digits[SN_WORD_BITS], count;
+
+        if (!sn_radix_powers__(pows, pow_digits, &count, radix, num->size)) {
+            return 0;
+        }
+
+        bool ok = sn_to_str_dc__(digits, len, num, radix, pows, pow_digits, count);
+        while (count > 0) {
+            sn_free(pows[--count]);
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+
+    /* The length was an upper bound; drop the leading zeros */
+    size_t zeros = 0;
+    while (zeros + 1 < len && digits[zeros] == '0') {
+        ++zeros;
+    }
+    memmove(digits, digits + zeros, len - zeros);
+    len -= zeros;
+
+    if (num->neg) {
+        dst[0] = '-';
+        ++len;
+    }
+    dst[len] = '\0';
+
+    return len;
+}
+
+/** Set `res` to the `len` digits at `str` in a power of two radix */
+static void sn_from_str_pow2__(SN * const res, const char *str, size_t len, unsigned radix) {
+    const unsigned bits = sn_radix_bits__(radix);
+
+    memset(res->blocks, 0, res->size * sizeof(*res->blocks));
+    for (size_t i = 0; i < len; ++i) {
+        const sn_word d = sn_digit_value__(str[len - 1 - i]);
+        const size_t bit = i * bits, j = bit / SN_WORD_BITS;
+        const unsigned shift = bit % SN_WORD_BITS;
+
+        res->blocks[j] |= d << shift;
+        if (shift + bits > SN_WORD_BITS) {
+            res->blocks[j + 1] |= d >> (SN_WORD_BITS - shift);
+        }
+    }
+}
+
+/** Set `res` to the `len` digits at `str`, a chunk at a time */
+static SN *sn_from_str_basecase__(SN * const res, const char *str, size_t len,
+        unsigned radix) {
+    unsigned chunk_digits;
+    const sn_word base = sn_radix_chunk__(radix, &chunk_digits);
+
+    if (!sn_resize__(res, len / chunk_digits + 1)) {
+        return NULL;
+    }
+
+    size_t n = 1;
+    res->blocks[0] = 0;
+
+    /* The first chunk takes the digits in excess of whole chunks */
+    for (size_t i = 0, take = (len - 1) % chunk_digits + 1; i < len;
+            i += take, take = chunk_digits) {
+        sn_word chunk = 0, scale = 1;
+        for (size_t j = 0; j < take; ++j) {
+            chunk = chunk * radix + sn_digit_value__(str[i + j]);
+            scale *= radix;
+        }
+
+        sn_word carry = sn_mul_1__(res->blocks, res->blocks, n, take == chunk_digits ? base
+                                                                                     : scale);
+        carry += sn_add_1__(res->blocks, res->blocks, n, chunk);
+        if (carry) {
+            res->blocks[n++] = carry;
+        }
+    }
+
+    res->size = n;
+    res->neg  = false;
+    sn_normalize__(res);
+
+    return res;
+}
+
+/**
+ * Set `res` to the `len` digits at `str` as hi B^(2^i) + lo, where `lo` takes
+ * the digits of the largest of the first `count` powers shorter than `str`.
+ */
+static SN *sn_from_str_dc__(SN * const res, const char *str, size_t len, unsigned radix,
+        SN * const pows[], const size_t digits[], size_t count) {
+    while (count > 0 && digits[count - 1] >= len) {
+        --count;
+    }
+
+    if (count == 0 || len < sn_thresholds__[SN_THRESHOLD_STR_DC] * digits[0]) {
+        return sn_from_str_basecase__(res, str, len, radix);
+    }
+
+    const size_t low = digits[count - 1];
+    SN lo;
+    sn_init(&lo);
+
+    SN *ok = sn_from_str_dc__(res, str, len - low, radix, pows, digits, count - 1);
+    ok = ok ? sn_from_str_dc__(&lo, str + len - low, low, radix, pows, digits, count - 1) : NULL;
+    ok = ok ? sn_mul(res, res, pows[count - 1]) : NULL;
+    ok = ok ? sn_add(res, res, &lo) : NULL;
+
+    sn_release(&lo);
+
+    return ok;
+}
+
+/**
+ * Parse the null-terminated string `str` of digits in `radix` from 2 to 36,
+ * with an optional leading sign and in either case, into `res`, or into a new
+ * number if `res` is NULL. Returns NULL if `str` holds no digits or anything
+ * but digits after the sign, or if memory runs out.
+ */
+SN *sn_from_str(const char *str, unsigned radix, SN *res) {
+    assert(str && radix >= 2 && radix <= 36);
+
+    const bool neg = *str == '-';
+    if (*str == '-' || *str == '+') {
+        ++str;
+    }
+
+    const size_t len = strlen(str);
+    if (len == 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (sn_digit_value__(str[i]) >= radix) {
+            return NULL;
+        }
+    }
+
+    SN *num = res ? res : sn_new();
+    if (!num) {
+        return NULL;
+    }
+
+    SN *ok = num;
+    if (sn_radix_bits__(radix)) {
+        const size_t bits = len * sn_radix_bits__(radix);
+        ok = sn_resize__(num, (bits + SN_WORD_BITS - 1) / SN_WORD_BITS);
+        if (ok) {
+            sn_from_str_pow2__(num, str, len, radix);
+            num->neg = false;
+            sn_normalize__(num);
+        }
+    } else {
+        unsigned chunk_digits;
+        sn_radix_chunk__(radix, &chunk_digits);
+
+        if (len < sn_thresholds__[SN_THRESHOLD_STR_DC] * chunk_digits) {
+            ok = sn_from_str_basecase__(num, str, len, radix);
+        } else {
+            SN *pows[SN_WORD_BITS];
+            size_t pow_digits[SN_WORD_BITS], count;
+
+            /* The powers only need to reach half of the value */
+            ok = sn_radix_powers__(pows, pow_digits, &count, radix, len / chunk_digits + 1)
+                ? sn_from_str_dc__(num, str, len, radix, pows, pow_digits, count) : NULL;
+            while (count > 0) {
+                sn_free(pows[--count]);
+            }
+        }
+    }
+
+    if (!ok) {
+        if (!res) {
+            sn_free(num);
+        }
+        return NULL;
+    }
+
+    num->neg = neg && !sn_is_zero(num);
+
+    return num;
+}
+
+/* **********************************************************************************
+ * Serialization
+ *
+ * A stream starts with an 8-byte header, the magic "SNUM", a version byte and
+ * a flags byte, and continues with one record per number: an unsigned LEB128
+ * varint holding the number of magnitude bytes shifted left by one, with the
+ * sign in the low bit, followed by the magnitude in little-endian byte order.
+ * Zero has no magnitude bytes.
+ *
+ * Streams written with SN_STREAM_ALIGNED pad every record with zeros after the
+ * varint and after the magnitude to offsets that are multiples of 8 bytes. Its
+ * bytes are then a valid array of little-endian blocks of either width, which
+ * sn_stream_view() can hand out as views of a memory-mapped file.
+ */
+
+#define SN_STREAM_MAGIC "SNUM"
+#define SN_STREAM_VERSION 1
+#define SN_STREAM_HEADER 8
+#define SN_STREAM_ALIGN 8
+#define SN_STREAM_BUFFER (1 << 16)
+
+struct sn_writer {
+    FILE    *file;   /**< Destination, or NULL for `fd` */
+    int      fd;
+    unsigned flags;
+    uint64_t offset; /**< Bytes written to the stream so far */
+    size_t   used;   /**< Bytes waiting in `buffer` */
+    uint8_t  buffer[SN_STREAM_BUFFER];
+};
+
+struct sn_reader {
+    FILE    *file;   /**< Source, or NULL for `fd` */
+    int      fd;
+    unsigned flags;
+    uint64_t offset; /**< Bytes consumed from the stream so far */
+    size_t   pos, len; /**< Unconsumed bytes in `buffer` */
+    bool     error;
+    uint8_t  buffer[SN_STREAM_BUFFER];
+};
+
+/** Write `value` at `dst` as an unsigned LEB128 varint and return its length */
+static size_t sn_varint_encode__(uint8_t *dst, uint64_t value) {
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        dst[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    dst[n++] = (uint8_t)value;
+
+    return n;
+}
+
+/** Zero bytes from `offset` up to the next aligned offset */
+static size_t sn_stream_padding__(uint64_t offset) {
+    return (size_t)(-offset % SN_STREAM_ALIGN);
+}
+
+/** Pass `len` bytes at `src` through the buffer of `writer` */
+static bool sn_writer_put__(sn_writer *writer, const void *src, size_t len) {
+    const uint8_t *bytes = src;
+
+    while (len > 0) {
+        if (writer->used == SN_STREAM_BUFFER && !sn_writer_flush(writer)) {
+            return false;
+        }
+
+        const size_t n = min(len, SN_STREAM_BUFFER - writer->used);
+        memcpy(writer->buffer + writer->used, bytes, n);
+        writer->used   += n;
+        writer->offset += n;
+        bytes += n;
+        len   -= n;
+    }
+
+    return true;
+}
+
+static sn_writer *sn_writer_start__(FILE *file, int fd, unsigned flags) {
+    sn_writer *writer = sn_mem_alloc__(sizeof(*writer));
+    if (!writer) {
+        return NULL;
+    }
+
+    writer->file   = file;
+    writer->fd     = fd;
+    writer->flags  = flags;
+    writer->offset = 0;
+    writer->used   = 0;
+
+    const uint8_t header[SN_STREAM_HEADER] = {
+        SN_STREAM_MAGIC[0], SN_STREAM_MAGIC[1], SN_STREAM_MAGIC[2], SN_STREAM_MAGIC[3],
+        SN_STREAM_VERSION, (uint8_t)flags, 0, 0
+    };
+    sn_writer_put__(writer, header, sizeof(header));
+
+    return writer;
+}
+
+/**
+ * Start a stream of numbers on `file`, with `flags` from sn_stream_flags.
+ * Nothing reaches the file before sn_writer_flush() or sn_writer_free().
+ */
+sn_writer *sn_writer_new(FILE *file, unsigned flags) {
+    assert(file && !(flags & ~SN_STREAM_ALIGNED));
+
+    return sn_writer_start__(file, -1, flags);
+}
+
+/** Write out the buffered bytes. Returns false on an I/O error. */
+bool sn_writer_flush(sn_writer *writer) {
+    assert(writer);
+
+    const uint8_t *bytes = writer->buffer;
+    size_t len = writer->used;
+
+    writer->used = 0;
+
+    if (writer->file) {
+        return fwrite(bytes, 1, len, writer->file) == len;
+    }
+
+#if SN_FD_STREAMS
+    while (len > 0) {
+        const ssize_t n = write(writer->fd, bytes, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        len   -= (size_t)n;
+    }
+#endif // SN_FD_STREAMS
+
+    return true;
+}
+
+/**
+ * Flush and free `writer`, but leave the file open. Returns false if the
+ * last bytes could not be written.
+ */
+bool sn_writer_free(sn_writer *writer) {
+    if (!writer) {
+        return true;
+    }
+
+    const bool ok = sn_writer_flush(writer);
+    sn_mem_free__(writer, sizeof(*writer));
+
+    return ok;
+}
+
+/** Append `num` to the stream. Returns false on an I/O error. */
+bool sn_write(sn_writer *writer, const SN *num) {
+    assert(writer && num && sn_valid__(num));
+
+    const size_t length = sn_num_bytes(num);
+    const bool aligned = writer->flags & SN_STREAM_ALIGNED;
+    static const uint8_t zeros[SN_STREAM_ALIGN];
+    uint8_t header[10];
+
+    const size_t header_len = sn_varint_encode__(header,
+            (uint64_t)length << 1 | (num->neg && length > 0));
+    if (!sn_writer_put__(writer, header, header_len)
+            || (aligned && !sn_writer_put__(writer, zeros, sn_stream_padding__(writer->offset)))) {
+        return false;
+    }
+
+    /* Whole blocks in little-endian order, then what is left of the top one */
+    const size_t word_bytes = sizeof(sn_word), whole = length / word_bytes;
+    const bool swap = sn_host_endian__() > 0;
+
+    for (size_t j = 0; j < whole; ++j) {
+        const sn_word w = swap ? sn_bswap__(num->blocks[j]) : num->blocks[j];
+        if (!sn_writer_put__(writer, &w, word_bytes)) {
+            return false;
+        }
+    }
+    if (whole * word_bytes < length) {
+        uint8_t top[sizeof(sn_word)];
+        for (size_t i = 0; i < length - whole * word_bytes; ++i) {
+            top[i] = (uint8_t)(num->blocks[whole] >> (8 * i));
+        }
+        if (!sn_writer_put__(writer, top, length - whole * word_bytes)) {
+            return false;
+        }
+    }
+
+    return !aligned || sn_writer_put__(writer, zeros, sn_stream_padding__(writer->offset));
+}
+
+/** Refill the empty buffer of `reader`; false at the end of the stream */
+static bool sn_reader_fill__(sn_reader *reader) {
+    size_t n = 0;
+
+    if (reader->file) {
+        n = fread(reader->buffer, 1, SN_STREAM_BUFFER, reader->file);
+        reader->error |= ferror(reader->file) != 0;
+    }
+#if SN_FD_STREAMS
+    else {
+        ssize_t got;
+        do {
+            got = read(reader->fd, reader->buffer, SN_STREAM_BUFFER);
+        } while (got < 0 && errno == EINTR);
+        reader->error |= got < 0;
+        n = got > 0 ? (size_t)got : 0;
+    }
+#endif // SN_FD_STREAMS
+
+    reader->pos = 0;
+    reader->len = n;
+
+    return n > 0;
+}
+
+/** Take `len` bytes from the stream into `dst`, or skip them if it is NULL */
+static bool sn_reader_get__(sn_reader *reader, void *dst, size_t len) {
+    uint8_t *bytes = dst;
+
+    while (len > 0) {
+        if (reader->pos == reader->len && !sn_reader_fill__(reader)) {
+            return false;
+        }
+
+        const size_t n = min(len, reader->len - reader->pos);
+        if (bytes) {
+            memcpy(bytes, reader->buffer + reader->pos, n);
+            bytes += n;
+        }
+        reader->pos    += n;
+        reader->offset += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static sn_reader *sn_reader_start__(FILE *file, int fd) {
+    sn_reader *reader = sn_mem_alloc__(sizeof(*reader));
+    if (!reader) {
+        return NULL;
+    }
+
+    reader->file   = file;
+    reader->fd     = fd;
+    reader->offset = 0;
+    reader->pos    = reader->len = 0;
+    reader->error  = false;
+
+    uint8_t header[SN_STREAM_HEADER];
+    if (!sn_reader_get__(reader, header, sizeof(header))
+            || memcmp(header, SN_STREAM_MAGIC, 4) != 0 || header[4] != SN_STREAM_VERSION
+            || (header[5] & ~SN_STREAM_ALIGNED)) {
+        sn_mem_free__(reader, sizeof(*reader));
+        return NULL;
+    }
+    reader->flags = header[5];
+
+    return reader;
+}
+
+/**
+ * Start reading a stream of numbers from `file`. Returns NULL if it does not
+ * start with a valid header.
+ */
+sn_reader *sn_reader_new(FILE *file) {
+    assert(file);
+
+    return sn_reader_start__(file, -1);
+}
+
+void sn_reader_free(sn_reader *reader) {
+    if (reader) {
+        sn_mem_free__(reader, sizeof(*reader));
+    }
+}
+
+/** Whether reading failed because of an I/O error or a malformed stream */
+bool sn_reader_error(const sn_reader *reader) {
+    assert(reader);
+
+    return reader->error;
+}
+
+/**
+ * Read the next number of the stream into `res`, or into a new number if it
+ * is NULL. Returns NULL at the end of the stream and on errors, which
+ * sn_reader_error() tells apart.
+ */
+SN *sn_read(sn_reader *reader, SN *res) {
+    assert(reader);
+
+    /* The header varint; the stream may only end before its first byte */
+    uint64_t header = 0;
+    uint8_t byte;
+    for (unsigned shift = 0;; shift += 7) {
+        if (!sn_reader_get__(reader, &byte, 1)) {
+            reader->error |= shift > 0;
+            return NULL;
+        }
+        if (shift > 63 || (shift == 63 && byte > 1)) {
+            reader->error = true;
+            return NULL;
+        }
+        header |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+
+    const uint64_t length = header >> 1;
+    const size_t word_bytes = sizeof(sn_word);
+    const bool aligned = reader->flags & SN_STREAM_ALIGNED;
+
+    if (length > SIZE_MAX - word_bytes
+            || (aligned && !sn_reader_get__(reader, NULL, sn_stream_padding__(reader->offset)))) {
+        reader->error = true;
+        return NULL;
+    }
+
+    SN *num = res ? res : sn_new();
+    bool ok = num && sn_resize__(num, 1);
+    if (ok) {
+        num->blocks[0] = 0;
+    }
+
+    /* Read the bytes straight into the blocks and put them in order after.
+     * The number only grows by a buffer at a time as the bytes arrive, so
+     * that a corrupt length cannot make it allocate more than the stream
+     * holds. Every chunk but the last is a whole number of blocks. */
+    for (size_t got = 0; ok && got < length;) {
+        const size_t n = (size_t)min(length - got, SN_STREAM_BUFFER);
+        const size_t words = (got + n + word_bytes - 1) / word_bytes;
+
+        ok = sn_resize__(num, words);
+        if (ok) {
+            num->blocks[words - 1] = 0;
+            ok = sn_reader_get__(reader, (uint8_t *)num->blocks + got, n);
+        }
+        got += n;
+    }
+
+    if (!ok || (aligned && !sn_reader_get__(reader, NULL, sn_stream_padding__(reader->offset)))) {
+        if (num && !res) {
+            sn_free(num);
+        }
+        reader->error = true;
+        return NULL;
+    }
+    if (sn_host_endian__() > 0) {
+        for (size_t j = 0; j < num->size; ++j) {
+            num->blocks[j] = sn_bswap__(num->blocks[j]);
+        }
+    }
+
+    num->neg = header & 1;
+    sn_normalize__(num);
+
+    return num;
+}
+
+/**
+ * Make `view` a zero-copy view of the number at offset `*pos` of the aligned
+ * stream of `length` bytes at `data`, such as a memory-mapped file, and
+ * advance `*pos` to the next one. Start with `*pos` = 0 to check the header.
+ * `data` must be aligned to 8 bytes. Returns NULL at the end of the stream,
+ * if it is malformed or not aligned, or on big-endian hosts.
+ */
+SN *sn_stream_view(SN * const view, const void *data, size_t length, size_t *pos) {
+    assert(view && data && pos && (uintptr_t)data % SN_STREAM_ALIGN == 0);
+
+    const uint8_t *bytes = data;
+
+    if (sn_host_endian__() > 0) {
+        return NULL;
+    }
+
+    if (*pos == 0) {
+        if (length < SN_STREAM_HEADER || memcmp(bytes, SN_STREAM_MAGIC, 4) != 0
+                || bytes[4] != SN_STREAM_VERSION || bytes[5] != SN_STREAM_ALIGNED) {
+            return NULL;
+        }
+        *pos = SN_STREAM_HEADER;
+    }
+
+    uint64_t header = 0;
+    size_t at = *pos;
+    for (unsigned shift = 0;; shift += 7) {
+        if (at >= length || shift > 63 || (shift == 63 && bytes[at] > 1)) {
+            return NULL;
+        }
+        header |= (uint64_t)(bytes[at] & 0x7f) << shift;
+        if (!(bytes[at++] & 0x80)) {
+            break;
+        }
+    }
+
+    const uint64_t size = header >> 1;
+    const size_t varint_end = at;
+    at += sn_stream_padding__(at);
+    const uint64_t padded = size + sn_stream_padding__(size);
+    if (at > length || padded > length - at) {
+        return NULL;
+    }
+
+    /* Both paddings must be zero, as sn_write() leaves them */
+    for (size_t i = varint_end; i < at; ++i) {
+        if (bytes[i]) {
+            return NULL;
+        }
+    }
+    for (size_t i = at + (size_t)size; i < at + (size_t)padded; ++i) {
+        if (bytes[i]) {
+            return NULL;
+        }
+    }
+
+    sn_view(view, (const sn_word *)(const void *)(bytes + at), (size_t)(padded / sizeof(sn_word)));
+    view->neg = (header & 1) && !sn_is_zero(view);
+    *pos = at + (size_t)padded;
+
+    return view;
+}
+
+#if SN_FD_STREAMS
+
+/** Like sn_writer_new(), on a file descriptor */
+sn_writer *sn_writer_fd(int fd, unsigned flags) {
+    assert(fd >= 0 && !(flags & ~SN_STREAM_ALIGNED));
+
+    return sn_writer_start__(NULL, fd, flags);
+}
+
+/** Like sn_reader_new(), on a file descriptor */
+sn_reader *sn_reader_fd(int fd) {
+    assert(fd >= 0);
+
+    return sn_reader_start__(NULL, fd);
+}
+
+#endif // SN_FD_STREAMS
+
 /* vim: set et sw=4: */
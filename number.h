@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #ifndef max
 #define max(a, b) ((a) > (b) ? (a) : (b))
@@ -13,7 +14,37 @@
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #endif // !defined max
 
+/**
+ * Width of a single block (limb) in bits. Either 32 or 64; the 64-bit variant
+ * requires a compiler with `unsigned __int128` for double-word arithmetic.
+ * Every translation unit including this header must agree on the value.
+ */
+#ifndef SN_WORD_BITS
+#  if defined(__SIZEOF_INT128__)
+#    define SN_WORD_BITS 64
+#  else
+#    define SN_WORD_BITS 32
+#  endif
+#endif // !defined SN_WORD_BITS
+
+#if SN_WORD_BITS == 64
+typedef uint64_t sn_word;
+#  define SN_WORD_MAX UINT64_MAX
+#elif SN_WORD_BITS == 32
 typedef uint32_t sn_word;
+#  define SN_WORD_MAX UINT32_MAX
+#else
+#  error "SN_WORD_BITS must be either 32 or 64"
+#endif // SN_WORD_BITS
+
+/**
+ * Number of blocks stored inside every number, so that small values such as
+ * counters and exponents need no heap allocation. Like SN_WORD_BITS, every
+ * translation unit must agree on the value.
+ */
+#ifndef SN_INLINE_BLOCKS
+#  define SN_INLINE_BLOCKS (128 / SN_WORD_BITS)
+#endif // !defined SN_INLINE_BLOCKS
 
 /**
  * The allocated number blocks (words) are stored as arrays in little-endian order,
@@ -22,6 +53,21 @@ typedef uint32_t sn_word;
  * and`W` denotes the word size in bits. The endianness of the words themselves
  * depends on the machine.
  *
+ * Only the first `size` blocks are part of the number. Every number produced
+ * by the library is normalized: its top block is nonzero, except for zero,
+ * which is a single zero block and never negative. Operands set up by hand
+ * may still carry leading zero blocks.
+ *
+ * The array may hold up to `capacity` blocks, so that results can grow
+ * without reallocating; it is only shrunk by sn_shrink_to_fit(). Values of up
+ * to SN_INLINE_BLOCKS blocks live in `small` and `blocks` points there; larger
+ * ones move to the heap. Numbers must therefore be copied with sn_copy() or
+ * sn_swap() rather than by assignment.
+ *
+ * A view, set up with sn_view(), borrows its blocks from the caller instead,
+ * e.g. from a memory-mapped file, and never writes or frees them. It can be
+ * passed wherever a number is read.
+ *
  * ```
  * +---------------+---------------+--
  * |   :   :   :   |   :   :   :   | ...
@@ -33,8 +79,11 @@ typedef uint32_t sn_word;
  */
 typedef struct smallnum {
     sn_word *blocks; /**< Pointer to the beginning of an array of allocated blocks */
-    size_t   size; /**< Number of allocated blocks */
+    size_t   size; /**< Number of blocks in use */
     bool     neg; /**< Negative number flag */
+    bool     view; /**< The blocks are borrowed and read-only */
+    size_t   capacity; /**< Number of allocated blocks; 0 means exactly `size` */
+    sn_word  small[SN_INLINE_BLOCKS]; /**< Inline storage for small values */
 } SN;
 /*@ type invariant number_size_is_positive(SN a) = a.size > 0; */
 
@@ -43,14 +92,51 @@ typedef struct smallnum {
  */
 SN *sn_init(SN * const);
 SN *sn_new(void);
+SN *sn_view(SN * const, const sn_word *, size_t);
+bool sn_is_view(const SN *);
 SN *sn_copy(SN * const restrict, const SN * restrict);
 SN *sn_duplicate(const SN *);
 void sn_swap(SN * const restrict, SN * const restrict);
+void sn_release(SN * const);
 void sn_free(SN *);
 void sn_clear(SN * const);
 void sn_clear_free(SN * const);
 void sn_zero(SN * const);
 void sn_one(SN * const);
+SN *sn_reserve(SN * const, size_t);
+SN *sn_shrink_to_fit(SN * const);
+size_t sn_capacity(const SN *);
+/* @} */
+
+/** @defgroup alloc Memory management
+ *
+ * All memory is obtained through a process-wide allocator, which defaults to
+ * malloc(), realloc() and free(). A replacement must be installed before any
+ * number is created, since blocks are always returned to the allocator that
+ * is current when they are freed.
+ *
+ * The scratch space of a single operation can instead come from a context:
+ * while a context is in use by a thread, temporaries are carved out of its
+ * arena and stay there until sn_ctx_reset(), so that a long computation stops
+ * going through the allocator. Results never live in the arena.
+ * @{
+ */
+typedef struct sn_allocator {
+    void *(*alloc)(void *state, size_t size);
+    void *(*realloc)(void *state, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *state, void *ptr, size_t size);
+    void *state; /**< Passed to every call, e.g. a pool to allocate from */
+} sn_allocator;
+
+void sn_set_allocator(const sn_allocator *);
+void sn_get_allocator(sn_allocator *);
+
+typedef struct sn_ctx sn_ctx;
+
+sn_ctx *sn_ctx_new(size_t);
+void sn_ctx_free(sn_ctx *);
+void sn_ctx_reset(sn_ctx *);
+sn_ctx *sn_ctx_use(sn_ctx *);
 /* @} */
 
 /** @defgroup cmp Comparisons and tests
@@ -76,9 +162,185 @@ size_t sn_num_bits(const SN *);
 /** @defgroup arith Basic arithmetic
  * @{
  */
-SN *sn_add(SN * const restrict, const SN *, const SN *);
-SN *sn_sub(SN * const restrict, const SN *, const SN *);
-SN *sn_mul(SN * const restrict, const SN *, const SN *);
+SN *sn_add(SN * const, const SN *, const SN *);
+SN *sn_sub(SN * const, const SN *, const SN *);
+SN *sn_mul(SN * const, const SN *, const SN *);
+SN *sn_sqr(SN * const, const SN *);
+SN *sn_add_inplace(SN * const, const SN *);
+SN *sn_sub_inplace(SN * const, const SN *);
+SN *sn_mul_inplace(SN * const, const SN *);
+/* @} */
+
+/** @defgroup div Division
+ * @{
+ */
+SN *sn_divmod(SN * const, SN * const, const SN *, const SN *);
+SN *sn_div(SN * const, const SN *, const SN *);
+SN *sn_mod(SN * const, const SN *, const SN *);
+/* @} */
+
+/** @defgroup bits Shifts and bitwise operations
+ *
+ * Negative numbers behave as in two's complement with infinitely many sign
+ * bits: sn_shr() rounds towards minus infinity like an arithmetic shift, and
+ * sn_not() turns x into -x - 1.
+ * @{
+ */
+SN *sn_shl(SN * const, const SN *, size_t);
+SN *sn_shr(SN * const, const SN *, size_t);
+SN *sn_and(SN * const, const SN *, const SN *);
+SN *sn_or(SN * const, const SN *, const SN *);
+SN *sn_xor(SN * const, const SN *, const SN *);
+SN *sn_not(SN * const, const SN *);
+bool sn_testbit(const SN *, size_t);
+SN *sn_setbit(SN * const, size_t);
+SN *sn_clrbit(SN * const, size_t);
+size_t sn_popcount(const SN *);
+/* @} */
+
+/** @defgroup roots Roots
+ * @{
+ */
+SN *sn_sqrtrem(SN * const, SN * const, const SN *);
+SN *sn_sqrt(SN * const, const SN *);
+SN *sn_root(SN * const, const SN *, unsigned);
+/* @} */
+
+/** @defgroup mod Modular arithmetic
+ *
+ * A Montgomery context holds the constants for a fixed odd modulus m. Residues
+ * passed to sn_mont_mul() and sn_mont_sqr() must be in Montgomery form, i.e.
+ * a R mod m for R = 2^(W n) and an `n` block modulus, as produced by
+ * sn_mont_to(). A Barrett context caches the reciprocal of any nonzero
+ * modulus and works on ordinary residues.
+ * @{
+ */
+typedef struct sn_mont_ctx sn_mont_ctx;
+
+sn_mont_ctx *sn_mont_ctx_new(const SN *);
+void sn_mont_ctx_free(sn_mont_ctx *);
+SN *sn_mont_to(SN * const, const SN *, const sn_mont_ctx *);
+SN *sn_mont_from(SN * const, const SN *, const sn_mont_ctx *);
+SN *sn_mont_mul(SN * const, const SN *, const SN *, const sn_mont_ctx *);
+SN *sn_mont_sqr(SN * const, const SN *, const sn_mont_ctx *);
+SN *sn_powm(SN * const, const SN *, const SN *, const sn_mont_ctx *);
+bool sn_powm_batch(SN * const [], const SN * const [], const SN * const [],
+        const sn_mont_ctx * const [], size_t);
+
+typedef struct sn_barrett_ctx sn_barrett_ctx;
+
+sn_barrett_ctx *sn_barrett_ctx_new(const SN *);
+void sn_barrett_ctx_free(sn_barrett_ctx *);
+SN *sn_mod_barrett(SN * const, const SN *, const sn_barrett_ctx *);
+SN *sn_mulmod_barrett(SN * const, const SN *, const SN *, const sn_barrett_ctx *);
+/* @} */
+
+/** @defgroup numth Number theory
+ * @{
+ */
+SN *sn_gcd(SN * const, const SN *, const SN *);
+SN *sn_gcdext(SN * const, SN * const, SN * const, const SN *, const SN *);
+SN *sn_invert(SN * const, const SN *, const SN *);
+int sn_probab_prime(const SN *, unsigned);
+SN *sn_next_prime(SN * const, const SN *);
+/* @} */
+
+/** @defgroup batch Batches of equal-size numbers
+ *
+ * A batch holds many unsigned numbers of the same number of blocks in one
+ * contiguous array, interleaved block by block, and applies an operation to
+ * all of them at once. Arithmetic on batches wraps around like fixed-width
+ * unsigned integers.
+ * @{
+ */
+typedef struct sn_batch sn_batch;
+
+sn_batch *sn_batch_new(size_t, size_t);
+void sn_batch_free(sn_batch *);
+size_t sn_batch_count(const sn_batch *);
+size_t sn_batch_blocks(const sn_batch *);
+sn_batch *sn_batch_set(sn_batch * const, size_t, const SN *);
+SN *sn_batch_get(SN * const, const sn_batch *, size_t);
+sn_batch *sn_batch_add(sn_batch * const, const sn_batch *, const sn_batch *, uint8_t *);
+sn_batch *sn_batch_sub(sn_batch * const, const sn_batch *, const sn_batch *, uint8_t *);
+sn_batch *sn_batch_mul(sn_batch * const, const sn_batch *, const sn_batch *);
+void sn_batch_cmp(int8_t *, const sn_batch *, const sn_batch *);
+/* @} */
+
+/** @defgroup fixed Fixed-width numbers
+ *
+ * Unsigned integers of 256, 512, 1024 and 2048 bits held by value, for code
+ * that works at one known width such as cryptography and hashing. They never
+ * allocate and every operation runs in time independent of the values. Sums
+ * and differences wrap around and return the carry or borrow; products are
+ * split into a low and a high half, where the high half may be NULL. Results
+ * may be the same variable as an operand.
+ *
+ * A Montgomery context snN_mont_ctx holds an odd modulus m of up to N bits and
+ * R = 2^N. Residues passed to snN_mont_mul() and snN_mont_sqr() must be below
+ * m and in Montgomery form, as produced by snN_mont_to() from any value.
+ * @{
+ */
+#define SN_FIXED_BLOCKS(bits) ((bits) / SN_WORD_BITS)
+
+#define SN_FIXED_DECLARE(bits) \
+    typedef struct sn##bits { \
+        sn_word blocks[SN_FIXED_BLOCKS(bits)]; /* Little-endian, like SN */ \
+    } sn##bits; \
+    typedef struct sn##bits##_mont_ctx { \
+        sn##bits mod; \
+        sn##bits r2; /* R^2 mod m, which converts into Montgomery form */ \
+        sn_word  minv; /* -m^-1 mod 2^W */ \
+    } sn##bits##_mont_ctx; \
+    sn##bits *sn##bits##_from_sn(sn##bits * const, const SN *); \
+    SN *sn##bits##_to_sn(SN * const, const sn##bits *); \
+    int sn##bits##_cmp(const sn##bits *, const sn##bits *); \
+    sn_word sn##bits##_add(sn##bits * const, const sn##bits *, const sn##bits *); \
+    sn_word sn##bits##_sub(sn##bits * const, const sn##bits *, const sn##bits *); \
+    void sn##bits##_mul(sn##bits * const, sn##bits * const, const sn##bits *, \
+            const sn##bits *); \
+    void sn##bits##_sqr(sn##bits * const, sn##bits * const, const sn##bits *); \
+    sn##bits##_mont_ctx *sn##bits##_mont_init(sn##bits##_mont_ctx * const, \
+            const sn##bits *); \
+    sn##bits *sn##bits##_mont_to(sn##bits * const, const sn##bits *, \
+            const sn##bits##_mont_ctx *); \
+    sn##bits *sn##bits##_mont_from(sn##bits * const, const sn##bits *, \
+            const sn##bits##_mont_ctx *); \
+    sn##bits *sn##bits##_mont_mul(sn##bits * const, const sn##bits *, const sn##bits *, \
+            const sn##bits##_mont_ctx *); \
+    sn##bits *sn##bits##_mont_sqr(sn##bits * const, const sn##bits *, \
+            const sn##bits##_mont_ctx *);
+
+SN_FIXED_DECLARE(256)
+SN_FIXED_DECLARE(512)
+SN_FIXED_DECLARE(1024)
+SN_FIXED_DECLARE(2048)
+/* @} */
+
+/** @defgroup tune Algorithm selection thresholds
+ *
+ * Sizes, in blocks, at which the library switches to an asymptotically faster
+ * algorithm. The defaults can be overridden at build time by defining the
+ * corresponding `SN_*_THRESHOLD` macro when compiling number.c, or at run time
+ * with sn_set_threshold(). Changing a threshold is not thread-safe.
+ * @{
+ */
+typedef enum sn_threshold {
+    SN_THRESHOLD_MUL_KARATSUBA, /**< Smallest operand using Karatsuba multiplication */
+    SN_THRESHOLD_MUL_TOOM3,     /**< Smallest operand using Toom-Cook 3-way multiplication */
+    SN_THRESHOLD_MUL_NTT,       /**< Smallest operand using number theoretic transforms */
+    SN_THRESHOLD_SQR_KARATSUBA, /**< Smallest operand using Karatsuba squaring */
+    SN_THRESHOLD_SQR_TOOM3,     /**< Smallest operand using Toom-Cook 3-way squaring */
+    SN_THRESHOLD_SQR_NTT,       /**< Smallest operand squared through transforms */
+    SN_THRESHOLD_DIV_BZ,        /**< Smallest divisor and quotient split by Burnikel-Ziegler */
+    SN_THRESHOLD_STR_DC,        /**< Smallest number converted by divide and conquer */
+    SN_THRESHOLD_GCD_LEHMER,    /**< Smallest operand reduced by Lehmer steps */
+    SN_THRESHOLD_GCD_HGCD,      /**< Smallest operand reduced by half-GCD */
+    SN_THRESHOLD_COUNT
+} sn_threshold;
+
+size_t sn_get_threshold(sn_threshold);
+void sn_set_threshold(sn_threshold, size_t);
 /* @} */
 
 /** @defgroup conv Conversion from/to byte strings and character strings
@@ -86,6 +348,54 @@ SN *sn_mul(SN * const restrict, const SN *, const SN *);
  */
 size_t sn_sn2bin(const SN *, uint8_t * const);
 SN *sn_bin2sn(const uint8_t *, size_t, SN *);
+size_t sn_export_size(const SN *, size_t, size_t);
+size_t sn_export(void * const, int, size_t, int, size_t, const SN *);
+SN *sn_import(SN *, size_t, int, size_t, int, size_t, const void * const);
+size_t sn_str_size(const SN *, unsigned);
+size_t sn_to_str(const SN *, unsigned, char * const);
+SN *sn_from_str(const char *, unsigned, SN *);
+/* @} */
+
+/**
+ * Whether streams can also be written to and read from POSIX file
+ * descriptors, with sn_writer_fd() and sn_reader_fd().
+ */
+#ifndef SN_FD_STREAMS
+#  if defined(__unix__) || defined(__APPLE__)
+#    define SN_FD_STREAMS 1
+#  else
+#    define SN_FD_STREAMS 0
+#  endif
+#endif // !defined SN_FD_STREAMS
+
+/** @defgroup stream Serialization
+ *
+ * A compact binary format for sequences of numbers: every number is written
+ * as a varint holding its length in bytes and its sign, followed by its
+ * magnitude in little-endian order. Writers and readers buffer the I/O.
+ * @{
+ */
+typedef enum sn_stream_flags {
+    /** Pad magnitudes to 8-byte offsets, so that sn_stream_view() works */
+    SN_STREAM_ALIGNED = 1
+} sn_stream_flags;
+
+typedef struct sn_writer sn_writer;
+typedef struct sn_reader sn_reader;
+
+sn_writer *sn_writer_new(FILE *, unsigned);
+bool sn_write(sn_writer *, const SN *);
+bool sn_writer_flush(sn_writer *);
+bool sn_writer_free(sn_writer *);
+sn_reader *sn_reader_new(FILE *);
+SN *sn_read(sn_reader *, SN *);
+bool sn_reader_error(const sn_reader *);
+void sn_reader_free(sn_reader *);
+SN *sn_stream_view(SN * const, const void *, size_t, size_t *);
+#if SN_FD_STREAMS
+sn_writer *sn_writer_fd(int, unsigned);
+sn_reader *sn_reader_fd(int);
+#endif // SN_FD_STREAMS
 /* @} */
 
 #endif // !defined SMALLNUM_NUMBER_H
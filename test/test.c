@@ -1,13 +1,53 @@
+/* fileno() and lseek() for the file descriptor streams */
+#define _POSIX_C_SOURCE 200809L
+
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <cmocka.h>
 
 #include "../number.h"
 
+#if SN_FD_STREAMS
+#include <unistd.h>
+#endif // SN_FD_STREAMS
+
+/* Pick the expected value of a word for the configured limb width */
+#if SN_WORD_BITS == 64
+#define WORD(w32, w64) ((sn_word)UINT64_C(w64))
+#else
+#define WORD(w32, w64) ((sn_word)UINT32_C(w32))
+#endif // SN_WORD_BITS
+
+/* Deterministic pseudo-random number with `size` blocks and a nonzero top block */
+static SN *random_number(size_t size, uint64_t *seed) {
+    SN *num = sn_new();
+    assert_non_null(num);
+
+    assert_non_null(sn_reserve(num, size));
+    num->size = size;
+
+    for (size_t i = 0; i < size; ++i) {
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 7;
+        *seed ^= *seed << 17;
+        num->blocks[i] = (sn_word)*seed;
+    }
+    num->blocks[size - 1] |= 1;
+
+    return num;
+}
+
+static void assert_sn_equal(const SN *a, const SN *b) {
+    assert_int_equal(a->size, b->size);
+    assert_memory_equal(a->blocks, b->blocks, a->size * sizeof(*a->blocks));
+    assert_int_equal(a->neg, b->neg);
+}
+
 /* Initialization */
 static void init__unitialized(void **state) {
     SN a;
@@ -20,11 +60,11 @@ static void init__unitialized(void **state) {
     assert_int_equal(a.blocks[0], 0);
     assert_false(a.neg);
 
-    free(a.blocks);
+    sn_release(&a);
 }
 
 static void init__initialized(void **state) {
-    SN  a = { (sn_word *)666, 5, true };
+    SN  a = { .blocks = (sn_word *)666, .size = 5, .neg = true };
     SN *b = sn_init(&a);
 
     assert_non_null(b);
@@ -34,7 +74,7 @@ static void init__initialized(void **state) {
     assert_int_equal(a.blocks[0], 0);
     assert_false(a.neg);
 
-    free(a.blocks);
+    sn_release(&a);
 }
 
 static void new__basic(void **state) {
@@ -45,14 +85,42 @@ static void new__basic(void **state) {
     assert_int_equal(a->blocks[0], 0);
     assert_false(a->neg);
 
-    free(a->blocks);
-    free(a);
+    sn_free(a);
+}
+
+static void init__inline_storage(void **state) {
+    SN a;
+    sn_init(&a);
+
+    assert_ptr_equal(a.blocks, a.small);
+    assert_int_equal(sn_capacity(&a), SN_INLINE_BLOCKS);
+
+    /* Growing past the inline blocks moves the value to the heap, and
+     * shrinking it brings it back */
+    uint64_t seed = 0x11;
+    SN *b = random_number(SN_INLINE_BLOCKS + 1, &seed);
+    SN *c = sn_new();
+
+    assert_non_null(sn_mul(c, &a, b));
+    assert_true(sn_is_zero(c));
+    assert_non_null(sn_add(&a, c, b));
+    assert_int_equal(a.size, SN_INLINE_BLOCKS + 1);
+    assert_true(a.blocks != a.small);
+
+    a.size = 1;
+    assert_non_null(sn_shrink_to_fit(&a));
+    assert_ptr_equal(a.blocks, a.small);
+    assert_int_equal(a.blocks[0], b->blocks[0]);
+
+    sn_release(&a);
+    sn_free(b);
+    sn_free(c);
 }
 
 /* Copying */
 static void copy__01(void **state) {
     sn_word words[] = { 0xdeadbeef, 0x2666 };
-    SN b, a = { words, 2, true };
+    SN b, a = { .blocks = words, .size = 2, .neg = true };
 
     SN *c = sn_copy(&b, &a);
 
@@ -62,12 +130,12 @@ static void copy__01(void **state) {
     assert_int_equal(b.blocks[1], words[1]);
     assert_true(b.neg);
 
-    free(b.blocks);
+    sn_release(&b);
 }
 
 static void duplicate__01(void **state) {
     sn_word words[] = { 0xd00db00b, 0x1948 };
-    SN a = { words, 2, false };
+    SN a = { .blocks = words, .size = 2, .neg = false };
 
     SN *b = sn_duplicate(&a);
 
@@ -77,16 +145,15 @@ static void duplicate__01(void **state) {
     assert_int_equal(b->blocks[1], words[1]);
     assert_false(b->neg);
 
-    free(b->blocks);
-    free(b);
+    sn_free(b);
 }
 
 /* Swapping */
 static void swap__01(void **state) {
     sn_word a_words[] = { 0xfaceface };
     sn_word b_words[] = { 0xdeaddead, 0xff00ff00 };
-    SN a = { a_words, 1, false };
-    SN b = { b_words, 2, true };
+    SN a = { .blocks = a_words, .size = 1, .neg = false };
+    SN b = { .blocks = b_words, .size = 2, .neg = true };
 
     sn_swap(&a, &b);
 
@@ -100,6 +167,102 @@ static void swap__01(void **state) {
     assert_false(b.neg);
 }
 
+static void swap__inline(void **state) {
+    uint64_t seed = 0x5a;
+    SN *a = sn_new(), *b = random_number(SN_INLINE_BLOCKS + 1, &seed);
+    SN *copy = sn_duplicate(b);
+
+    sn_one(a);
+    sn_swap(a, b);
+
+    assert_ptr_equal(b->blocks, b->small);
+    assert_true(sn_is_one(b));
+    assert_sn_equal(a, copy);
+
+    sn_free(a);
+    sn_free(b);
+    sn_free(copy);
+}
+
+/* Views live in read-only memory here, so that any write through one would crash */
+static const sn_word view_words[] = { WORD(0x89abcdef, 0x0123456789abcdef), 7, 0, 0 };
+
+static void view__read_only_operations(void **state) {
+    SN view, *copy = sn_new(), *res = sn_new(), *expected = sn_new();
+    char str[64], expected_str[64];
+
+    assert_ptr_equal(sn_view(&view, view_words, 4), &view);
+    assert_true(sn_is_view(&view));
+    /* Leading zero blocks are left out */
+    assert_int_equal(view.size, 2);
+
+    copy->size = 2;
+    copy->blocks[0] = view_words[0];
+    copy->blocks[1] = view_words[1];
+    assert_false(sn_is_view(copy));
+
+    assert_int_equal(sn_cmp(&view, copy), 0);
+    assert_int_equal(sn_num_bits(&view), SN_WORD_BITS + 3);
+
+    sn_mul(res, &view, &view);
+    sn_mul(expected, copy, copy);
+    assert_sn_equal(res, expected);
+
+    assert_int_equal(sn_to_str(&view, 10, str), sn_to_str(copy, 10, expected_str));
+    assert_string_equal(str, expected_str);
+
+    /* A copy of a view owns its blocks */
+    SN *dup = sn_duplicate(&view);
+    assert_false(sn_is_view(dup));
+    assert_sn_equal(dup, copy);
+    sn_free(dup);
+
+    /* Nothing to release */
+    sn_release(&view);
+    assert_true(sn_is_zero(&view));
+    assert_int_equal(sn_view(&view, view_words + 2, 2)->size, 1);
+    assert_true(sn_is_zero(&view));
+
+    sn_free(copy);
+    sn_free(res);
+    sn_free(expected);
+}
+
+/* A view assigned a result moves to blocks of its own, even in place */
+static void view__result_detaches(void **state) {
+    sn_word one_word[] = { 1 };
+    SN one = { .blocks = one_word, .size = 1, .neg = false };
+    SN *view = sn_new(), *expected = sn_new();
+
+    sn_view(view, view_words, 2);
+    sn_view(expected, view_words, 2);
+    sn_add(expected, expected, &one);
+    assert_false(sn_is_view(expected));
+
+    assert_non_null(sn_add(view, view, &one));
+    assert_false(sn_is_view(view));
+    assert_sn_equal(view, expected);
+    assert_int_equal(view_words[0], WORD(0x89abcdef, 0x0123456789abcdef));
+
+    /* sn_view() does not release the blocks the result moved to */
+    sn_release(view);
+    sn_view(view, view_words, 2);
+    sn_zero(view);
+    assert_false(sn_is_view(view));
+    assert_true(sn_is_zero(view));
+
+    /* sn_free() must leave the borrowed blocks to their owner */
+    sn_word *heap = malloc(3 * sizeof(*heap));
+    assert_non_null(heap);
+    heap[0] = heap[1] = heap[2] = 5;
+    sn_release(view);
+    sn_view(view, heap, 3);
+    sn_free(view);
+    free(heap);
+
+    sn_free(expected);
+}
+
 /* Cleanup */
 static void free__01(void **state) {
     // TODO
@@ -119,7 +282,7 @@ static void clear_free__01(void **state) {
 /* Resetting */
 static void zero__one_word(void **state) {
     sn_word words[] = { 0x49494949 };
-    SN a = { words, 1, true };
+    SN a = { .blocks = words, .size = 1, .neg = true };
 
     sn_zero(&a);
     assert_int_equal(a.size, 1);
@@ -135,7 +298,7 @@ static void zero__multiple_words(void **state) {
     words[1] = 0x50055005;
     words[2] = 0xfafafafa;
 
-    SN a = { words, 3, false };
+    SN a = { .blocks = words, .size = 3, .neg = false };
     sn_zero(&a);
 
     assert_int_equal(a.size, 1);
@@ -147,7 +310,7 @@ static void zero__multiple_words(void **state) {
 
 static void one__one_word(void **state) {
     sn_word words[] = { 0x66666666 };
-    SN a = { words, 1, true };
+    SN a = { .blocks = words, .size = 1, .neg = true };
 
     sn_one(&a);
     assert_int_equal(a.size, 1);
@@ -163,7 +326,7 @@ static void one__multiple_words(void **state) {
     words[1] = 0x55511000;
     words[2] = 0xefefefef;
 
-    SN a = { words, 3, false };
+    SN a = { .blocks = words, .size = 3, .neg = false };
     sn_one(&a);
 
     assert_int_equal(a.size, 1);
@@ -173,11 +336,265 @@ static void one__multiple_words(void **state) {
     free(a.blocks);
 }
 
+static void zero__keeps_capacity(void **state) {
+    uint64_t seed = 0x2e70;
+    SN *a = random_number(8, &seed);
+    sn_word *blocks = a->blocks;
+
+    sn_zero(a);
+    assert_int_equal(a->size, 1);
+    assert_int_equal(sn_capacity(a), 8);
+    assert_ptr_equal(a->blocks, blocks);
+
+    sn_free(a);
+}
+
+/* Capacity */
+static void reserve__keeps_value(void **state) {
+    uint64_t seed = 0x7e5e;
+    SN *a = random_number(SN_INLINE_BLOCKS + 1, &seed);
+    SN *copy = sn_duplicate(a);
+
+    assert_ptr_equal(sn_reserve(a, 100), a);
+    assert_int_equal(sn_capacity(a), 100);
+    assert_sn_equal(a, copy);
+
+    /* Reserving less than the capacity never shrinks it */
+    sn_reserve(a, 10);
+    assert_int_equal(sn_capacity(a), 100);
+
+    assert_ptr_equal(sn_shrink_to_fit(a), a);
+    assert_int_equal(sn_capacity(a), SN_INLINE_BLOCKS + 1);
+    assert_sn_equal(a, copy);
+
+    sn_free(a);
+    sn_free(copy);
+}
+
+static void add__accumulate_without_realloc(void **state) {
+    sn_word words[] = { SN_WORD_MAX, SN_WORD_MAX };
+    SN step = { .blocks = words, .size = 2, .neg = false };
+    SN *sums[2] = { sn_new(), sn_new() };
+
+    sn_reserve(sums[0], 8);
+    sn_reserve(sums[1], 8);
+    const sn_word *blocks[2] = { sums[0]->blocks, sums[1]->blocks };
+
+    /* Ping-pong between two accumulators, carrying out of the top block */
+    for (size_t i = 0; i < 64; ++i) {
+        sn_add(sums[(i + 1) % 2], sums[i % 2], &step);
+    }
+
+    assert_ptr_equal(sums[0]->blocks, blocks[0]);
+    assert_ptr_equal(sums[1]->blocks, blocks[1]);
+
+    /* 64 (B^2 - 1) = 63 B^2 + (B^2 - 64) */
+    assert_int_equal(sums[0]->size, 3);
+    assert_int_equal(sums[0]->blocks[0], SN_WORD_MAX - 63);
+    assert_int_equal(sums[0]->blocks[1], SN_WORD_MAX);
+    assert_int_equal(sums[0]->blocks[2], 63);
+
+    sn_free(sums[0]);
+    sn_free(sums[1]);
+}
+
+/* Memory management */
+struct alloc_counts {
+    size_t allocs, reallocs, frees;
+};
+
+static void *counting_alloc(void *state, size_t size) {
+    ++((struct alloc_counts *)state)->allocs;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *state, void *ptr, size_t old_size, size_t new_size) {
+    ++((struct alloc_counts *)state)->reallocs;
+    return realloc(ptr, new_size);
+}
+
+static void counting_free(void *state, void *ptr, size_t size) {
+    ++((struct alloc_counts *)state)->frees;
+    free(ptr);
+}
+
+static void allocator__custom_functions(void **state) {
+    struct alloc_counts counts = { 0 };
+    const sn_allocator counting = {
+        counting_alloc, counting_realloc, counting_free, &counts
+    };
+    sn_allocator current;
+
+    sn_set_allocator(&counting);
+    sn_get_allocator(&current);
+    assert_ptr_equal(current.state, &counts);
+
+    uint64_t seed = 0xa110c;
+    SN *a = random_number(SN_INLINE_BLOCKS + 1, &seed);
+    assert_non_null(sn_reserve(a, 100));
+    sn_free(a);
+
+    sn_set_allocator(NULL);
+    assert_int_equal(counts.allocs, 2);
+    assert_int_equal(counts.reallocs, 1);
+    assert_int_equal(counts.frees, 2);
+}
+
+static void ctx__arena_reuse(void **state) {
+    uint64_t seed = 0xa7e4a;
+    SN *a = random_number(200, &seed), *b = random_number(150, &seed);
+    SN *p = sn_new(), *q = sn_new(), *r = sn_new(), *expected = sn_new();
+    sn_ctx *ctx = sn_ctx_new(16);
+
+    assert_non_null(ctx);
+    assert_non_null(sn_reserve(p, 350));
+    assert_non_null(sn_reserve(q, 200));
+    assert_non_null(sn_reserve(r, 150));
+    assert_non_null(sn_mul(expected, a, b));
+
+    struct alloc_counts counts = { 0 };
+    const sn_allocator counting = {
+        counting_alloc, counting_realloc, counting_free, &counts
+    };
+    sn_set_allocator(&counting);
+    assert_null(sn_ctx_use(ctx));
+
+    /* The first round grows the arena, the second one fits after the reset */
+    for (int round = 0; round < 2; ++round) {
+        assert_non_null(sn_mul(p, a, b));
+        assert_non_null(sn_divmod(q, r, p, b));
+        sn_ctx_reset(ctx);
+        if (round == 0) {
+            assert_int_not_equal(counts.allocs, 0);
+            counts = (struct alloc_counts){ 0 };
+        }
+    }
+
+    assert_ptr_equal(sn_ctx_use(NULL), ctx);
+    sn_set_allocator(NULL);
+    assert_int_equal(counts.allocs + counts.reallocs + counts.frees, 0);
+
+    assert_sn_equal(p, expected);
+    assert_sn_equal(q, a);
+    assert_true(sn_is_zero(r));
+
+    sn_ctx_free(ctx);
+    sn_free(a);
+    sn_free(b);
+    sn_free(p);
+    sn_free(q);
+    sn_free(r);
+    sn_free(expected);
+}
+
+static void ctx__use_nests(void **state) {
+    sn_ctx *outer = sn_ctx_new(0), *inner = sn_ctx_new(0);
+    assert_non_null(outer);
+    assert_non_null(inner);
+
+    assert_null(sn_ctx_use(outer));
+    assert_ptr_equal(sn_ctx_use(inner), outer);
+    assert_ptr_equal(sn_ctx_use(outer), inner);
+
+    /* Freeing the context in use stops using it */
+    sn_ctx_free(outer);
+    assert_null(sn_ctx_use(NULL));
+
+    sn_ctx_free(inner);
+}
+
+/* Comparisons */
+static void ucmp__most_significant_first(void **state) {
+    sn_word a_words[] = { 2, 1 };
+    sn_word b_words[] = { 1, 2 };
+    sn_word c_words[] = { 5, 0, 0 };
+    SN a = { .blocks = a_words, .size = 2, .neg = false };
+    SN b = { .blocks = b_words, .size = 2, .neg = true };
+    SN c = { .blocks = c_words, .size = 3, .neg = false };
+
+    assert_int_equal(sn_ucmp(&a, &b), -1);
+    assert_int_equal(sn_ucmp(&b, &a), 1);
+    assert_int_equal(sn_ucmp(&a, &a), 0);
+
+    /* Leading zero blocks of hand-built operands are ignored */
+    assert_int_equal(sn_ucmp(&c, &a), -1);
+    a.size = 1;
+    assert_int_equal(sn_ucmp(&c, &a), 1);
+
+    assert_int_equal(sn_cmp(&a, &b), 1);
+    assert_int_equal(sn_cmp(&b, &a), -1);
+}
+
+static void sub__result_normalized(void **state) {
+    uint64_t seed = 0x4041;
+    SN *a = random_number(6, &seed), *b = sn_duplicate(a), *res = sn_new();
+
+    b->blocks[0] ^= 1;
+    assert_non_null(sn_sub(res, a, b));
+    assert_int_equal(res->size, 1);
+    assert_int_equal(res->blocks[0], 1);
+
+    assert_non_null(sn_sub(res, a, a));
+    assert_true(sn_is_zero(res));
+    assert_false(res->neg);
+
+    /* -a + a is zero, not negative zero */
+    SN *c = sn_duplicate(a);
+    c->neg = true;
+    assert_non_null(sn_add(res, c, a));
+    assert_true(sn_is_zero(res));
+    assert_false(res->neg);
+
+    sn_free(a);
+    sn_free(b);
+    sn_free(c);
+    sn_free(res);
+}
+
+/* Sizes */
+static void num_bits__exact(void **state) {
+    sn_word words[] = { 0, 0x80, 0 };
+    SN a = { .blocks = words, .size = 1, .neg = true };
+
+    assert_int_equal(sn_num_bits(&a), 0);
+    assert_int_equal(sn_num_bytes(&a), 0);
+
+    words[0] = 1;
+    assert_int_equal(sn_num_bits(&a), 1);
+    assert_int_equal(sn_num_bytes(&a), 1);
+
+    words[0] = SN_WORD_MAX;
+    assert_int_equal(sn_num_bits(&a), SN_WORD_BITS);
+    assert_int_equal(sn_num_bytes(&a), SN_WORD_BITS / 8);
+
+    a.size = 3;
+    assert_int_equal(sn_num_bits(&a), SN_WORD_BITS + 8);
+    assert_int_equal(sn_num_bytes(&a), SN_WORD_BITS / 8 + 1);
+}
+
+static void sn2bin__strips_leading_zeros(void **state) {
+    const uint8_t bytes[] = { 0x00, 0x00, 0x01, 0x02, 0x03 };
+    uint8_t out[sizeof(bytes)];
+
+    SN *a = sn_bin2sn(bytes, sizeof(bytes), NULL);
+    assert_non_null(a);
+    assert_int_equal(a->size, 1);
+    assert_int_equal(sn_num_bits(a), 17);
+
+    assert_int_equal(sn_sn2bin(a, out), 3);
+    assert_memory_equal(out, bytes + 2, 3);
+
+    sn_zero(a);
+    assert_int_equal(sn_sn2bin(a, out), 0);
+
+    sn_free(a);
+}
+
 /* Addition */
 static void add__zero_plus_zero(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -195,9 +612,9 @@ static void add__zero_plus_zero(void **state) {
 }
 
 static void add__one_plus_zero(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -216,9 +633,9 @@ static void add__one_plus_zero(void **state) {
 }
 
 static void add__zero_plus_one(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -237,9 +654,9 @@ static void add__zero_plus_one(void **state) {
 }
 
 static void add__one_plus_one(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -259,9 +676,9 @@ static void add__one_plus_one(void **state) {
 }
 
 static void add__size_1_nonoverflow(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -282,15 +699,15 @@ static void add__size_1_nonoverflow(void **state) {
 }
 
 static void add__size_1_overflow(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
     right.blocks  = calloc(1, sizeof(right.blocks));
 
-    left.blocks[0]  = 0xffffffff;
+    left.blocks[0]  = SN_WORD_MAX;
     right.blocks[0] = 1;
 
     sn_add(&result, &left, &right);
@@ -306,16 +723,16 @@ static void add__size_1_overflow(void **state) {
 }
 
 static void add__size_2_overflow(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 2, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 2, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(2, sizeof(left.blocks));
     right.blocks  = calloc(1, sizeof(right.blocks));
 
-    left.blocks[0]  = 0xffffffff;
-    left.blocks[1]  = 0xffffffff;
+    left.blocks[0]  = SN_WORD_MAX;
+    left.blocks[1]  = SN_WORD_MAX;
     right.blocks[0] = 1;
 
     sn_add(&result, &left, &right);
@@ -356,7 +773,7 @@ static void sub__size_2_underflow(void **state) {
     SN *n = sn_new();
     SN *res = sn_new();
 
-    m->blocks[0] = 0xffffffff;
+    m->blocks[0] = SN_WORD_MAX;
     n->blocks[0] = 1;
 
     sn_add(res, m, n);
@@ -370,9 +787,9 @@ static void sub__size_2_underflow(void **state) {
     sn_swap(res, m);
     sn_sub(res, m, n);
 
-    assert_int_equal(res->size, 2);
-    assert_int_equal(res->blocks[0], 0xfffffffe);
-    assert_int_equal(res->blocks[1], 0);
+    /* The borrowed-from top block is stripped */
+    assert_int_equal(res->size, 1);
+    assert_int_equal(res->blocks[0], SN_WORD_MAX - 1);
     assert_false(res->neg);
 
     sn_free(m);
@@ -385,12 +802,12 @@ static void sub__size_3_underflow(void **state) {
     SN *n = sn_new();
     SN *res = sn_new();
 
-    m->blocks[0] = 0xffffffff;
+    m->blocks[0] = SN_WORD_MAX;
     n->blocks[0] = 1;
 
     sn_add(res, m, n);
     sn_swap(res, m);
-    m->blocks[0] = m->blocks[1] = 0xffffffff;
+    m->blocks[0] = m->blocks[1] = SN_WORD_MAX;
     sn_add(res, m, n);
 
     assert_int_equal(res->size, 3);
@@ -403,10 +820,9 @@ static void sub__size_3_underflow(void **state) {
     sn_swap(res, m);
     sn_sub(res, m, n);
 
-    assert_int_equal(res->size, 3);
-    assert_int_equal(res->blocks[0], 0xfffffffe);
-    assert_int_equal(res->blocks[1], 0xffffffff);
-    assert_int_equal(res->blocks[2], 0);
+    assert_int_equal(res->size, 2);
+    assert_int_equal(res->blocks[0], SN_WORD_MAX - 1);
+    assert_int_equal(res->blocks[1], SN_WORD_MAX);
     assert_false(res->neg);
 
     sn_free(m);
@@ -414,11 +830,113 @@ static void sub__size_3_underflow(void **state) {
     sn_free(res);
 }
 
+static void sub__negative_result(void **state) {
+    SN *m = sn_new();
+    SN *n = sn_new();
+    SN *res = sn_new();
+
+    m->blocks[0] = 1;
+    n->blocks[0] = 3;
+
+    sn_sub(res, m, n);
+
+    assert_int_equal(res->size, 1);
+    assert_int_equal(res->blocks[0], 2);
+    assert_true(res->neg);
+
+    sn_free(m);
+    sn_free(n);
+    sn_free(res);
+}
+
+static void add__long_carry_chain(void **state) {
+    sn_word ones[9], one_word[] = { 1 };
+    SN a = { .blocks = ones, .size = 9, .neg = false };
+    SN one = { .blocks = one_word, .size = 1, .neg = false };
+    SN *res = sn_new();
+
+    /* The carry runs through the odd blocks and every unrolled step */
+    for (size_t i = 0; i < 9; ++i) {
+        ones[i] = SN_WORD_MAX;
+    }
+    assert_non_null(sn_add(res, &a, &one));
+    assert_int_equal(res->size, 10);
+    for (size_t i = 0; i < 9; ++i) {
+        assert_int_equal(res->blocks[i], 0);
+    }
+    assert_int_equal(res->blocks[9], 1);
+
+    assert_non_null(sn_sub(res, res, &one));
+    assert_sn_equal(res, &a);
+
+    sn_free(res);
+}
+
+static void add__in_place(void **state) {
+    sn_word words[] = { SN_WORD_MAX, SN_WORD_MAX };
+    SN step = { .blocks = words, .size = 2, .neg = false };
+    SN *x = sn_new();
+
+    /* B^2 - 1 + B^2 - 1 = B^2 + (B^2 - 2) */
+    assert_ptr_equal(sn_add_inplace(x, &step), x);
+    assert_ptr_equal(sn_add_inplace(x, &step), x);
+    assert_int_equal(x->size, 3);
+    assert_int_equal(x->blocks[0], SN_WORD_MAX - 1);
+    assert_int_equal(x->blocks[1], SN_WORD_MAX);
+    assert_int_equal(x->blocks[2], 1);
+
+    /* Both operands are the result */
+    assert_ptr_equal(sn_add(x, x, x), x);
+    assert_int_equal(x->size, 3);
+    assert_int_equal(x->blocks[0], SN_WORD_MAX - 3);
+    assert_int_equal(x->blocks[1], SN_WORD_MAX);
+    assert_int_equal(x->blocks[2], 3);
+
+    /* Mixed signs turn into an in-place subtraction from the second operand */
+    SN *y = sn_new();
+    y->blocks[0] = 5;
+    y->neg = true;
+    x->blocks[0] = 3;
+    x->size = 1;
+    assert_ptr_equal(sn_add(y, x, y), y);
+    assert_int_equal(y->blocks[0], 2);
+    assert_true(y->neg);
+
+    sn_free(x);
+    sn_free(y);
+}
+
+static void sub__in_place(void **state) {
+    sn_word words[] = { 1 };
+    SN one = { .blocks = words, .size = 1, .neg = false };
+    SN *x = sn_new();
+
+    x->blocks[0] = 2;
+    assert_ptr_equal(sn_sub_inplace(x, &one), x);
+    assert_int_equal(x->blocks[0], 1);
+    assert_false(x->neg);
+
+    assert_ptr_equal(sn_sub_inplace(x, &one), x);
+    assert_ptr_equal(sn_sub_inplace(x, &one), x);
+    assert_int_equal(x->blocks[0], 1);
+    assert_true(x->neg);
+
+    /* 1 - (-1) */
+    assert_ptr_equal(sn_sub(x, &one, x), x);
+    assert_int_equal(x->blocks[0], 2);
+    assert_false(x->neg);
+
+    assert_ptr_equal(sn_sub(x, x, x), x);
+    assert_int_equal(x->blocks[0], 0);
+
+    sn_free(x);
+}
+
 /* Multiplication */
 static void mul__zero_times_zero(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -436,9 +954,9 @@ static void mul__zero_times_zero(void **state) {
 }
 
 static void mul__zero_times_one(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -458,9 +976,9 @@ static void mul__zero_times_one(void **state) {
 }
 
 static void mul__one_times_zero(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -480,9 +998,9 @@ static void mul__one_times_zero(void **state) {
 }
 
 static void mul__one_times_one(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -503,9 +1021,9 @@ static void mul__one_times_one(void **state) {
 }
 
 static void mul__ten_times_one(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
@@ -525,17 +1043,17 @@ static void mul__ten_times_one(void **state) {
     free(right.blocks);
 }
 
-static void mul__0x10000_times_0x10000_overflow(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+static void mul__half_word_times_half_word_overflow(void **state) {
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
     right.blocks  = calloc(1, sizeof(right.blocks));
 
-    left.blocks[0]  = 0x00010000;
-    right.blocks[0] = 0x00010000;
+    left.blocks[0]  = (sn_word)1 << (SN_WORD_BITS / 2);
+    right.blocks[0] = (sn_word)1 << (SN_WORD_BITS / 2);
 
     sn_mul(&result, &left, &right);
 
@@ -550,22 +1068,22 @@ static void mul__0x10000_times_0x10000_overflow(void **state) {
 }
 
 static void mul__size_1_overflow(void **state) {
-    SN result = { NULL, 1, false },
-       left   = { NULL, 1, false },
-       right  = { NULL, 1, false };
+    SN result = { .blocks = NULL, .size = 1, .neg = false },
+       left   = { .blocks = NULL, .size = 1, .neg = false },
+       right  = { .blocks = NULL, .size = 1, .neg = false };
 
     result.blocks = calloc(1, sizeof(result.blocks));
     left.blocks   = calloc(1, sizeof(left.blocks));
     right.blocks  = calloc(1, sizeof(right.blocks));
 
-    left.blocks[0]  = 0xffffffff;
-    right.blocks[0] = 0xfefefefe;
+    left.blocks[0]  = SN_WORD_MAX;
+    right.blocks[0] = WORD(0xfefefefe, 0xfefefefefefefefe);
 
     sn_mul(&result, &left, &right);
 
     assert_int_equal(result.size, 2);
-    assert_int_equal(result.blocks[0], 0x01010102);
-    assert_int_equal(result.blocks[1], 0xfefefefd);
+    assert_int_equal(result.blocks[0], WORD(0x01010102, 0x0101010101010102));
+    assert_int_equal(result.blocks[1], WORD(0xfefefefd, 0xfefefefefefefefd));
     assert_false(result.neg);
 
     free(result.blocks);
@@ -573,17 +1091,2056 @@ static void mul__size_1_overflow(void **state) {
     free(right.blocks);
 }
 
+static void mul__size_2_times_size_2(void **state) {
+    sn_word a_words[] = { SN_WORD_MAX, SN_WORD_MAX };
+    sn_word b_words[] = { SN_WORD_MAX, SN_WORD_MAX };
+    SN a = { .blocks = a_words, .size = 2, .neg = false };
+    SN b = { .blocks = b_words, .size = 2, .neg = false };
+    SN *res = sn_new();
+
+    sn_mul(res, &a, &b);
+
+    /* (B^2 - 1)^2 = B^4 - 2 B^2 + 1 */
+    assert_int_equal(res->size, 4);
+    assert_int_equal(res->blocks[0], 1);
+    assert_int_equal(res->blocks[1], 0);
+    assert_int_equal(res->blocks[2], SN_WORD_MAX - 1);
+    assert_int_equal(res->blocks[3], SN_WORD_MAX);
+    assert_false(res->neg);
+
+    sn_free(res);
+}
+
+static void mul__size_3_times_size_1_normalized(void **state) {
+    sn_word a_words[] = { 0, 0, 1 };
+    sn_word b_words[] = { 7 };
+    SN a = { .blocks = a_words, .size = 3, .neg = false };
+    SN b = { .blocks = b_words, .size = 1, .neg = false };
+    SN *res = sn_new();
+
+    sn_mul(res, &a, &b);
+
+    assert_int_equal(res->size, 3);
+    assert_int_equal(res->blocks[0], 0);
+    assert_int_equal(res->blocks[1], 0);
+    assert_int_equal(res->blocks[2], 7);
+
+    sn_free(res);
+}
+
+static void mul__signs(void **state) {
+    sn_word a_words[] = { 3 };
+    sn_word b_words[] = { 5 };
+    SN a = { .blocks = a_words, .size = 1, .neg = true };
+    SN b = { .blocks = b_words, .size = 1, .neg = false };
+    SN *res = sn_new();
+
+    sn_mul(res, &a, &b);
+    assert_int_equal(res->blocks[0], 15);
+    assert_true(res->neg);
+
+    b.neg = true;
+    sn_mul(res, &a, &b);
+    assert_int_equal(res->blocks[0], 15);
+    assert_false(res->neg);
+
+    b.blocks[0] = 0;
+    sn_mul(res, &a, &b);
+    assert_int_equal(res->size, 1);
+    assert_int_equal(res->blocks[0], 0);
+    assert_false(res->neg);
+
+    sn_free(res);
+}
+
+/* Compare a product under the given thresholds with the schoolbook one */
+static void check_mul_thresholds(size_t karatsuba, size_t toom3, size_t ntt) {
+    const size_t sizes[][2] = { { 2, 2 }, { 7, 7 }, { 31, 31 }, { 64, 64 },
+                                { 97, 97 }, { 200, 13 }, { 150, 61 }, { 33, 100 },
+                                { 1500, 1100 } };
+    const sn_threshold which[] = { SN_THRESHOLD_MUL_KARATSUBA, SN_THRESHOLD_MUL_TOOM3,
+                                   SN_THRESHOLD_MUL_NTT };
+    const size_t values[] = { karatsuba, toom3, ntt };
+    size_t saved[3];
+    uint64_t seed = 0x5eed;
+
+    for (size_t t = 0; t < 3; ++t) {
+        saved[t] = sn_get_threshold(which[t]);
+    }
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        SN *a = random_number(sizes[i][0], &seed);
+        SN *b = random_number(sizes[i][1], &seed);
+        SN *expected = sn_new(), *actual = sn_new();
+
+        /* The largest convolution coefficients come from all-ones operands */
+        if (i % 2) {
+            memset(a->blocks, 0xff, a->size * sizeof(*a->blocks));
+            memset(b->blocks, 0xff, b->size * sizeof(*b->blocks));
+        }
+
+        for (size_t t = 0; t < 3; ++t) {
+            sn_set_threshold(which[t], SIZE_MAX);
+        }
+        assert_non_null(sn_mul(expected, a, b));
+
+        for (size_t t = 0; t < 3; ++t) {
+            sn_set_threshold(which[t], values[t]);
+        }
+        assert_non_null(sn_mul(actual, a, b));
+
+        assert_int_equal(expected->size, sizes[i][0] + sizes[i][1]);
+        assert_sn_equal(actual, expected);
+
+        sn_free(a);
+        sn_free(b);
+        sn_free(expected);
+        sn_free(actual);
+    }
+
+    for (size_t t = 0; t < 3; ++t) {
+        sn_set_threshold(which[t], saved[t]);
+    }
+}
+
+static void mul__karatsuba_matches_schoolbook(void **state) {
+    check_mul_thresholds(2, SIZE_MAX, SIZE_MAX);
+}
+
+static void mul__toom3_matches_schoolbook(void **state) {
+    check_mul_thresholds(4, 5, SIZE_MAX);
+}
+
+static void mul__ntt_matches_schoolbook(void **state) {
+    check_mul_thresholds(SIZE_MAX, SIZE_MAX, 1);
+}
+
+static void mul__in_place(void **state) {
+    uint64_t seed = 0x1a9ace;
+    SN *a = random_number(120, &seed), *b = random_number(70, &seed);
+    SN *expected = sn_new(), *x = sn_duplicate(a), *y = sn_duplicate(b);
+
+    b->neg = true;
+    y->neg = true;
+    assert_non_null(sn_mul(expected, a, b));
+
+    /* The product is copied back into the blocks already reserved */
+    assert_non_null(sn_reserve(x, 190));
+    const sn_word *blocks = x->blocks;
+    assert_ptr_equal(sn_mul_inplace(x, b), x);
+    assert_sn_equal(x, expected);
+    assert_ptr_equal(x->blocks, blocks);
+
+    assert_ptr_equal(sn_mul(y, a, y), y);
+    assert_sn_equal(y, expected);
+
+    sn_free(a);
+    sn_free(b);
+    sn_free(x);
+    sn_free(y);
+    sn_free(expected);
+}
+
+/* Squaring */
+static void sqr__size_1(void **state) {
+    sn_word words[] = { SN_WORD_MAX };
+    SN a = { .blocks = words, .size = 1, .neg = true };
+    SN *res = sn_new();
+
+    sn_sqr(res, &a);
+
+    /* (B - 1)^2 = (B - 2) B + 1 */
+    assert_int_equal(res->size, 2);
+    assert_int_equal(res->blocks[0], 1);
+    assert_int_equal(res->blocks[1], SN_WORD_MAX - 1);
+    assert_false(res->neg);
+
+    sn_free(res);
+}
+
+static void sqr__in_place(void **state) {
+    uint64_t seed = 0xabcdef;
+    SN *a = random_number(9, &seed);
+    SN *expected = sn_new();
+    SN *copy = sn_duplicate(a);
+
+    sn_mul(expected, a, copy);
+    assert_ptr_equal(sn_sqr(a, a), a);
+    assert_sn_equal(a, expected);
+
+    sn_free(a);
+    sn_free(copy);
+    sn_free(expected);
+}
+
+/* Operands over the same blocks take the squaring path, but keep their signs */
+static void mul__negated_alias(void **state) {
+    sn_word words[] = { 3, 5 }, zero_word[] = { 0 };
+    SN pos = { .blocks = words, .size = 2, .neg = false };
+    SN neg = { .blocks = words, .size = 2, .neg = true };
+    SN zero = { .blocks = zero_word, .size = 1, .neg = false };
+    SN neg_zero = { .blocks = zero_word, .size = 1, .neg = true };
+    SN *copy = sn_duplicate(&neg), *expected = sn_new(), *res = sn_new();
+
+    assert_non_null(sn_mul(expected, &pos, copy));
+    assert_true(sn_is_negative(expected));
+    assert_non_null(sn_mul(res, &pos, &neg));
+    assert_sn_equal(res, expected);
+    assert_non_null(sn_mul(res, &neg, &pos));
+    assert_sn_equal(res, expected);
+
+    assert_non_null(sn_mul(expected, &neg, copy));
+    assert_false(sn_is_negative(expected));
+    assert_non_null(sn_mul(res, &neg, &neg));
+    assert_sn_equal(res, expected);
+
+    assert_non_null(sn_mul(res, &zero, &neg_zero));
+    assert_true(sn_is_zero(res));
+    assert_false(sn_is_negative(res));
+
+    sn_free(copy);
+    sn_free(expected);
+    sn_free(res);
+}
+
+/* Compare squares under the given thresholds with schoolbook products */
+static void check_sqr_thresholds(size_t karatsuba, size_t toom3, size_t ntt) {
+    const size_t sizes[] = { 1, 2, 5, 17, 64, 99, 250, 1200 };
+    const sn_threshold which[] = { SN_THRESHOLD_SQR_KARATSUBA, SN_THRESHOLD_SQR_TOOM3,
+                                   SN_THRESHOLD_SQR_NTT, SN_THRESHOLD_MUL_KARATSUBA,
+                                   SN_THRESHOLD_MUL_TOOM3, SN_THRESHOLD_MUL_NTT };
+    const size_t values[] = { karatsuba, toom3, ntt, SIZE_MAX, SIZE_MAX, SIZE_MAX };
+    size_t saved[6];
+    uint64_t seed = 0x5eed5;
+
+    for (size_t t = 0; t < 6; ++t) {
+        saved[t] = sn_get_threshold(which[t]);
+        sn_set_threshold(which[t], values[t]);
+    }
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        SN *a = random_number(sizes[i], &seed);
+        if (i % 2) {
+            memset(a->blocks, 0xff, a->size * sizeof(*a->blocks));
+        }
+        SN *copy = sn_duplicate(a);
+        SN *expected = sn_new(), *actual = sn_new();
+
+        assert_non_null(sn_mul(expected, a, copy));
+        assert_non_null(sn_sqr(actual, a));
+        assert_sn_equal(actual, expected);
+
+        sn_free(a);
+        sn_free(copy);
+        sn_free(expected);
+        sn_free(actual);
+    }
+
+    for (size_t t = 0; t < 6; ++t) {
+        sn_set_threshold(which[t], saved[t]);
+    }
+}
+
+static void sqr__karatsuba_matches_mul(void **state) {
+    check_sqr_thresholds(2, SIZE_MAX, SIZE_MAX);
+}
+
+static void sqr__toom3_matches_mul(void **state) {
+    check_sqr_thresholds(3, 5, SIZE_MAX);
+}
+
+static void sqr__ntt_matches_mul(void **state) {
+    check_sqr_thresholds(SIZE_MAX, SIZE_MAX, 1);
+}
+
+/* Division */
+static void divmod__signs(void **state) {
+    /* Truncating quotient and remainder, and the Euclidean remainder, of
+     * (+-7) / (+-2) */
+    const struct { bool a_neg, b_neg, q_neg, r_neg; } cases[] = {
+        { false, false, false, false },
+        { true,  false, true,  true  },
+        { false, true,  true,  false },
+        { true,  true,  false, true  },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+        sn_word a_words[] = { 7 }, b_words[] = { 2 };
+        SN a = { .blocks = a_words, .size = 1, .neg = cases[i].a_neg };
+        SN b = { .blocks = b_words, .size = 1, .neg = cases[i].b_neg };
+        SN *q = sn_new(), *r = sn_new(), *m = sn_new();
+
+        assert_ptr_equal(sn_divmod(q, r, &a, &b), q);
+        assert_int_equal(q->blocks[0], 3);
+        assert_int_equal(q->neg, cases[i].q_neg);
+        assert_int_equal(r->blocks[0], 1);
+        assert_int_equal(r->neg, cases[i].r_neg);
+
+        assert_ptr_equal(sn_mod(m, &a, &b), m);
+        assert_int_equal(m->size, 1);
+        assert_int_equal(m->blocks[0], 1);
+        assert_false(m->neg);
+
+        sn_free(q);
+        sn_free(r);
+        sn_free(m);
+    }
+}
+
+static void divmod__by_zero(void **state) {
+    sn_word words[] = { 5, 0 };
+    SN a = { .blocks = words, .size = 1, .neg = false };
+    SN zero = { .blocks = words + 1, .size = 1, .neg = false };
+    SN *q = sn_new(), *r = sn_new();
+
+    assert_null(sn_divmod(q, r, &a, &zero));
+    assert_null(sn_div(q, &a, &zero));
+    assert_null(sn_mod(r, &a, &zero));
+
+    sn_free(q);
+    sn_free(r);
+}
+
+static void divmod__dividend_smaller(void **state) {
+    sn_word a_words[] = { 5 }, b_words[] = { 0, 1 };
+    SN a = { .blocks = a_words, .size = 1, .neg = true };
+    SN b = { .blocks = b_words, .size = 2, .neg = false };
+    SN *q = sn_new(), *r = sn_new();
+
+    sn_divmod(q, r, &a, &b);
+    assert_true(sn_is_zero(q));
+    assert_false(q->neg);
+    assert_sn_equal(r, &a);
+
+    /* -5 mod B = B - 5 */
+    sn_mod(r, &a, &b);
+    assert_int_equal(r->size, 1);
+    assert_int_equal(r->blocks[0], SN_WORD_MAX - 4);
+    assert_false(r->neg);
+
+    sn_free(q);
+    sn_free(r);
+}
+
+static void divmod__size_2_by_size_1(void **state) {
+    /* (B^2 - 1) / (B - 1) = B + 1 */
+    sn_word a_words[] = { SN_WORD_MAX, SN_WORD_MAX }, b_words[] = { SN_WORD_MAX };
+    SN a = { .blocks = a_words, .size = 2, .neg = false };
+    SN b = { .blocks = b_words, .size = 1, .neg = false };
+    SN *q = sn_new(), *r = sn_new();
+
+    sn_divmod(q, r, &a, &b);
+    assert_int_equal(q->size, 2);
+    assert_int_equal(q->blocks[0], 1);
+    assert_int_equal(q->blocks[1], 1);
+    assert_true(sn_is_zero(r));
+
+    sn_free(q);
+    sn_free(r);
+}
+
+static void divmod__aliased_operands(void **state) {
+    uint64_t seed = 0xd1d1;
+    SN *a = random_number(12, &seed), *b = random_number(5, &seed);
+    SN *q = sn_new(), *r = sn_new();
+
+    sn_divmod(q, r, a, b);
+    /* The quotient overwrites the dividend, the remainder the divisor */
+    assert_ptr_equal(sn_divmod(a, b, a, b), a);
+    assert_sn_equal(a, q);
+    assert_sn_equal(b, r);
+
+    sn_free(a);
+    sn_free(b);
+    sn_free(q);
+    sn_free(r);
+}
+
+/* Divide under the given Burnikel-Ziegler threshold and check that a = q b + r
+ * with 0 <= r < b and that the result matches Knuth's algorithm */
+static void check_div_threshold(size_t bz) {
+    const size_t sizes[][2] = {
+        { 2, 2 }, { 9, 4 }, { 40, 8 }, { 64, 32 }, { 129, 33 }, { 300, 61 },
+        { 333, 100 }, { 800, 256 }, { 1100, 1000 },
+    };
+    const size_t saved = sn_get_threshold(SN_THRESHOLD_DIV_BZ);
+    uint64_t seed = 0xd1;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        SN *a = random_number(sizes[i][0], &seed);
+        SN *b = random_number(sizes[i][1], &seed);
+        SN *q = sn_new(), *r = sn_new(), *expected_q = sn_new(), *expected_r = sn_new();
+        SN *prod = sn_new(), *sum = sn_new();
+
+        /* Quotient blocks of all ones exercise the correction steps */
+        if (i % 2) {
+            memset(a->blocks, 0xff, a->size * sizeof(*a->blocks));
+        }
+
+        sn_set_threshold(SN_THRESHOLD_DIV_BZ, SIZE_MAX);
+        assert_non_null(sn_divmod(expected_q, expected_r, a, b));
+        sn_set_threshold(SN_THRESHOLD_DIV_BZ, bz);
+        assert_non_null(sn_divmod(q, r, a, b));
+
+        assert_sn_equal(q, expected_q);
+        assert_sn_equal(r, expected_r);
+
+        assert_true(r->size <= b->size);
+        sn_mul(prod, q, b);
+        sn_add(sum, prod, r);
+        assert_sn_equal(sum, a);
+
+        sn_free(a);
+        sn_free(b);
+        sn_free(q);
+        sn_free(r);
+        sn_free(expected_q);
+        sn_free(expected_r);
+        sn_free(prod);
+        sn_free(sum);
+    }
+
+    sn_set_threshold(SN_THRESHOLD_DIV_BZ, saved);
+}
+
+static void divmod__burnikel_ziegler_matches_knuth(void **state) {
+    check_div_threshold(4);
+}
+
+static void divmod__burnikel_ziegler_single_block_base(void **state) {
+    check_div_threshold(1);
+}
+
+/* Shifts and bitwise operations */
+
+/* A number from a machine integer, through its decimal string */
+static SN *int_number(long long v) {
+    char str[32];
+    snprintf(str, sizeof(str), "%lld", v);
+
+    SN *num = sn_from_str(str, 10, NULL);
+    assert_non_null(num);
+
+    return num;
+}
+
+/* Shifts agree with multiplication and floored division by powers of two,
+ * also in place */
+static void shl_shr__match_mul_div(void **state) {
+    const size_t sizes[] = { 1, 2, 5, 33 };
+    const size_t shifts[] = { 0, 1, 7, SN_WORD_BITS - 1, SN_WORD_BITS, SN_WORD_BITS + 1, 200 };
+    uint64_t seed = 0x5417;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        for (size_t j = 0; j < sizeof(shifts) / sizeof(*shifts); ++j) {
+            SN *a = random_number(sizes[i], &seed), *pow = sn_new();
+            SN *res = sn_new(), *expected = sn_new(), *r = sn_new();
+
+            a->neg = (i + j) % 2;
+            assert_non_null(sn_setbit(pow, shifts[j]));
+
+            assert_non_null(sn_shl(res, a, shifts[j]));
+            sn_mul(expected, a, pow);
+            assert_sn_equal(res, expected);
+            assert_non_null(sn_shr(res, res, shifts[j]));
+            assert_sn_equal(res, a);
+
+            /* floor(a / 2^k) = (a - (a mod 2^k)) / 2^k */
+            assert_non_null(sn_shr(res, a, shifts[j]));
+            sn_mod(r, a, pow);
+            sn_sub(expected, a, r);
+            sn_div(expected, expected, pow);
+            assert_sn_equal(res, expected);
+
+            sn_release(res);
+            sn_copy(res, a);
+            assert_non_null(sn_shr(res, res, shifts[j]));
+            assert_sn_equal(res, expected);
+
+            sn_free(a);
+            sn_free(pow);
+            sn_free(res);
+            sn_free(expected);
+            sn_free(r);
+        }
+    }
+}
+
+static void shr__past_the_top(void **state) {
+    SN *a = int_number(-5), *res = sn_new(), *minus_one = int_number(-1);
+
+    assert_non_null(sn_shr(res, a, 1000));
+    assert_sn_equal(res, minus_one);
+    sn_set_negative(a, false);
+    assert_non_null(sn_shr(res, a, 1000));
+    assert_true(sn_is_zero(res));
+
+    sn_free(a);
+    sn_free(res);
+    sn_free(minus_one);
+}
+
+/* Two's complement results on machine integers of both signs */
+static void bitwise__matches_machine_integers(void **state) {
+    const long long values[] = {
+        0, 1, -1, 2, -2, 5, -6, 0x7fffffffLL, -0x80000000LL, 0x123456789abcLL,
+        -0x100000000LL, -0x123456789abdLL, 0x7fffffffffffffffLL, -0x7fffffffffffffffLL - 1,
+    };
+    const size_t count = sizeof(values) / sizeof(*values);
+
+    for (size_t i = 0; i < count; ++i) {
+        SN *a = int_number(values[i]), *res = sn_new(), *expected;
+
+        assert_non_null(sn_not(res, a));
+        expected = int_number(~values[i]);
+        assert_sn_equal(res, expected);
+        sn_free(expected);
+
+        for (size_t j = 0; j < count; ++j) {
+            SN *b = int_number(values[j]);
+
+            assert_non_null(sn_and(res, a, b));
+            expected = int_number(values[i] & values[j]);
+            assert_sn_equal(res, expected);
+            sn_free(expected);
+
+            assert_non_null(sn_or(res, a, b));
+            expected = int_number(values[i] | values[j]);
+            assert_sn_equal(res, expected);
+            sn_free(expected);
+
+            assert_non_null(sn_xor(res, a, b));
+            expected = int_number(values[i] ^ values[j]);
+            assert_sn_equal(res, expected);
+            sn_free(expected);
+
+            sn_free(b);
+        }
+
+        for (size_t bit = 0; bit < 70; ++bit) {
+            assert_int_equal(sn_testbit(a, bit), values[i] >> min(bit, 63) & 1);
+        }
+
+        sn_free(a);
+        sn_free(res);
+    }
+}
+
+/* (a | b) + (a & b) = a + b and (a | b) - (a & b) = a ^ b on long operands
+ * of all signs, with results in place of either operand */
+static void bitwise__identities(void **state) {
+    const size_t sizes[][2] = { { 1, 1 }, { 1, 4 }, { 7, 3 }, { 20, 20 } };
+    uint64_t seed = 0xb175;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        for (int signs = 0; signs < 4; ++signs) {
+            SN *a = random_number(sizes[i][0], &seed), *b = random_number(sizes[i][1], &seed);
+            SN *x = sn_new(), *y = sn_new(), *sum = sn_new(), *expected = sn_new();
+
+            a->neg = signs & 1;
+            b->neg = signs >> 1;
+
+            assert_non_null(sn_or(x, a, b));
+            assert_non_null(sn_and(y, a, b));
+            sn_add(sum, x, y);
+            sn_add(expected, a, b);
+            assert_sn_equal(sum, expected);
+
+            sn_sub(expected, x, y);
+            sn_release(x);
+            sn_copy(x, a);
+            assert_non_null(sn_xor(x, x, b));
+            assert_sn_equal(x, expected);
+            sn_release(x);
+            sn_copy(x, b);
+            assert_non_null(sn_xor(x, a, x));
+            assert_sn_equal(x, expected);
+
+            /* a & ~a = 0 and a | ~a = -1 */
+            assert_non_null(sn_not(x, a));
+            assert_non_null(sn_and(y, a, x));
+            assert_true(sn_is_zero(y));
+            assert_non_null(sn_or(y, a, x));
+            sn_one(expected);
+            sn_set_negative(expected, true);
+            assert_sn_equal(y, expected);
+
+            sn_free(a);
+            sn_free(b);
+            sn_free(x);
+            sn_free(y);
+            sn_free(sum);
+            sn_free(expected);
+        }
+    }
+}
+
+/* Setting a bit is an OR and clearing one an AND with the complement */
+static void setbit_clrbit__match_or_and(void **state) {
+    const size_t bits[] = { 0, 3, SN_WORD_BITS - 1, SN_WORD_BITS, 2 * SN_WORD_BITS + 5, 500 };
+    uint64_t seed = 0x5e7b;
+
+    for (size_t i = 0; i < 8; ++i) {
+        SN *a = random_number(1 + i % 4, &seed);
+        a->neg = i % 2;
+
+        for (size_t j = 0; j < sizeof(bits) / sizeof(*bits); ++j) {
+            SN *pow = sn_new(), *res = sn_duplicate(a), *expected = sn_new();
+
+            assert_non_null(sn_setbit(pow, bits[j]));
+
+            assert_non_null(sn_setbit(res, bits[j]));
+            sn_or(expected, a, pow);
+            assert_sn_equal(res, expected);
+            assert_true(sn_testbit(res, bits[j]));
+
+            sn_release(res);
+            sn_copy(res, a);
+            assert_non_null(sn_clrbit(res, bits[j]));
+            sn_not(pow, pow);
+            sn_and(expected, a, pow);
+            assert_sn_equal(res, expected);
+            assert_false(sn_testbit(res, bits[j]));
+
+            sn_free(pow);
+            sn_free(res);
+            sn_free(expected);
+        }
+
+        sn_free(a);
+    }
+}
+
+static void popcount__01(void **state) {
+    SN *a = sn_from_str("ff00000000000000000000000000000f1", 16, NULL);
+
+    assert_int_equal(sn_popcount(a), 13);
+    sn_set_negative(a, true);
+    assert_int_equal(sn_popcount(a), SIZE_MAX);
+    sn_zero(a);
+    assert_int_equal(sn_popcount(a), 0);
+
+    sn_free(a);
+}
+
+/* Roots */
+
+/* s^2 <= a < (s + 1)^2 with r = a - s^2 for all small a, also in place */
+static void sqrtrem__small_values(void **state) {
+    SN *s = sn_new(), *r = sn_new(), *x = sn_new();
+
+    for (long long v = 0; v < 2000; ++v) {
+        SN *a = int_number(v);
+
+        assert_non_null(sn_sqrtrem(s, r, a));
+        sn_sqr(x, s);
+        sn_add(x, x, r);
+        assert_sn_equal(x, a);
+        assert_false(sn_is_negative(r));
+        assert_true(sn_cmp(r, sn_add(x, s, s)) <= 0);
+
+        assert_non_null(sn_sqrt(a, a));
+        assert_sn_equal(a, s);
+
+        sn_free(a);
+    }
+
+    sn_free(s);
+    sn_free(r);
+    sn_free(x);
+}
+
+/* Squares of random numbers and their neighbours, from one to hundreds of
+ * blocks, so that several Newton steps are taken */
+static void sqrtrem__around_squares(void **state) {
+    const size_t sizes[] = { 1, 2, 3, 8, 64, 257 };
+    uint64_t seed = 0x5947;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        SN *x = random_number(sizes[i], &seed), *a = sn_new(), *one = int_number(1);
+        SN *s = sn_new(), *r = sn_new(), *expected_r = sn_new();
+
+        /* x^2 */
+        sn_sqr(a, x);
+        assert_non_null(sn_sqrtrem(s, r, a));
+        assert_sn_equal(s, x);
+        assert_true(sn_is_zero(r));
+
+        /* x^2 + 2x = (x + 1)^2 - 1 */
+        sn_add(expected_r, x, x);
+        sn_add(a, a, expected_r);
+        assert_non_null(sn_sqrtrem(s, r, a));
+        assert_sn_equal(s, x);
+        assert_sn_equal(r, expected_r);
+
+        /* x^2 - 1 = (x - 1)^2 + 2(x - 1) */
+        sn_sub(a, a, expected_r);
+        sn_sub(a, a, one);
+        sn_sub(x, x, one);
+        sn_add(expected_r, x, x);
+        assert_non_null(sn_sqrtrem(NULL, r, a));
+        assert_sn_equal(r, expected_r);
+        assert_non_null(sn_sqrt(s, a));
+        assert_sn_equal(s, x);
+
+        sn_set_negative(a, true);
+        assert_null(sn_sqrt(s, a));
+
+        sn_free(x);
+        sn_free(a);
+        sn_free(one);
+        sn_free(s);
+        sn_free(r);
+        sn_free(expected_r);
+    }
+}
+
+/* k-th powers of random numbers and their neighbours, of both signs */
+static void root__around_powers(void **state) {
+    const unsigned ks[] = { 1, 2, 3, 4, 5, 7, 16, 61 };
+    const size_t sizes[] = { 1, 2, 9, 40 };
+    uint64_t seed = 0x7007;
+
+    for (size_t i = 0; i < sizeof(ks) / sizeof(*ks); ++i) {
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(*sizes); ++j) {
+            const unsigned k = ks[i];
+            SN *x = random_number(sizes[j], &seed), *a = sn_new(), *one = int_number(1);
+            SN *res = sn_new();
+
+            /* x^k */
+            sn_copy(a, x);
+            for (unsigned e = 1; e < k; ++e) {
+                sn_mul(a, a, x);
+            }
+            assert_non_null(sn_root(res, a, k));
+            assert_sn_equal(res, x);
+
+            /* x^k - 1, and its negative for odd k */
+            sn_sub(a, a, one);
+            sn_sub(x, x, one);
+            assert_non_null(sn_root(res, a, k));
+            assert_sn_equal(res, x);
+
+            sn_set_negative(a, true);
+            if (k % 2) {
+                sn_set_negative(x, true);
+                assert_non_null(sn_root(a, a, k));
+                assert_sn_equal(a, x);
+            } else {
+                assert_null(sn_root(res, a, k));
+            }
+
+            sn_free(x);
+            sn_free(a);
+            sn_free(one);
+            sn_free(res);
+        }
+    }
+}
+
+static void root__edge_cases(void **state) {
+    SN *a = int_number(1000), *res = sn_new(), *expected = int_number(1);
+
+    assert_null(sn_root(res, a, 0));
+    assert_non_null(sn_root(res, a, 10));
+    assert_sn_equal(res, expected);
+    assert_non_null(sn_root(res, a, 1000000));
+    assert_sn_equal(res, expected);
+
+    sn_zero(a);
+    assert_non_null(sn_root(res, a, 5));
+    assert_true(sn_is_zero(res));
+
+    sn_free(a);
+    sn_free(res);
+    sn_free(expected);
+}
+
+/* Modular arithmetic */
+static void mont_ctx_new__even_modulus(void **state) {
+    sn_word words[] = { 10 };
+    SN m = { .blocks = words, .size = 1, .neg = false };
+
+    assert_null(sn_mont_ctx_new(&m));
+}
+
+static void powm__size_1(void **state) {
+    sn_word m_words[] = { 497 }, b_words[] = { 4 }, e_words[] = { 13 };
+    SN m = { .blocks = m_words, .size = 1, .neg = false };
+    SN b = { .blocks = b_words, .size = 1, .neg = false };
+    SN e = { .blocks = e_words, .size = 1, .neg = false };
+    sn_mont_ctx *ctx = sn_mont_ctx_new(&m);
+    SN *res = sn_new();
+
+    assert_non_null(ctx);
+    assert_ptr_equal(sn_powm(res, &b, &e, ctx), res);
+    assert_int_equal(res->size, 1);
+    assert_int_equal(res->blocks[0], 445);
+
+    /* (-4)^13 = -(4^13) = 497 - 445 mod 497 */
+    b.neg = true;
+    sn_powm(res, &b, &e, ctx);
+    assert_int_equal(res->blocks[0], 52);
+
+    /* Anything to the zeroth power is one */
+    e_words[0] = 0;
+    sn_powm(res, &b, &e, ctx);
+    assert_true(sn_is_one(res));
+
+    e.neg = true;
+    e_words[0] = 1;
+    assert_null(sn_powm(res, &b, &e, ctx));
+
+    sn_free(res);
+    sn_mont_ctx_free(ctx);
+}
+
+static void powm__fermat_mersenne_prime(void **state) {
+    /* 3^(p - 1) = 1 mod p for the prime p = 2^127 - 1 */
+    uint8_t bytes[16];
+    memset(bytes, 0xff, sizeof(bytes));
+    bytes[0] = 0x7f;
+
+    SN *p = sn_bin2sn(bytes, sizeof(bytes), NULL);
+    bytes[15] = 0xfe;
+    SN *e = sn_bin2sn(bytes, sizeof(bytes), NULL);
+    sn_word b_words[] = { 3 };
+    SN b = { .blocks = b_words, .size = 1, .neg = false };
+    SN *res = sn_new();
+    sn_mont_ctx *ctx = sn_mont_ctx_new(p);
+
+    assert_non_null(ctx);
+    sn_powm(res, &b, e, ctx);
+    assert_true(sn_is_one(res));
+
+    sn_free(p);
+    sn_free(e);
+    sn_free(res);
+    sn_mont_ctx_free(ctx);
+}
+
+/* Compare batched exponentiations, in lanes where supported, with sn_powm() */
+static void powm_batch__matches_powm(void **state) {
+    /* Eight items of mixed sizes share the lanes, the other three do not */
+    const size_t sizes[] = { 1, 3, 2, 5, 1, 4, 3, 2, 1, 2, 3 };
+    enum { COUNT = sizeof(sizes) / sizeof(*sizes) };
+    SN *mods[COUNT], *bases[COUNT], *exps[COUNT], *res[COUNT], *expected = sn_new();
+    sn_mont_ctx *ctx[COUNT];
+    uint64_t seed = 0xba7c4;
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        const size_t n = sizes[i] * (64 / SN_WORD_BITS);
+        mods[i]  = random_number(n, &seed);
+        bases[i] = random_number(n + i % 3, &seed);
+        exps[i]  = random_number(1 + i % 4, &seed);
+        res[i]   = sn_new();
+        mods[i]->blocks[0] |= 1;
+        bases[i]->neg = i % 2;
+        ctx[i] = sn_mont_ctx_new(mods[i]);
+        assert_non_null(ctx[i]);
+    }
+    sn_zero(exps[5]);
+
+    assert_true(sn_powm_batch(res, (const SN * const *)bases, (const SN * const *)exps,
+                              (const sn_mont_ctx * const *)ctx, COUNT));
+    for (size_t i = 0; i < COUNT; ++i) {
+        assert_non_null(sn_powm(expected, bases[i], exps[i], ctx[i]));
+        assert_sn_equal(res[i], expected);
+    }
+
+    exps[7]->neg = true;
+    assert_false(sn_powm_batch(res, (const SN * const *)bases, (const SN * const *)exps,
+                               (const sn_mont_ctx * const *)ctx, COUNT));
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        sn_mont_ctx_free(ctx[i]);
+        sn_free(mods[i]);
+        sn_free(bases[i]);
+        sn_free(exps[i]);
+        sn_free(res[i]);
+    }
+    sn_free(expected);
+}
+
+/* Compare Montgomery products under both kernels with sn_mul() and sn_mod() */
+static void mont_mul__matches_mod(void **state) {
+    const size_t sizes[] = { 1, 2, 3, 8, 31, 64 };
+    const size_t saved = sn_get_threshold(SN_THRESHOLD_MUL_KARATSUBA);
+    uint64_t seed = 0x3057;
+
+    for (size_t i = 0; i < 2 * sizeof(sizes) / sizeof(*sizes); ++i) {
+        const size_t n = sizes[i / 2];
+        SN *m = random_number(n, &seed), *a = random_number(2 * n, &seed);
+        SN *b = random_number(n, &seed);
+        SN *ma = sn_new(), *mb = sn_new(), *prod = sn_new(), *expected = sn_new();
+        m->blocks[0] |= 1;
+
+        /* Even iterations use CIOS, odd ones multiplication and REDC */
+        sn_set_threshold(SN_THRESHOLD_MUL_KARATSUBA, i % 2 ? 2 : SIZE_MAX);
+
+        sn_mont_ctx *ctx = sn_mont_ctx_new(m);
+        assert_non_null(ctx);
+
+        sn_mont_to(ma, a, ctx);
+        sn_mont_to(mb, b, ctx);
+        assert_non_null(sn_mont_mul(ma, ma, mb, ctx));
+        assert_non_null(sn_mont_from(ma, ma, ctx));
+
+        sn_mul(prod, a, b);
+        sn_mod(expected, prod, m);
+        assert_sn_equal(ma, expected);
+
+        /* Residues must be reduced */
+        assert_null(sn_mont_mul(ma, a, mb, ctx));
+
+        sn_mont_ctx_free(ctx);
+        sn_free(m);
+        sn_free(a);
+        sn_free(b);
+        sn_free(ma);
+        sn_free(mb);
+        sn_free(prod);
+        sn_free(expected);
+    }
+
+    sn_set_threshold(SN_THRESHOLD_MUL_KARATSUBA, saved);
+}
+
+static void barrett_ctx_new__zero_modulus(void **state) {
+    sn_word words[] = { 0, 0 };
+    SN m = { .blocks = words, .size = 2, .neg = false };
+
+    assert_null(sn_barrett_ctx_new(&m));
+}
+
+static void mulmod_barrett__even_modulus(void **state) {
+    sn_word m_words[] = { 10 }, a_words[] = { 7 }, b_words[] = { 9 };
+    SN m = { .blocks = m_words, .size = 1, .neg = false };
+    SN a = { .blocks = a_words, .size = 1, .neg = false };
+    SN b = { .blocks = b_words, .size = 1, .neg = true };
+    sn_barrett_ctx *ctx = sn_barrett_ctx_new(&m);
+    SN *res = sn_new();
+
+    assert_non_null(ctx);
+
+    /* 7 (-9) = -63 = 7 mod 10 */
+    assert_ptr_equal(sn_mulmod_barrett(res, &a, &b, ctx), res);
+    assert_int_equal(res->size, 1);
+    assert_int_equal(res->blocks[0], 7);
+    assert_false(res->neg);
+
+    sn_free(res);
+    sn_barrett_ctx_free(ctx);
+}
+
+/* Compare Barrett reductions of values up to three times the modulus size,
+ * the largest of which take the division fallback, with sn_mod() */
+static void mod_barrett__matches_mod(void **state) {
+    const size_t sizes[] = { 1, 2, 3, 7, 40, 130 };
+    uint64_t seed = 0xba77;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        const size_t n = sizes[i];
+        SN *m = random_number(n, &seed);
+        sn_barrett_ctx *ctx = sn_barrett_ctx_new(m);
+        assert_non_null(ctx);
+
+        for (size_t xn = 1; xn <= 3 * n; xn += (n + 1) / 2) {
+            SN *x = random_number(xn, &seed);
+            SN *actual = sn_new(), *expected = sn_new();
+
+            x->neg = xn % 2;
+            assert_non_null(sn_mod_barrett(actual, x, ctx));
+            sn_mod(expected, x, m);
+            assert_sn_equal(actual, expected);
+
+            sn_free(x);
+            sn_free(actual);
+            sn_free(expected);
+        }
+
+        sn_barrett_ctx_free(ctx);
+        sn_free(m);
+    }
+}
+
+/* Number theory */
+
+static void gcd__known_values(void **state) {
+    const struct {
+        const char *a, *b, *g, *s, *t;
+    } cases[] = {
+        { "0", "0", "0", "0", "0" },
+        { "-5", "0", "5", "-1", "0" },
+        { "0", "-5", "5", "0", "-1" },
+        { "7", "-7", "7", "0", "-1" },
+        { "240", "46", "2", "-9", "47" },
+        { "-240", "46", "2", "9", "47" },
+        { "12", "-18", "6", "-1", "-1" },
+        /* F(300) and F(299) take the longest Euclidean sequence for their size */
+        { "222232244629420445529739893461909967206666939096499764990979600",
+          "137347080577163115432025771710279131845700275212767467264610201", "1",
+          "52461916524905785334311649958648296484733611329035169538240802",
+          "-84885164052257330097714121751630835360966663883732297726369399" },
+        { "340282366920938463463374607431768211456", "18446744073709551616",
+          "18446744073709551616", "0", "1" },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+        SN *a = sn_from_str(cases[i].a, 10, NULL), *b = sn_from_str(cases[i].b, 10, NULL);
+        SN *g = sn_from_str(cases[i].g, 10, NULL), *s = sn_from_str(cases[i].s, 10, NULL);
+        SN *t = sn_from_str(cases[i].t, 10, NULL);
+        SN *res = sn_new(), *res_s = sn_new(), *res_t = sn_new();
+
+        assert_non_null(sn_gcd(res, a, b));
+        assert_sn_equal(res, g);
+        assert_non_null(sn_gcdext(res, res_s, res_t, a, b));
+        assert_sn_equal(res, g);
+        assert_sn_equal(res_s, s);
+        assert_sn_equal(res_t, t);
+
+        sn_free(a);
+        sn_free(b);
+        sn_free(g);
+        sn_free(s);
+        sn_free(t);
+        sn_free(res);
+        sn_free(res_s);
+        sn_free(res_t);
+    }
+}
+
+/* Compute the GCD of a c and b c for random a, b and c by binary GCD, Lehmer
+ * steps and half-GCD with the given thresholds and check that all agree, that
+ * c divides it and that the cofactors are in range */
+static void check_gcd_thresholds(size_t lehmer, size_t hgcd) {
+    const size_t sizes[][3] = {
+        { 1, 1, 1 }, { 2, 1, 1 }, { 3, 3, 1 }, { 9, 4, 2 }, { 20, 17, 5 }, { 64, 64, 3 },
+        { 150, 90, 20 }, { 300, 299, 1 },
+    };
+    const size_t saved_lehmer = sn_get_threshold(SN_THRESHOLD_GCD_LEHMER);
+    const size_t saved_hgcd   = sn_get_threshold(SN_THRESHOLD_GCD_HGCD);
+    uint64_t seed = 0x9cd;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        SN *a = random_number(sizes[i][0], &seed), *b = random_number(sizes[i][1], &seed);
+        SN *c = random_number(sizes[i][2], &seed);
+        SN *expected = sn_new(), *g = sn_new(), *s = sn_new(), *t = sn_new();
+        SN *sum = sn_new(), *prod = sn_new(), *r = sn_new();
+
+        sn_mul(a, a, c);
+        sn_mul(b, b, c);
+        a->neg = i % 2;
+        b->neg = i % 3 == 0;
+
+        sn_set_threshold(SN_THRESHOLD_GCD_LEHMER, SIZE_MAX);
+        sn_set_threshold(SN_THRESHOLD_GCD_HGCD, SIZE_MAX);
+        assert_non_null(sn_gcd(expected, a, b));
+        sn_set_threshold(SN_THRESHOLD_GCD_LEHMER, lehmer);
+        sn_set_threshold(SN_THRESHOLD_GCD_HGCD, hgcd);
+        assert_non_null(sn_gcd(g, a, b));
+        assert_sn_equal(g, expected);
+        sn_mod(r, g, c);
+        assert_true(sn_is_zero(r));
+
+        /* s a + t b = g with 2 |s| g <= |b| and 2 |t| g <= |a| */
+        assert_non_null(sn_gcdext(g, s, t, a, b));
+        assert_sn_equal(g, expected);
+        sn_mul(sum, s, a);
+        sn_mul(prod, t, b);
+        sn_add(sum, sum, prod);
+        assert_sn_equal(sum, g);
+        sn_mul(prod, s, g);
+        sn_add(prod, prod, prod);
+        assert_true(sn_ucmp(prod, b) <= 0);
+        sn_mul(prod, t, g);
+        sn_add(prod, prod, prod);
+        assert_true(sn_ucmp(prod, a) <= 0);
+
+        sn_free(a);
+        sn_free(b);
+        sn_free(c);
+        sn_free(expected);
+        sn_free(g);
+        sn_free(s);
+        sn_free(t);
+        sn_free(sum);
+        sn_free(prod);
+        sn_free(r);
+    }
+
+    sn_set_threshold(SN_THRESHOLD_GCD_LEHMER, saved_lehmer);
+    sn_set_threshold(SN_THRESHOLD_GCD_HGCD, saved_hgcd);
+}
+
+static void gcd__lehmer_matches_binary(void **state) {
+    check_gcd_thresholds(1, SIZE_MAX);
+}
+
+static void gcd__hgcd_matches_binary(void **state) {
+    check_gcd_thresholds(1, 2);
+    check_gcd_thresholds(2, 7);
+}
+
+/* Pairs far apart in size above the half-GCD threshold, which used to recurse
+ * without reducing much, agree with Lehmer steps alone */
+static void gcd__hgcd_unbalanced_matches_lehmer(void **state) {
+    const size_t sizes[][2] = { { 1600, 1210 }, { 1600, 1100 }, { 3000, 1560 }, { 2000, 40 } };
+    const size_t saved = sn_get_threshold(SN_THRESHOLD_GCD_HGCD);
+    uint64_t seed = 0x4bd;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        for (size_t j = 0; j < 2; ++j) {
+            const size_t hgcd = j ? saved : 2;
+            SN *a = random_number(sizes[i][0], &seed), *b = random_number(sizes[i][1], &seed);
+            SN *c = random_number(3, &seed), *expected = sn_new(), *g = sn_new();
+            SN *s = sn_new(), *t = sn_new(), *sum = sn_new(), *prod = sn_new();
+
+            sn_mul(a, a, c);
+            sn_mul(b, b, c);
+
+            sn_set_threshold(SN_THRESHOLD_GCD_HGCD, SIZE_MAX);
+            assert_non_null(sn_gcd(expected, a, b));
+            sn_set_threshold(SN_THRESHOLD_GCD_HGCD, hgcd);
+            assert_non_null(sn_gcd(g, a, b));
+            assert_sn_equal(g, expected);
+
+            assert_non_null(sn_gcdext(g, s, t, a, b));
+            assert_sn_equal(g, expected);
+            sn_mul(sum, s, a);
+            sn_mul(prod, t, b);
+            sn_add(sum, sum, prod);
+            assert_sn_equal(sum, g);
+
+            sn_free(a);
+            sn_free(b);
+            sn_free(c);
+            sn_free(expected);
+            sn_free(g);
+            sn_free(s);
+            sn_free(t);
+            sn_free(sum);
+            sn_free(prod);
+        }
+    }
+
+    sn_set_threshold(SN_THRESHOLD_GCD_HGCD, saved);
+}
+
+static void invert__matches_mod(void **state) {
+    const size_t sizes[] = { 1, 2, 5, 32, 120 };
+    uint64_t seed = 0x1a7;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        SN *m = random_number(sizes[i], &seed), *a = random_number(sizes[i] + 1, &seed);
+        SN *inv = sn_new(), *prod = sn_new(), *g = sn_new();
+
+        /* An odd modulus and an odd number with a common factor */
+        m->blocks[0] |= 1;
+        a->neg = i % 2;
+        sn_gcd(g, a, m);
+        if (sn_is_one(g)) {
+            assert_non_null(sn_invert(inv, a, m));
+            assert_true(!sn_is_negative(inv) && sn_ucmp(inv, m) < 0);
+            sn_mul(prod, inv, a);
+            sn_mod(prod, prod, m);
+            assert_true(sn_is_one(prod));
+        }
+
+        sn_mul(a, a, m);
+        sn_add(a, a, g);
+        sn_mul(a, a, m);
+        assert_null(sn_invert(inv, a, m));
+        sn_zero(m);
+        assert_null(sn_invert(inv, g, m));
+
+        sn_free(m);
+        sn_free(a);
+        sn_free(inv);
+        sn_free(prod);
+        sn_free(g);
+    }
+}
+
+/* Certainly prime below 2^64, probably above, and composite for pseudoprimes
+ * that pass only one half of the Baillie-PSW test */
+static void probab_prime__known_values(void **state) {
+    const struct {
+        const char *n;
+        int         expected;
+    } cases[] = {
+        { "0", 0 },
+        { "1", 0 },
+        { "2", 2 },
+        { "-7", 2 },
+        { "1021", 2 },
+        { "1048573", 2 },
+        /* 1093^2, a square and a strong pseudoprime to base 2 */
+        { "1194649", 0 },
+        /* Strong Lucas pseudoprimes without factors below 1024 */
+        { "1711469", 0 },
+        { "2263127", 0 },
+        /* A strong pseudoprime to all bases up to 23 */
+        { "3825123056546413051", 0 },
+        { "18446744073709551557", 2 },
+        { "18446744073709551629", 1 },
+        /* 2^67 - 1 = 193707721 761838257287 and 2^127 - 1 */
+        { "147573952589676412927", 0 },
+        { "170141183460469231731687303715884105727", 1 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+        SN *n = sn_from_str(cases[i].n, 10, NULL);
+        assert_non_null(n);
+        assert_int_equal(sn_probab_prime(n, 10), cases[i].expected);
+        sn_free(n);
+    }
+
+    /* 2^521 + 1 is divisible by three and 2^521 - 1 is prime */
+    SN *n = int_number(1), *two = int_number(2);
+    sn_shl(n, n, 521);
+    sn_setbit(n, 0);
+    assert_int_equal(sn_probab_prime(n, 5), 0);
+    sn_sub(n, n, two);
+    assert_int_equal(sn_probab_prime(n, 5), 1);
+
+    sn_free(n);
+    sn_free(two);
+}
+
+/* Trial division below 2^21, both for the table and for the full test */
+static bool is_prime_by_division(uint64_t n) {
+    if (n < 2) {
+        return false;
+    }
+    for (uint64_t d = 2; d * d <= n; ++d) {
+        if (n % d == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void probab_prime__matches_trial_division(void **state) {
+    const uint64_t starts[] = { 0, (1 << 20) - 2000 };
+
+    for (size_t i = 0; i < sizeof(starts) / sizeof(*starts); ++i) {
+        for (uint64_t v = starts[i]; v < starts[i] + 6000; ++v) {
+            SN *n = int_number((long long)v);
+            assert_int_equal(sn_probab_prime(n, 0), is_prime_by_division(v) ? 2 : 0);
+            sn_free(n);
+        }
+    }
+}
+
+static void next_prime__known_values(void **state) {
+    const struct {
+        long long n, expected;
+    } small[] = {
+        { -5, 2 }, { 0, 2 }, { 1, 2 }, { 2, 3 }, { 3, 5 }, { 1021, 1031 },
+        { 524288, 524309 }, { 1048576, 1048583 }, { 3825123056546413050, 3825123056546413057 },
+    };
+
+    for (size_t i = 0; i < sizeof(small) / sizeof(*small); ++i) {
+        SN *n = int_number(small[i].n), *expected = int_number(small[i].expected);
+        SN *res = sn_new();
+        assert_non_null(sn_next_prime(res, n));
+        assert_sn_equal(res, expected);
+        /* In place */
+        assert_non_null(sn_next_prime(n, n));
+        assert_sn_equal(n, expected);
+        sn_free(n);
+        sn_free(expected);
+        sn_free(res);
+    }
+
+    /* 2^64 + 13 and 2^128 + 51 */
+    const struct {
+        size_t   bits;
+        unsigned gap;
+    } large[] = { { 64, 13 }, { 128, 51 } };
+
+    for (size_t i = 0; i < sizeof(large) / sizeof(*large); ++i) {
+        SN *n = int_number(1), *gap = int_number(large[i].gap), *res = sn_new();
+        sn_shl(n, n, large[i].bits);
+        assert_non_null(sn_next_prime(res, n));
+        sn_sub(res, res, n);
+        assert_sn_equal(res, gap);
+        sn_free(n);
+        sn_free(gap);
+        sn_free(res);
+    }
+}
+
+/* Nothing between a random number and the result passes sn_probab_prime() */
+static void next_prime__skips_no_prime(void **state) {
+    const size_t sizes[] = { 1, 2, 3, 8 };
+    uint64_t seed = 0x9e1;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+        SN *n = random_number(sizes[i], &seed), *res = sn_new(), *one = int_number(1);
+
+        assert_non_null(sn_next_prime(res, n));
+        assert_true(sn_probab_prime(res, 10) > 0);
+        for (sn_add(n, n, one); sn_cmp(n, res) < 0; sn_add(n, n, one)) {
+            assert_int_equal(sn_probab_prime(n, 10), 0);
+        }
+
+        sn_free(n);
+        sn_free(res);
+        sn_free(one);
+    }
+}
+
+/* Batches */
+
+/* Reduce `a` modulo 2^(W n), keeping it normalized */
+static void truncate_blocks(SN *a, size_t n) {
+    if (a->size > n) {
+        a->size = n;
+        while (a->size > 1 && a->blocks[a->size - 1] == 0) {
+            --a->size;
+        }
+    }
+}
+
+/* More numbers than fit into a single chunk of the kernels */
+#define BATCH_COUNT 70
+
+static void batch__set_get(void **state) {
+    sn_batch *batch = sn_batch_new(BATCH_COUNT, 3);
+    SN *nums[BATCH_COUNT], *out = sn_new();
+    uint64_t seed = 0xba7c;
+
+    assert_non_null(batch);
+    assert_int_equal(sn_batch_count(batch), BATCH_COUNT);
+    assert_int_equal(sn_batch_blocks(batch), 3);
+
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        nums[i] = random_number(1 + i % 3, &seed);
+        assert_non_null(sn_batch_set(batch, i, nums[i]));
+    }
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        assert_non_null(sn_batch_get(out, batch, i));
+        assert_sn_equal(out, nums[i]);
+        sn_free(nums[i]);
+    }
+
+    /* Too wide or negative numbers are rejected, leading zeros are not */
+    SN *wide = random_number(4, &seed);
+    assert_null(sn_batch_set(batch, 0, wide));
+    wide->blocks[3] = 0;
+    assert_non_null(sn_batch_set(batch, 0, wide));
+    wide->neg = true;
+    assert_null(sn_batch_set(batch, 0, wide));
+
+    sn_free(wide);
+    sn_free(out);
+    sn_batch_free(batch);
+}
+
+static void batch__add_sub_match_sn(void **state) {
+    sn_batch *a = sn_batch_new(BATCH_COUNT, 3), *b = sn_batch_new(BATCH_COUNT, 3);
+    sn_batch *sum = sn_batch_new(BATCH_COUNT, 3), *diff = sn_batch_new(BATCH_COUNT, 3);
+    SN *x[BATCH_COUNT], *y[BATCH_COUNT], *expected = sn_new(), *out = sn_new();
+    uint8_t carry[BATCH_COUNT], borrow[BATCH_COUNT];
+    uint64_t seed = 0xadd5;
+
+    /* 2^(3 W), added to the minuend to model the wrap-around */
+    SN *wrap = sn_new();
+    assert_non_null(sn_reserve(wrap, 4));
+    wrap->size = 4;
+    wrap->blocks[0] = wrap->blocks[1] = wrap->blocks[2] = 0;
+    wrap->blocks[3] = 1;
+
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        x[i] = random_number(1 + (i + 2) % 3, &seed);
+        y[i] = i % 7 ? random_number(1 + i % 3, &seed) : sn_duplicate(x[i]);
+        if (i % 5 == 0) {
+            /* All ones, so that a carry runs through every block */
+            assert_non_null(sn_reserve(x[i], 3));
+            x[i]->size = 3;
+            x[i]->blocks[0] = x[i]->blocks[1] = x[i]->blocks[2] = SN_WORD_MAX;
+        }
+        assert_non_null(sn_batch_set(a, i, x[i]));
+        assert_non_null(sn_batch_set(b, i, y[i]));
+    }
+
+    assert_ptr_equal(sn_batch_add(sum, a, b, carry), sum);
+    assert_ptr_equal(sn_batch_sub(diff, a, b, borrow), diff);
+    /* The result may be an operand */
+    assert_ptr_equal(sn_batch_add(a, a, b, NULL), a);
+
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        sn_add(expected, x[i], y[i]);
+        assert_int_equal(carry[i], expected->size > 3);
+        truncate_blocks(expected, 3);
+        sn_batch_get(out, sum, i);
+        assert_sn_equal(out, expected);
+        sn_batch_get(out, a, i);
+        assert_sn_equal(out, expected);
+
+        assert_int_equal(borrow[i], sn_ucmp(x[i], y[i]) < 0);
+        if (borrow[i]) {
+            sn_add(expected, x[i], wrap);
+            sn_sub(expected, expected, y[i]);
+        } else {
+            sn_sub(expected, x[i], y[i]);
+        }
+        sn_batch_get(out, diff, i);
+        assert_sn_equal(out, expected);
+
+        sn_free(x[i]);
+        sn_free(y[i]);
+    }
+
+    sn_free(wrap);
+    sn_free(expected);
+    sn_free(out);
+    sn_batch_free(a);
+    sn_batch_free(b);
+    sn_batch_free(sum);
+    sn_batch_free(diff);
+}
+
+/* Products are cut down to the width of the result, or padded with zeros */
+static void batch__mul_matches_mul(void **state) {
+    const size_t widths[] = { 1, 4, 5, 7 };
+    sn_batch *a = sn_batch_new(BATCH_COUNT, 3), *b = sn_batch_new(BATCH_COUNT, 2);
+    SN *x[BATCH_COUNT], *y[BATCH_COUNT], *expected = sn_new(), *out = sn_new();
+    uint64_t seed = 0x3a1;
+
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        x[i] = random_number(1 + i % 3, &seed);
+        y[i] = random_number(1 + i % 2, &seed);
+        assert_non_null(sn_batch_set(a, i, x[i]));
+        assert_non_null(sn_batch_set(b, i, y[i]));
+    }
+
+    for (size_t w = 0; w < sizeof(widths) / sizeof(*widths); ++w) {
+        sn_batch *prod = sn_batch_new(BATCH_COUNT, widths[w]);
+        assert_ptr_equal(sn_batch_mul(prod, a, b), prod);
+
+        for (size_t i = 0; i < BATCH_COUNT; ++i) {
+            sn_mul(expected, x[i], y[i]);
+            truncate_blocks(expected, widths[w]);
+            sn_batch_get(out, prod, i);
+            assert_sn_equal(out, expected);
+        }
+        sn_batch_free(prod);
+    }
+
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        sn_free(x[i]);
+        sn_free(y[i]);
+    }
+    sn_free(expected);
+    sn_free(out);
+    sn_batch_free(a);
+    sn_batch_free(b);
+}
+
+static void batch__cmp(void **state) {
+    sn_batch *a = sn_batch_new(BATCH_COUNT, 2), *b = sn_batch_new(BATCH_COUNT, 2);
+    SN *x = sn_new(), *y = sn_new();
+    int8_t cmp[BATCH_COUNT];
+    uint64_t seed = 0xc3;
+
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        SN *r = random_number(2, &seed);
+        sn_copy(x, r);
+        sn_copy(y, r);
+        /* Differ in the low block only, in both blocks, or not at all */
+        if (i % 3 == 1) {
+            y->blocks[0] ^= 1;
+        } else if (i % 3 == 2) {
+            y->blocks[0] = ~x->blocks[0];
+            y->blocks[1] ^= 2;
+        }
+        assert_non_null(sn_batch_set(a, i, x));
+        assert_non_null(sn_batch_set(b, i, y));
+        sn_free(r);
+    }
+
+    sn_batch_cmp(cmp, a, b);
+    for (size_t i = 0; i < BATCH_COUNT; ++i) {
+        sn_batch_get(x, a, i);
+        sn_batch_get(y, b, i);
+        assert_int_equal(cmp[i], sn_ucmp(x, y));
+    }
+
+    sn_free(x);
+    sn_free(y);
+    sn_batch_free(a);
+    sn_batch_free(b);
+}
+
+/* Fixed-width numbers */
+
+/* `lo` and `hi` (if not NULL) of `n` blocks each are the low and high half of `expected` */
+static void assert_halves_equal(const sn_word *lo, const sn_word *hi, size_t n,
+        const SN *expected) {
+    for (size_t i = 0; i < 2 * n; ++i) {
+        const sn_word w = i < expected->size ? expected->blocks[i] : 0;
+        if (i < n) {
+            assert_int_equal(lo[i], w);
+        } else if (hi) {
+            assert_int_equal(hi[i - n], w);
+        }
+    }
+}
+
+static void fixed__from_sn(void **state) {
+    sn256 a;
+    SN *x = sn_new(), *y = sn_new();
+    uint64_t seed = 0xf1;
+
+    SN *r = random_number(SN_FIXED_BLOCKS(256), &seed);
+    assert_ptr_equal(sn256_from_sn(&a, r), &a);
+    assert_non_null(sn256_to_sn(x, &a));
+    assert_sn_equal(x, r);
+    sn_free(r);
+
+    r = random_number(1, &seed);
+    assert_non_null(sn256_from_sn(&a, r));
+    for (size_t i = 1; i < SN_FIXED_BLOCKS(256); ++i) {
+        assert_int_equal(a.blocks[i], 0);
+    }
+    r->neg = true;
+    assert_null(sn256_from_sn(&a, r));
+    sn_free(r);
+
+    r = random_number(SN_FIXED_BLOCKS(256) + 1, &seed);
+    assert_null(sn256_from_sn(&a, r));
+    sn_free(r);
+
+    sn_zero(y);
+    assert_non_null(sn256_from_sn(&a, y));
+    assert_non_null(sn256_to_sn(x, &a));
+    assert_true(sn_is_zero(x));
+
+    sn_free(x);
+    sn_free(y);
+}
+
+static void fixed__arith_matches_sn(void **state) {
+    SN *expected = sn_new();
+    uint64_t seed = 0xf2;
+
+    for (size_t round = 0; round < 8; ++round) {
+        const size_t n = SN_FIXED_BLOCKS(2048);
+        SN *x = random_number(1 + round * (n - 1) / 7, &seed);
+        SN *y = random_number(n - round * (n - 1) / 7, &seed);
+        sn2048 a, b, lo, hi;
+
+        assert_non_null(sn2048_from_sn(&a, x));
+        assert_non_null(sn2048_from_sn(&b, y));
+
+        sn_add(expected, x, y);
+        assert_int_equal(sn2048_add(&lo, &a, &b), expected->size > n);
+        assert_halves_equal(lo.blocks, NULL, n, expected);
+
+        sn_sub(expected, x, y);
+        lo = a;
+        assert_int_equal(sn2048_sub(&lo, &lo, &b), sn_is_negative(expected));
+        if (!sn_is_negative(expected)) {
+            assert_halves_equal(lo.blocks, NULL, n, expected);
+        }
+        assert_int_equal(sn2048_cmp(&a, &b), sn_ucmp(x, y));
+        assert_int_equal(sn2048_cmp(&a, &a), 0);
+
+        sn_mul(expected, x, y);
+        sn2048_mul(&lo, &hi, &a, &b);
+        assert_halves_equal(lo.blocks, hi.blocks, n, expected);
+
+        sn_sqr(expected, y);
+        sn2048_sqr(&lo, &hi, &b);
+        assert_halves_equal(lo.blocks, hi.blocks, n, expected);
+        sn2048_sqr(&b, NULL, &b);
+        assert_halves_equal(b.blocks, NULL, n, expected);
+
+        sn_free(x);
+        sn_free(y);
+    }
+
+    /* Carries run through every block */
+    sn256 ones, one = { { 1 } }, sum;
+    memset(ones.blocks, 0xff, sizeof(ones.blocks));
+    assert_int_equal(sn256_add(&sum, &ones, &one), 1);
+    for (size_t i = 0; i < SN_FIXED_BLOCKS(256); ++i) {
+        assert_int_equal(sum.blocks[i], 0);
+    }
+    assert_int_equal(sn256_sub(&sum, &sum, &one), 1);
+    assert_memory_equal(sum.blocks, ones.blocks, sizeof(ones.blocks));
+
+    sn_free(expected);
+}
+
+static void fixed__mont_matches_mod(void **state) {
+    SN *expected = sn_new(), *actual = sn_new();
+    uint64_t seed = 0xf3;
+
+    for (size_t round = 0; round < 4; ++round) {
+        const size_t n = SN_FIXED_BLOCKS(1024);
+        SN *m = random_number(round == 3 ? 1 : n - round, &seed);
+        SN *x = random_number(n, &seed), *y = random_number(n, &seed);
+        sn1024 mod, a, b, ma, mb;
+        sn1024_mont_ctx ctx;
+
+        m->blocks[0] |= 1;
+        sn_mod(x, x, m);
+        sn_mod(y, y, m);
+
+        assert_non_null(sn1024_from_sn(&mod, m));
+        assert_non_null(sn1024_from_sn(&a, x));
+        assert_non_null(sn1024_from_sn(&b, y));
+        assert_ptr_equal(sn1024_mont_init(&ctx, &mod), &ctx);
+
+        sn1024_mont_to(&ma, &a, &ctx);
+        sn1024_mont_to(&mb, &b, &ctx);
+        sn1024_mont_mul(&ma, &ma, &mb, &ctx);
+        sn1024_mont_from(&ma, &ma, &ctx);
+        sn_mul(expected, x, y);
+        sn_mod(expected, expected, m);
+        sn1024_to_sn(actual, &ma);
+        assert_sn_equal(actual, expected);
+
+        sn1024_mont_to(&mb, &b, &ctx);
+        sn1024_mont_sqr(&mb, &mb, &ctx);
+        sn1024_mont_from(&mb, &mb, &ctx);
+        sn_sqr(expected, y);
+        sn_mod(expected, expected, m);
+        sn1024_to_sn(actual, &mb);
+        assert_sn_equal(actual, expected);
+
+        sn_free(m);
+        sn_free(x);
+        sn_free(y);
+    }
+
+    sn1024 even = { { 2 } };
+    sn1024_mont_ctx ctx;
+    assert_null(sn1024_mont_init(&ctx, &even));
+
+    sn_free(expected);
+    sn_free(actual);
+}
+
+/* Conversion */
+static void bin2sn__unaligned_length(void **state) {
+    const uint8_t bytes[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09 };
+
+    SN *a = sn_bin2sn(bytes, sizeof(bytes), NULL);
+    assert_non_null(a);
+
+    assert_int_equal(a->size, 1 + (sizeof(bytes) - 1) / sizeof(sn_word));
+    assert_int_equal(a->blocks[0], WORD(0x06070809, 0x0203040506070809));
+    assert_int_equal(a->blocks[1], WORD(0x02030405, 0x01));
+#if SN_WORD_BITS == 32
+    assert_int_equal(a->blocks[2], 0x01);
+#endif // SN_WORD_BITS
+    assert_false(a->neg);
+
+    sn_free(a);
+}
+
+static void sn2bin__roundtrip(void **state) {
+    const uint8_t bytes[] = { 0xde, 0xad, 0xbe, 0xef, 0x00, 0x11, 0x22, 0x33,
+                              0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb };
+    uint8_t out[sizeof(bytes)];
+
+    SN *a = sn_bin2sn(bytes, sizeof(bytes), NULL);
+    assert_non_null(a);
+
+    assert_int_equal(sn_sn2bin(a, out), sizeof(bytes));
+    assert_memory_equal(out, bytes, sizeof(bytes));
+
+    sn_free(a);
+}
+
+/* Every combination of word order and byte order, against byte strings built by hand */
+static void export__formats(void **state) {
+    const uint8_t be[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b };
+    const size_t sizes[] = { 1, 2, 3, 4, 8, 16 };
+    uint8_t out[32], expected[32];
+
+    SN *a = sn_bin2sn(be, sizeof(be), NULL), *b = sn_new();
+    assert_non_null(a);
+
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(*sizes); ++k) {
+        const size_t size = sizes[k], count = (sizeof(be) + size - 1) / size;
+        assert_int_equal(sn_export_size(a, size, 0), count);
+
+        for (int order = -1; order <= 1; order += 2) {
+            for (int endian = -1; endian <= 1; endian += 2) {
+                /* Byte i of the number, counting from the least significant one */
+                memset(expected, 0, sizeof(expected));
+                for (size_t i = 0; i < sizeof(be); ++i) {
+                    const size_t word = i / size, byte = i % size;
+                    expected[(order > 0 ? count - 1 - word : word) * size
+                             + (endian > 0 ? size - 1 - byte : byte)] = be[sizeof(be) - 1 - i];
+                }
+
+                memset(out, 0xee, sizeof(out));
+                assert_int_equal(sn_export(out, order, size, endian, 0, a), count);
+                assert_memory_equal(out, expected, count * size);
+                assert_int_equal(out[count * size], 0xee);
+
+                assert_non_null(sn_import(b, count, order, size, endian, 0, expected));
+                assert_sn_equal(b, a);
+            }
+        }
+    }
+
+    /* Zero has no words */
+    sn_zero(a);
+    assert_int_equal(sn_export_size(a, 4, 0), 0);
+    assert_int_equal(sn_export(out, 1, 4, 0, 0, a), 0);
+    assert_non_null(sn_import(b, 0, 1, 4, 0, 0, NULL));
+    assert_true(sn_is_zero(b));
+
+    sn_free(a);
+    sn_free(b);
+}
+
+/* Words with unused top bits, e.g. 7 bits to a byte */
+static void export__nails(void **state) {
+    uint64_t seed = 0x4a11;
+
+    for (size_t size = 1; size < 4 * sizeof(sn_word); size += 3) {
+        for (size_t nails = 1; nails < 8 * size; nails += 5) {
+            SN *a = random_number(3, &seed), *b = sn_new();
+            const size_t count = sn_export_size(a, size, nails);
+            uint8_t *out = malloc(count * size);
+            assert_non_null(out);
+
+            assert_int_equal(count, (sn_num_bits(a) + 8 * size - nails - 1) / (8 * size - nails));
+            assert_int_equal(sn_export(out, -1, size, 1, nails, a), count);
+
+            /* The nails are zero on export and ignored on import */
+            for (size_t i = 0; i < count; ++i) {
+                for (size_t bit = 8 * size - nails; bit < 8 * size; ++bit) {
+                    uint8_t *byte = &out[i * size + size - 1 - bit / 8];
+                    assert_int_equal(*byte >> (bit % 8) & 1, 0);
+                    *byte |= (uint8_t)(1 << (bit % 8));
+                }
+            }
+
+            assert_non_null(sn_import(b, count, -1, size, 1, nails, out));
+            assert_sn_equal(b, a);
+
+            free(out);
+            sn_free(a);
+            sn_free(b);
+        }
+    }
+}
+
+/* Known values in several radixes, and malformed strings */
+static void to_str__known_values(void **state) {
+    const struct {
+        const char *in, *out;
+        unsigned radix;
+    } cases[] = {
+        { "0",                     "0",                     10 },
+        { "-0",                    "0",                     10 },
+        { "+000123",               "123",                   10 },
+        { "-18446744073709551616", "-18446744073709551616", 10 },
+        { "DeadBeef0123456789",    "deadbeef0123456789",    16 },
+        { "-101",                  "-101",                  2 },
+        { "777777777777777777777", "777777777777777777777", 8 },
+        { "zz",                    "zz",                    36 },
+        { "2101",                  "2101",                  3 },
+    };
+    const char *bad[] = { "", "-", "12a", " 1", "1 ", "0x10", "--1" };
+    char buffer[64];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+        SN *a = sn_from_str(cases[i].in, cases[i].radix, NULL);
+        assert_non_null(a);
+        assert_true(sn_str_size(a, cases[i].radix) <= sizeof(buffer));
+        assert_int_equal(sn_to_str(a, cases[i].radix, buffer), strlen(cases[i].out));
+        assert_string_equal(buffer, cases[i].out);
+        sn_free(a);
+    }
+
+    SN *a = sn_new();
+    for (size_t i = 0; i < sizeof(bad) / sizeof(*bad); ++i) {
+        assert_null(sn_from_str(bad[i], 10, a));
+    }
+    assert_null(sn_from_str("2", 2, a));
+    sn_free(a);
+}
+
+/* Divide and conquer agrees with the chunked conversion in both directions */
+static void to_str__divide_and_conquer(void **state) {
+    const unsigned radixes[] = { 10, 16, 3, 36, 2, 32 };
+    const size_t saved = sn_get_threshold(SN_THRESHOLD_STR_DC);
+    uint64_t seed = 0x57e;
+
+    for (size_t i = 0; i < sizeof(radixes) / sizeof(*radixes); ++i) {
+        for (size_t size = 1; size < 120; size += 17) {
+            SN *a = random_number(size, &seed), *back = sn_new();
+            a->neg = size % 2;
+            /* Runs of zero digits must survive the split */
+            if (size > 40) {
+                memset(a->blocks + 10, 0, 20 * sizeof(*a->blocks));
+            }
+
+            const size_t length = sn_str_size(a, radixes[i]);
+            char *slow = malloc(length), *fast = malloc(length);
+            assert_non_null(slow);
+            assert_non_null(fast);
+
+            sn_set_threshold(SN_THRESHOLD_STR_DC, SIZE_MAX);
+            const size_t slow_len = sn_to_str(a, radixes[i], slow);
+            assert_true(slow_len > 0 && slow_len < length);
+
+            sn_set_threshold(SN_THRESHOLD_STR_DC, 2);
+            assert_int_equal(sn_to_str(a, radixes[i], fast), slow_len);
+            assert_string_equal(fast, slow);
+            assert_non_null(sn_from_str(fast, radixes[i], back));
+            assert_sn_equal(back, a);
+
+            sn_set_threshold(SN_THRESHOLD_STR_DC, SIZE_MAX);
+            assert_non_null(sn_from_str(slow, radixes[i], back));
+            assert_sn_equal(back, a);
+
+            free(slow);
+            free(fast);
+            sn_free(a);
+            sn_free(back);
+        }
+    }
+
+    sn_set_threshold(SN_THRESHOLD_STR_DC, saved);
+}
+
+/* Serialization */
+
+#define STREAM_COUNT 12
+
+/* Numbers of all sizes and signs, including zero and a very long one */
+static void stream_numbers(SN *nums[STREAM_COUNT]) {
+    uint64_t seed = 0x5e7;
+
+    for (size_t i = 0; i < STREAM_COUNT; ++i) {
+        nums[i] = random_number(i == STREAM_COUNT - 1 ? 20000 : 1 + i * i, &seed);
+        nums[i]->neg = i % 3 == 1;
+    }
+    sn_zero(nums[0]);
+    nums[1]->blocks[0] = 5;
+}
+
+static void free_numbers(SN *nums[STREAM_COUNT]) {
+    for (size_t i = 0; i < STREAM_COUNT; ++i) {
+        sn_free(nums[i]);
+    }
+}
+
+static void stream__roundtrip(void **state) {
+    SN *nums[STREAM_COUNT], *num = sn_new();
+    stream_numbers(nums);
+
+    for (unsigned flags = 0; flags <= SN_STREAM_ALIGNED; ++flags) {
+        FILE *file = tmpfile();
+        assert_non_null(file);
+
+        sn_writer *writer = sn_writer_new(file, flags);
+        assert_non_null(writer);
+        for (size_t i = 0; i < STREAM_COUNT; ++i) {
+            assert_true(sn_write(writer, nums[i]));
+        }
+        assert_true(sn_writer_free(writer));
+
+        rewind(file);
+        sn_reader *reader = sn_reader_new(file);
+        assert_non_null(reader);
+        for (size_t i = 0; i < STREAM_COUNT; ++i) {
+            assert_non_null(sn_read(reader, num));
+            assert_sn_equal(num, nums[i]);
+        }
+        assert_null(sn_read(reader, num));
+        assert_false(sn_reader_error(reader));
+        sn_reader_free(reader);
+
+        fclose(file);
+    }
+
+    free_numbers(nums);
+    sn_free(num);
+}
+
+/* Small values take a byte or two, and headers and records are checked */
+static void stream__compact_and_malformed(void **state) {
+    const uint8_t truncated[] = { 'S', 'N', 'U', 'M', 1, 0, 0, 0, 10 << 1, 1, 2, 3 };
+    const uint8_t bad_magic[] = { 'S', 'N', 'U', 'X', 1, 0, 0, 0 };
+    /* A length of 2^62 bytes with only three of them present */
+    const uint8_t huge[] = {
+        'S', 'N', 'U', 'M', 1, 0, 0, 0, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01,
+        1, 2, 3
+    };
+    SN *num = sn_new();
+
+    FILE *file = tmpfile();
+    assert_non_null(file);
+    sn_writer *writer = sn_writer_new(file, 0);
+    sn_one(num);
+    assert_true(sn_write(writer, num));
+    sn_zero(num);
+    assert_true(sn_write(writer, num));
+    assert_true(sn_writer_free(writer));
+    /* The header, then a length byte and a magnitude byte for one */
+    assert_int_equal(ftell(file), 8 + 2 + 1);
+    fclose(file);
+
+    file = tmpfile();
+    assert_non_null(file);
+    fwrite(truncated, 1, sizeof(truncated), file);
+    rewind(file);
+    sn_reader *reader = sn_reader_new(file);
+    assert_non_null(reader);
+    assert_null(sn_read(reader, num));
+    assert_true(sn_reader_error(reader));
+    sn_reader_free(reader);
+    fclose(file);
+
+    file = tmpfile();
+    assert_non_null(file);
+    fwrite(huge, 1, sizeof(huge), file);
+    rewind(file);
+    reader = sn_reader_new(file);
+    assert_non_null(reader);
+    assert_null(sn_read(reader, num));
+    assert_true(sn_reader_error(reader));
+    sn_reader_free(reader);
+    fclose(file);
+
+    file = tmpfile();
+    assert_non_null(file);
+    fwrite(bad_magic, 1, sizeof(bad_magic), file);
+    rewind(file);
+    assert_null(sn_reader_new(file));
+    fclose(file);
+
+    sn_free(num);
+}
+
+/* Aligned streams in memory, as if mapped from a file, give views */
+static void stream__views(void **state) {
+    SN *nums[STREAM_COUNT], view;
+    stream_numbers(nums);
+
+    for (unsigned flags = 0; flags <= SN_STREAM_ALIGNED; ++flags) {
+        FILE *file = tmpfile();
+        assert_non_null(file);
+        sn_writer *writer = sn_writer_new(file, flags);
+        for (size_t i = 0; i < STREAM_COUNT; ++i) {
+            assert_true(sn_write(writer, nums[i]));
+        }
+        assert_true(sn_writer_free(writer));
+
+        const size_t length = (size_t)ftell(file);
+        uint64_t *data = malloc(length + sizeof(*data));
+        assert_non_null(data);
+        rewind(file);
+        assert_int_equal(fread(data, 1, length, file), length);
+        fclose(file);
+
+        size_t pos = 0;
+        if (flags & SN_STREAM_ALIGNED) {
+            for (size_t i = 0; i < STREAM_COUNT; ++i) {
+                assert_non_null(sn_stream_view(&view, data, length, &pos));
+                assert_int_equal(sn_cmp(&view, nums[i]), 0);
+                assert_int_equal(sn_is_view(&view), !sn_is_zero(nums[i]));
+            }
+            assert_int_equal(pos, length);
+        }
+        assert_null(sn_stream_view(&view, data, length, &pos));
+
+        free(data);
+    }
+
+    free_numbers(nums);
+}
+
+/* Views are only handed out for records sn_write() could have produced */
+static void stream__views_malformed(void **state) {
+    /* One, then a varint whose tenth byte overflows 64 bits */
+    const uint8_t records[] = {
+        'S', 'N', 'U', 'M', 1, SN_STREAM_ALIGNED, 0, 0,
+        1 << 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02, 0, 0, 0, 0, 0, 0,
+    };
+    uint64_t data[sizeof(records) / sizeof(uint64_t)];
+    uint8_t *bytes = (uint8_t *)data;
+    SN view;
+    size_t pos = 0;
+
+    memcpy(data, records, sizeof(records));
+    assert_non_null(sn_stream_view(&view, data, sizeof(data), &pos));
+    assert_true(sn_is_one(&view));
+    assert_null(sn_stream_view(&view, data, sizeof(data), &pos));
+
+    /* Nonzero padding after the varint and after the magnitude */
+    bytes[9] = 1;
+    pos = 0;
+    assert_null(sn_stream_view(&view, data, sizeof(data), &pos));
+    bytes[9]  = 0;
+    bytes[17] = 1;
+    pos = 0;
+    assert_null(sn_stream_view(&view, data, sizeof(data), &pos));
+}
+
+#if SN_FD_STREAMS
+static void stream__file_descriptor(void **state) {
+    SN *nums[STREAM_COUNT], *num = sn_new();
+    stream_numbers(nums);
+
+    FILE *file = tmpfile();
+    assert_non_null(file);
+    const int fd = fileno(file);
+
+    sn_writer *writer = sn_writer_fd(fd, SN_STREAM_ALIGNED);
+    for (size_t i = 0; i < STREAM_COUNT; ++i) {
+        assert_true(sn_write(writer, nums[i]));
+    }
+    assert_true(sn_writer_free(writer));
+
+    assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+    sn_reader *reader = sn_reader_fd(fd);
+    assert_non_null(reader);
+    for (size_t i = 0; i < STREAM_COUNT; ++i) {
+        SN *read = sn_read(reader, NULL);
+        assert_non_null(read);
+        assert_sn_equal(read, nums[i]);
+        sn_free(read);
+    }
+    assert_null(sn_read(reader, num));
+    assert_false(sn_reader_error(reader));
+    sn_reader_free(reader);
+
+    fclose(file);
+    free_numbers(nums);
+    sn_free(num);
+}
+#endif // SN_FD_STREAMS
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         /* Initialization */
         cmocka_unit_test(init__unitialized),
         cmocka_unit_test(init__initialized),
         cmocka_unit_test(new__basic),
+        cmocka_unit_test(init__inline_storage),
         /* Copying */
         cmocka_unit_test(copy__01),
         cmocka_unit_test(duplicate__01),
         /* Swapping */
         cmocka_unit_test(swap__01),
+        cmocka_unit_test(swap__inline),
+        cmocka_unit_test(view__read_only_operations),
+        cmocka_unit_test(view__result_detaches),
         /* Cleanup */
         cmocka_unit_test(free__01),
         cmocka_unit_test(clear__01),
@@ -593,6 +3150,20 @@ int main(void) {
         cmocka_unit_test(zero__multiple_words),
         cmocka_unit_test(one__one_word),
         cmocka_unit_test(one__multiple_words),
+        cmocka_unit_test(zero__keeps_capacity),
+        /* Capacity */
+        cmocka_unit_test(reserve__keeps_value),
+        cmocka_unit_test(add__accumulate_without_realloc),
+        /* Memory management */
+        cmocka_unit_test(allocator__custom_functions),
+        cmocka_unit_test(ctx__arena_reuse),
+        cmocka_unit_test(ctx__use_nests),
+        /* Comparisons */
+        cmocka_unit_test(ucmp__most_significant_first),
+        cmocka_unit_test(sub__result_normalized),
+        /* Sizes */
+        cmocka_unit_test(num_bits__exact),
+        cmocka_unit_test(sn2bin__strips_leading_zeros),
         /* Addition */
         cmocka_unit_test(add__zero_plus_zero),
         cmocka_unit_test(add__one_plus_zero),
@@ -601,18 +3172,99 @@ int main(void) {
         cmocka_unit_test(add__size_1_nonoverflow),
         cmocka_unit_test(add__size_1_overflow),
         cmocka_unit_test(add__size_2_overflow),
+        cmocka_unit_test(add__long_carry_chain),
+        cmocka_unit_test(add__in_place),
         /* Subtraction */
         cmocka_unit_test(sub__size_1_nonunderflow),
         cmocka_unit_test(sub__size_2_underflow),
         cmocka_unit_test(sub__size_3_underflow),
+        cmocka_unit_test(sub__negative_result),
+        cmocka_unit_test(sub__in_place),
         /* Multiplication */
         cmocka_unit_test(mul__zero_times_zero),
         cmocka_unit_test(mul__zero_times_one),
         cmocka_unit_test(mul__one_times_zero),
         cmocka_unit_test(mul__one_times_one),
         cmocka_unit_test(mul__ten_times_one),
-        cmocka_unit_test(mul__0x10000_times_0x10000_overflow),
+        cmocka_unit_test(mul__half_word_times_half_word_overflow),
         cmocka_unit_test(mul__size_1_overflow),
+        cmocka_unit_test(mul__size_2_times_size_2),
+        cmocka_unit_test(mul__size_3_times_size_1_normalized),
+        cmocka_unit_test(mul__signs),
+        cmocka_unit_test(mul__in_place),
+        cmocka_unit_test(mul__karatsuba_matches_schoolbook),
+        cmocka_unit_test(mul__toom3_matches_schoolbook),
+        cmocka_unit_test(mul__ntt_matches_schoolbook),
+        /* Squaring */
+        cmocka_unit_test(sqr__size_1),
+        cmocka_unit_test(sqr__in_place),
+        cmocka_unit_test(mul__negated_alias),
+        cmocka_unit_test(sqr__karatsuba_matches_mul),
+        cmocka_unit_test(sqr__toom3_matches_mul),
+        cmocka_unit_test(sqr__ntt_matches_mul),
+        /* Division */
+        cmocka_unit_test(divmod__signs),
+        cmocka_unit_test(divmod__by_zero),
+        cmocka_unit_test(divmod__dividend_smaller),
+        cmocka_unit_test(divmod__size_2_by_size_1),
+        cmocka_unit_test(divmod__aliased_operands),
+        cmocka_unit_test(divmod__burnikel_ziegler_matches_knuth),
+        cmocka_unit_test(divmod__burnikel_ziegler_single_block_base),
+        /* Shifts and bitwise operations */
+        cmocka_unit_test(shl_shr__match_mul_div),
+        cmocka_unit_test(shr__past_the_top),
+        cmocka_unit_test(bitwise__matches_machine_integers),
+        cmocka_unit_test(bitwise__identities),
+        cmocka_unit_test(setbit_clrbit__match_or_and),
+        cmocka_unit_test(popcount__01),
+        /* Roots */
+        cmocka_unit_test(sqrtrem__small_values),
+        cmocka_unit_test(sqrtrem__around_squares),
+        cmocka_unit_test(root__around_powers),
+        cmocka_unit_test(root__edge_cases),
+        /* Modular arithmetic */
+        cmocka_unit_test(mont_ctx_new__even_modulus),
+        cmocka_unit_test(powm__size_1),
+        cmocka_unit_test(powm__fermat_mersenne_prime),
+        cmocka_unit_test(mont_mul__matches_mod),
+        cmocka_unit_test(powm_batch__matches_powm),
+        cmocka_unit_test(barrett_ctx_new__zero_modulus),
+        cmocka_unit_test(mulmod_barrett__even_modulus),
+        cmocka_unit_test(mod_barrett__matches_mod),
+        /* Number theory */
+        cmocka_unit_test(gcd__known_values),
+        cmocka_unit_test(gcd__lehmer_matches_binary),
+        cmocka_unit_test(gcd__hgcd_matches_binary),
+        cmocka_unit_test(gcd__hgcd_unbalanced_matches_lehmer),
+        cmocka_unit_test(invert__matches_mod),
+        cmocka_unit_test(probab_prime__known_values),
+        cmocka_unit_test(probab_prime__matches_trial_division),
+        cmocka_unit_test(next_prime__known_values),
+        cmocka_unit_test(next_prime__skips_no_prime),
+        /* Batches */
+        cmocka_unit_test(batch__set_get),
+        cmocka_unit_test(batch__add_sub_match_sn),
+        cmocka_unit_test(batch__mul_matches_mul),
+        cmocka_unit_test(batch__cmp),
+        /* Fixed-width numbers */
+        cmocka_unit_test(fixed__from_sn),
+        cmocka_unit_test(fixed__arith_matches_sn),
+        cmocka_unit_test(fixed__mont_matches_mod),
+        /* Conversion */
+        cmocka_unit_test(bin2sn__unaligned_length),
+        cmocka_unit_test(sn2bin__roundtrip),
+        cmocka_unit_test(export__formats),
+        cmocka_unit_test(export__nails),
+        cmocka_unit_test(to_str__known_values),
+        cmocka_unit_test(to_str__divide_and_conquer),
+        /* Serialization */
+        cmocka_unit_test(stream__roundtrip),
+        cmocka_unit_test(stream__compact_and_malformed),
+        cmocka_unit_test(stream__views),
+        cmocka_unit_test(stream__views_malformed),
+#if SN_FD_STREAMS
+        cmocka_unit_test(stream__file_descriptor),
+#endif // SN_FD_STREAMS
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
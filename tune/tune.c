@@ -0,0 +1,170 @@
+/*
+ * Measure the crossover points between the multiplication, squaring,
+ * division, string conversion and GCD algorithms on the host CPU and print
+ * them in a form that can be pasted into the build, e.g.
+ *
+ *     #define SN_MUL_KARATSUBA_THRESHOLD 28
+ *
+ * The same values can also be installed at run time with sn_set_threshold().
+ * Build without sanitizers and with optimizations for meaningful results.
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../number.h"
+
+/* Minimum wall clock time of one measurement, in seconds */
+#define MIN_MEASURE_TIME 0.005
+/* Number of consecutive sizes the new algorithm must win to accept a crossover */
+#define WINS_NEEDED 3
+
+typedef SN *(*binary_op)(SN * const, const SN *, const SN *);
+
+struct tunable {
+    sn_threshold threshold;
+    const char  *name;
+    binary_op    op;
+    size_t       lo, hi, step; /* A zero `step` grows the size by a quarter instead */
+    size_t       a_scale; /* Size of the first operand relative to the second */
+    int          after; /* Index of the tunable whose crossover bounds `lo`, or -1 */
+};
+
+static SN *sqr(SN * const res, const SN *a, const SN *b) {
+    return sn_sqr(res, a);
+}
+
+/* Large enough for the decimal digits of the largest number tuned */
+static char digits[1 << 16];
+
+static SN *to_str(SN * const res, const SN *a, const SN *b) {
+    return sn_to_str(a, 10, digits) ? res : NULL;
+}
+
+/* Division, string conversion and GCD are tuned last, on top of the multiplication thresholds */
+static const struct tunable tunables[] = {
+    { SN_THRESHOLD_MUL_KARATSUBA, "SN_MUL_KARATSUBA_THRESHOLD", sn_mul, 4,   200,     2,  1, -1 },
+    { SN_THRESHOLD_MUL_TOOM3,     "SN_MUL_TOOM3_THRESHOLD",     sn_mul, 16,  1000,    8,  1,  0 },
+    { SN_THRESHOLD_MUL_NTT,       "SN_MUL_NTT_THRESHOLD",       sn_mul, 512, 1 << 19, 0,  1,  1 },
+    { SN_THRESHOLD_SQR_KARATSUBA, "SN_SQR_KARATSUBA_THRESHOLD", sqr,    4,   200,     2,  1, -1 },
+    { SN_THRESHOLD_SQR_TOOM3,     "SN_SQR_TOOM3_THRESHOLD",     sqr,    16,  1000,    8,  1,  3 },
+    { SN_THRESHOLD_SQR_NTT,       "SN_SQR_NTT_THRESHOLD",       sqr,    512, 1 << 19, 0,  1,  4 },
+    { SN_THRESHOLD_DIV_BZ,        "SN_DIV_BZ_THRESHOLD",        sn_div, 8,   400,     4,  2, -1 },
+    { SN_THRESHOLD_STR_DC,        "SN_STR_DC_THRESHOLD",        to_str, 4,   400,     4,  1, -1 },
+    { SN_THRESHOLD_GCD_LEHMER,    "SN_GCD_LEHMER_THRESHOLD",    sn_gcd, 2,   40,      1,  1, -1 },
+    { SN_THRESHOLD_GCD_HGCD,      "SN_GCD_HGCD_THRESHOLD",      sn_gcd, 40,  2000,    20, 1, -1 },
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static SN *random_number(size_t blocks) {
+    size_t   length = blocks * sizeof(sn_word);
+    uint8_t *bytes  = malloc(length);
+    if (!bytes) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < length; ++i) {
+        bytes[i] = (uint8_t)rand();
+    }
+    bytes[0] |= 0x80;
+
+    SN *num = sn_bin2sn(bytes, length, NULL);
+    free(bytes);
+
+    return num;
+}
+
+/* Best-of-three time of a single `op(res, a, b)` call, in seconds */
+static double time_op(binary_op op, SN *res, const SN *a, const SN *b) {
+    double best = 0;
+
+    for (int round = 0; round < 3; ++round) {
+        size_t reps = 0;
+        double start = now(), elapsed;
+        do {
+            op(res, a, b);
+            ++reps;
+        } while ((elapsed = now() - start) < MIN_MEASURE_TIME);
+
+        elapsed /= reps;
+        if (round == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Find the smallest size from which switching to the next algorithm at the
+ * top level of the recursion is consistently faster than staying with the
+ * current one, or SIZE_MAX if it never is up to `t->hi`.
+ */
+static size_t find_crossover(const struct tunable *t, size_t lo) {
+    size_t wins = 0, first_win = 0;
+
+    for (size_t n = lo; n <= t->hi; n += t->step ? t->step : max(n / 4, 1)) {
+        SN *a = random_number(n * t->a_scale), *b = random_number(n), *res = sn_new();
+        if (!a || !b || !res) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+
+        sn_set_threshold(t->threshold, n + 1);
+        double old_time = time_op(t->op, res, a, b);
+        sn_set_threshold(t->threshold, n);
+        double new_time = time_op(t->op, res, a, b);
+
+        sn_free(a);
+        sn_free(b);
+        sn_free(res);
+
+        if (new_time < old_time) {
+            if (wins++ == 0) {
+                first_win = n;
+            }
+            if (wins == WINS_NEEDED) {
+                return first_win;
+            }
+        } else {
+            wins = 0;
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+int main(void) {
+    srand(1);
+
+    const size_t count = sizeof(tunables) / sizeof(*tunables);
+    size_t found[sizeof(tunables) / sizeof(*tunables)];
+
+    printf("/* smallnum thresholds for %d-bit blocks */\n", SN_WORD_BITS);
+    for (size_t i = 0; i < count; ++i) {
+        const struct tunable *t = &tunables[i];
+        /* A faster algorithm only takes over where the previous one already has */
+        size_t lo = t->after < 0 ? t->lo : max(t->lo, found[t->after]);
+        size_t n = found[i] = find_crossover(t, lo);
+        /* Later algorithms are tuned on top of the earlier crossovers */
+        sn_set_threshold(t->threshold, n);
+        if (n == SIZE_MAX) {
+            printf("#define %-32s SIZE_MAX /* no crossover up to %zu */\n", t->name, t->hi);
+        } else {
+            printf("#define %-32s %zu\n", t->name, n);
+        }
+        fflush(stdout);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* vim: set et sw=4: */